@@ -0,0 +1,156 @@
+// Header Guards
+#ifndef ANALOG_CACHE_H_
+#define ANALOG_CACHE_H_
+
+#include <Arduino.h>
+#include "AdcFilter.h"
+
+// The resolution the ADC is read at, in bits
+#ifndef ANALOG_CACHE_ADC_BITS
+#define ANALOG_CACHE_ADC_BITS 12
+#endif
+
+// The number of readings in each burst, after the priming readings
+#ifndef ANALOG_CACHE_SAMPLES
+#define ANALOG_CACHE_SAMPLES 16
+#endif
+
+// The time to let a channel settle after turning its power on, in milliseconds
+#ifndef ANALOG_CACHE_POWER_WARM_UP_MS
+#define ANALOG_CACHE_POWER_WARM_UP_MS 10
+#endif
+
+/**
+ * @brief Reads an analog voltage, like a battery through a divider, once per
+ * logging cycle and hands the same value to everything that asks for it.
+ *
+ * The first getVoltage() after expire() reads the channel: two priming
+ * readings are thrown away, then a quick burst of readings is taken and run
+ * through adcFilter, which drops the outliers and averages the rest.  Every
+ * later call returns that value until the cache is expired again, which the
+ * program does at the start of each cycle.  The lowest and highest readings
+ * kept are saved as well, to show how noisy the channel is.  If the channel
+ * needs power to be read, like the 12V battery behind the relay, the power is
+ * turned on for the reading and left as it was found.
+ *
+ * The time of the reading is kept so a value carried over from earlier can be
+ * spotted.  It's from millis(), which stops while the processor sleeps, so the
+ * age doesn't count any sleep since the reading.
+ */
+class analogCache {
+ public:
+    /**
+     * @param pin The analog pin to read
+     * @param multiplier The divider ratio, to turn the volts at the pin into
+     * the volts being measured
+     * @param operating_voltage The ADC reference voltage
+     * @param power_pin A pin that must be high while reading, or -1 for none
+     * @param samples The number of readings in each burst, up to
+     * ADC_FILTER_MAX_SAMPLES
+     */
+    analogCache(int8_t pin, float multiplier, float operating_voltage = 3.3,
+                int8_t power_pin = -1, uint8_t samples = ANALOG_CACHE_SAMPLES)
+        : _pin(pin),
+          _multiplier(multiplier),
+          _operatingVoltage(operating_voltage),
+          _powerPin(power_pin),
+          _samples(samples > ADC_FILTER_MAX_SAMPLES ? ADC_FILTER_MAX_SAMPLES
+                                                    : samples),
+          _fresh(false),
+          _volts(-9999),
+          _burst({-9999, 0, 0, 0, 0}),
+          _readMillis(0) {}
+    ~analogCache() {}
+
+    // Start a new cycle, so the next getVoltage() reads the channel again
+    void expire() {
+        _fresh = false;
+    }
+
+    // The voltage, read once per cycle; -9999 if there's no pin
+    float getVoltage() {
+        if (!_fresh) { read(); }
+        return _volts;
+    }
+
+    // The lowest reading kept from the last burst, in volts
+    float getMinVoltage() {
+        return _burst.used ? toVolts(_burst.min) : -9999;
+    }
+
+    // The highest reading kept from the last burst, in volts
+    float getMaxVoltage() {
+        return _burst.used ? toVolts(_burst.max) : -9999;
+    }
+
+    // The number of readings thrown out of the last burst as outliers
+    uint8_t getRejectedCount() {
+        return _burst.rejected;
+    }
+
+    // Whether the value has been read since the cache was last expired
+    bool isFresh() {
+        return _fresh;
+    }
+
+    // The millis() when the channel was last read
+    uint32_t getReadMillis() {
+        return _readMillis;
+    }
+
+    // The time since the channel was last read, in milliseconds
+    uint32_t getAgeMillis() {
+        return millis() - _readMillis;
+    }
+
+ protected:
+    void read() {
+        _fresh      = true;
+        _readMillis = millis();
+        if (_pin < 0 || _multiplier <= 0) {
+            _volts = -9999;
+            return;
+        }
+
+        bool powered = false;
+        if (_powerPin >= 0 && digitalRead(_powerPin) != HIGH) {
+            pinMode(_powerPin, OUTPUT);
+            digitalWrite(_powerPin, HIGH);
+            powered = true;
+            delay(ANALOG_CACHE_POWER_WARM_UP_MS);
+        }
+
+        analogReadResolution(ANALOG_CACHE_ADC_BITS);
+        pinMode(_pin, INPUT);
+        analogRead(_pin);  // priming reading
+        analogRead(_pin);  // another priming reading
+        // The return value from analogRead() is IN BITS NOT IN VOLTS!!
+        uint16_t samples[ADC_FILTER_MAX_SAMPLES];
+        for (uint8_t i = 0; i < _samples; i++) {
+            samples[i] = analogRead(_pin);
+        }
+        if (powered) { digitalWrite(_powerPin, LOW); }
+
+        _burst = adcFilter::filter(samples, _samples);
+        _volts = _burst.used ? toVolts(_burst.mean) : -9999;
+    }
+
+    // Converts bits at the pin to the volts being measured
+    float toVolts(float bits) {
+        float per_bit = _operatingVoltage /
+            static_cast<float>((1 << ANALOG_CACHE_ADC_BITS) - 1);
+        return per_bit * _multiplier * bits;
+    }
+
+    int8_t         _pin;
+    float          _multiplier;
+    float          _operatingVoltage;
+    int8_t         _powerPin;
+    uint8_t        _samples;
+    bool           _fresh;
+    float          _volts;
+    adcBurstResult _burst;
+    uint32_t       _readMillis;
+};
+
+#endif
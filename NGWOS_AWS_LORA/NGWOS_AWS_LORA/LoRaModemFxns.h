@@ -5,6 +5,29 @@
 #include <Arduino.h>
 #include <LoRa_AT.h>
 
+// The longest to wait for the modem to answer after power on or a wake
+#ifndef LORA_MODEM_READY_TIMEOUT_MS
+#define LORA_MODEM_READY_TIMEOUT_MS 10000L
+#endif
+// The longest pause between AT polls while waiting for the modem
+#ifndef LORA_MODEM_MAX_BACKOFF_MS
+#define LORA_MODEM_MAX_BACKOFF_MS 500L
+#endif
+// How many uplinks to send between saves of the network session to the
+// modem's flash.  A session restored after the modem lost power has its
+// uplink counter moved on by this much, past any frames sent since the save.
+#ifndef LORA_SESSION_SAVE_UPLINKS
+#define LORA_SESSION_SAVE_UPLINKS 32L
+#endif
+// Where the hash of the configuration the modem joined with is kept: the
+// backup RAM of the SAMD51, which isn't cleared by a reset
+#if defined(__SAMD51__) && !defined(LORA_CONFIG_HASH_ADDR)
+#define LORA_CONFIG_HASH_ADDR (BKUPRAM_ADDR + 16)
+#endif
+
+// "LCFG", to tell the saved hash from whatever was in the RAM at power on
+#define LORA_CONFIG_MAGIC 0x4C434647UL
+
 class loraModemAWS {
  public:
     loraModemAWS(const int8_t arduino_power_pin, const int8_t arduino_wake_pin,
@@ -28,6 +51,18 @@ class loraModemAWS {
     int8_t _lora_wake_pullup;
     // The LoRa module's wake trigger mode (ie, 0=ANY, 1=RISE, 2=FALL)
     int8_t _lora_wake_edge;
+    // The time the modem took to be ready after the last power on or wake
+    uint32_t _lastReadyMs = 0;
+    // Whether the modem is awake and answering, so it can be asked for things
+    // like its signal quality without waking it
+    bool _isAwake = false;
+
+    // The network settings sent by setupModemAWS()
+    _lora_class _loraClass  = CLASS_A;
+    bool        _isPublic   = true;
+    int8_t      _subBand    = 2;  // the sub-band used by The Things Network
+    bool        _useADR     = true;
+    int8_t      _ackRetries = 0;
 
     void setPinModes() {
         if (_power_pin_for_module >= 0) {
@@ -43,7 +78,7 @@ class loraModemAWS {
         if (_modemStatusPin >= 0) { pinMode(_modemStatusPin, INPUT); }
     }
 
-    void modemPowerOn() {
+    bool modemPowerOn(LoRa_AT& _lora_modem) {
         setPinModes();
         if (_power_pin_for_module >= 0) {
             Serial.print("Powering LoRa module with pin ");
@@ -52,11 +87,55 @@ class loraModemAWS {
             digitalWrite(_power_pin_for_module, HIGH);
 
             Serial.println(F("Wait..."));
-            delay(1000L);
+            _isAwake = waitForReady(_lora_modem);
+            return _isAwake;
         }
+        _isAwake = true;
+        return true;
+    }
+
+    // Waits for the modem to be ready for commands: first for the status pin to
+    // go high, if there is one, then for the modem to answer "AT", polling with
+    // a doubling pause between tries.  The time it took is kept in
+    // _lastReadyMs.
+    bool waitForReady(LoRa_AT& _lora_modem,
+                      uint32_t timeout_ms = LORA_MODEM_READY_TIMEOUT_MS) {
+        uint32_t start = millis();
+        if (_modemStatusPin >= 0) {
+            pinMode(_modemStatusPin, INPUT);
+            while (digitalRead(_modemStatusPin) != HIGH &&
+                   millis() - start < timeout_ms) {
+                delay(1);
+            }
+        }
+        uint32_t backoff = 5;
+        bool     ready   = false;
+        // always try at least once, even if the status pin never went high
+        do {
+            ready = _lora_modem.testAT(backoff);
+            if (!ready) {
+                delay(backoff);
+                backoff *= 2;
+                if (backoff > LORA_MODEM_MAX_BACKOFF_MS) {
+                    backoff = LORA_MODEM_MAX_BACKOFF_MS;
+                }
+            }
+        } while (!ready && millis() - start < timeout_ms);
+        _lastReadyMs = millis() - start;
+        Serial.print(ready ? F("  LoRa modem ready after ")
+                           : F("--LoRa modem not ready after "));
+        Serial.print(_lastReadyMs);
+        Serial.println(F(" ms"));
+        return ready;
     }
 
-    bool setupModemAWS(LoRa_AT& _lora_modem) {
+    // Sets up the modem with the network settings above.  If the modem
+    // joined with the same settings and keys before, it keeps the session it
+    // saved and nothing is sent again.  If anything changed, the settings are
+    // sent and saved, and the next modemConnect() joins again instead of
+    // restoring the old session.
+    bool setupModemAWS(LoRa_AT& _lora_modem, const char* _appEui,
+                       const char* _appKey) {
         bool success = true;
         Serial.println(F("Initializing modem..."));
         success &= _lora_modem.init();
@@ -69,17 +148,27 @@ class loraModemAWS {
         Serial.print(F("Module Info: "));
         Serial.println(modemInfo);
 
-        _lora_class currClass = CLASS_A;
-        if (_lora_modem.setClass(currClass)) {
+        // If the modem joined with this configuration, the configuration was
+        // saved with the session, so there's nothing to set up
+        _configHash = configHash(_appEui, _appKey);
+        if (getSavedConfigHash() == _configHash &&
+            restoreSession(_lora_modem)) {
+            Serial.println(F("  Restored the saved LoRaWAN session and "
+                             "configuration"));
+            return success;
+        }
+        Serial.println(F("  The configuration is new or has changed"));
+        _mustJoin = true;
+
+        if (_lora_modem.setClass(_loraClass)) {
             Serial.print(F("  Set LoRa device class to "));
-            Serial.println((char)currClass);
+            Serial.println((char)_loraClass);
         }
 
-        bool isPublic = true;
-        if (_lora_modem.setPublicNetwork(isPublic)) {
+        if (_lora_modem.setPublicNetwork(_isPublic)) {
             Serial.print(F("  Set public network mode to "));
-            Serial.println(isPublic ? "public network mode"
-                                    : "private network mode");
+            Serial.println(_isPublic ? "public network mode"
+                                     : "private network mode");
         }
 
         // get and set the current band to test functionality
@@ -87,31 +176,28 @@ class loraModemAWS {
         Serial.print(F("Device is currently using LoRa band "));
         Serial.println(currBand);
 
-        // Set the frequency sub-band to '2' (used by The Things Network)
-        int8_t subBand = 2;
-        if (_lora_modem.setFrequencySubBand(subBand)) {
+        // Set the frequency sub-band
+        if (_lora_modem.setFrequencySubBand(_subBand)) {
             Serial.print(F("  Set frequency sub-band to "));
-            Serial.println(subBand);
+            Serial.println(_subBand);
         } else {
             Serial.println(F("--Failed to set frequency sub-band"));
         }
 
         // enable adaptive data rate
         // https://www.thethingsnetwork.org/docs/lorawan/adaptive-data-rate/
-        bool useADR = true;
-        if (_lora_modem.setAdaptiveDataRate(useADR)) {
+        if (_lora_modem.setAdaptiveDataRate(_useADR)) {
             Serial.print(F("  Set to "));
-            Serial.print(useADR ? "use" : "not use");
+            Serial.print(_useADR ? "use" : "not use");
             Serial.println(F(" adaptive data rate"));
         } else {
             Serial.println(F("--Failed to set adaptive data rate"));
         }
 
-        // Set the ack count to 0 (no confirmation)
-        int8_t ackRetries = 0;
-        if (_lora_modem.setConfirmationRetries(ackRetries)) {
+        // Set the ack count (0 for no confirmation)
+        if (_lora_modem.setConfirmationRetries(_ackRetries)) {
             Serial.print(F("  Set ACK retry count to "));
-            Serial.println(ackRetries);
+            Serial.println(_ackRetries);
         } else {
             Serial.println(F("--Failed to set ACK retry count"));
         }
@@ -119,14 +205,96 @@ class loraModemAWS {
         // Don't ask for message confirmation
         _lora_modem.requireConfirmation(false);
 
+        // Save the configuration to the modem's flash so it doesn't need to be
+        // sent again
+        if (saveConfig(_lora_modem)) {
+            Serial.println(F("  Saved the configuration to the modem"));
+        } else {
+            Serial.println(F("--Failed to save the configuration"));
+        }
+
         return success;
     }
 
+    // Restores the network session saved in the modem's flash (AT+RS) if the
+    // modem isn't already joined
+    // Returns true if the modem is joined to the network afterwards
+    bool restoreSession(LoRa_AT& _lora_modem) {
+        if (_lora_modem.isNetworkConnected()) { return true; }
+        _lora_modem.sendAT(F("+RS"));
+        if (_lora_modem.waitResponse() != 1) { return false; }
+        if (!_lora_modem.isNetworkConnected()) { return false; }
+        // The saved uplink counter is behind by the frames sent since it was
+        // saved, and the network drops frames with a counter it's already
+        // seen, so move it past them and save it again
+        int32_t uplinks = getUplinkCounter(_lora_modem);
+        if (uplinks >= 0 &&
+            setUplinkCounter(_lora_modem,
+                             uplinks + LORA_SESSION_SAVE_UPLINKS) &&
+            saveSession(_lora_modem)) {
+            _savedUplinks = uplinks + LORA_SESSION_SAVE_UPLINKS;
+        }
+        return true;
+    }
+
+    // Saves the network session - the join status, keys, and frame counters -
+    // to the modem's flash (AT+SS)
+    bool saveSession(LoRa_AT& _lora_modem) {
+        _lora_modem.sendAT(F("+SS"));
+        return _lora_modem.waitResponse() == 1;
+    }
+
+    // Reads the modem's uplink frame counter (AT+UPC)
+    // Returns -1 if the modem doesn't answer
+    int32_t getUplinkCounter(LoRa_AT& _lora_modem) {
+        _lora_modem.sendAT(F("+UPC?"));
+        int32_t uplinks = _lora_modem.stream.parseInt();
+        if (_lora_modem.waitResponse() != 1) { return -1; }
+        return uplinks;
+    }
+
+    // Sets the modem's uplink frame counter (AT+UPC)
+    bool setUplinkCounter(LoRa_AT& _lora_modem, int32_t uplinks) {
+        _lora_modem.sendAT(F("+UPC="), uplinks);
+        return _lora_modem.waitResponse() == 1;
+    }
+
+    // Saves the configuration to the modem's flash (AT&W)
+    bool saveConfig(LoRa_AT& _lora_modem) {
+        _lora_modem.sendAT(F("&W"));
+        return _lora_modem.waitResponse() == 1;
+    }
+
     bool modemConnect(LoRa_AT& _lora_modem, const char* _appEui,
                       const char* _appKey) {
+        // Reuse the current session and only join if it's been lost or the
+        // configuration has changed since it was saved.  The saved session is
+        // only restored when the modem starts; once the network has dropped
+        // it, restoring it again would only send frames that are ignored.
+        if (!_mustJoin && _lora_modem.isNetworkConnected()) {
+            Serial.println(F("  Using the existing LoRaWAN session"));
+            return true;
+        }
         Serial.println(F("Attempting to connect to LoRa network without "
                          "OTAA and built-in device EUI..."));
-        return _lora_modem.joinOTAA(_appEui, _appKey);
+        if (!_lora_modem.joinOTAA(_appEui, _appKey)) { return false; }
+        // Only keep the hash once the session joined with the configuration
+        // is saved, so a failed join is tried again on the next start
+        if (saveSession(_lora_modem)) {
+            setSavedConfigHash(_configHash);
+            _savedUplinks = getUplinkCounter(_lora_modem);
+        }
+        _mustJoin = false;
+        return true;
+    }
+
+    // After a send fails: joins again if the modem says it's no longer
+    // joined, since the network has dropped the session
+    bool modemReconnect(LoRa_AT& _lora_modem, const char* _appEui,
+                        const char* _appKey) {
+        if (_lora_modem.isNetworkConnected()) { return true; }
+        _mustJoin = true;
+        return modemConnect(_lora_modem, _appEui, _appKey);
     }
 
     uint32_t modemGetTime(LoRa_AT& _lora_modem, uint8_t nRetries = 5) {
@@ -142,6 +310,16 @@ class loraModemAWS {
     }
 
     bool modemSleep(LoRa_AT& _lora_modem) {
+        // Save the session now and then so the frame counters are kept if the
+        // modem loses power or resets while it's asleep - not before every
+        // sleep, which would wear out the modem's flash
+        if (_lora_modem.isNetworkConnected()) {
+            int32_t uplinks = getUplinkCounter(_lora_modem);
+            if (uplinks >= _savedUplinks + LORA_SESSION_SAVE_UPLINKS &&
+                saveSession(_lora_modem)) {
+                _savedUplinks = uplinks;
+            }
+        }
         if (_arduino_wake_pin >= 0) {
             // test sleeping and waking with the an interrupt pin
             Serial.println(
@@ -150,6 +328,7 @@ class loraModemAWS {
                                      _lora_wake_edge)) {
                 Serial.println(F("  Put LoRa modem to sleep"));
                 _lora_modem.stream.flush();
+                _isAwake = false;
                 return true;
             } else {
                 Serial.println(F("--Failed to put LoRa modem to sleep"));
@@ -165,17 +344,20 @@ class loraModemAWS {
         // verify we have the power pin set
         setPinModes();
         if (_arduino_wake_pin >= 0) {
-            delay(5000);
             // Serial.print(F("Waking LoRa modem with a 50ms LOW pulse on pin
             // ")); Serial.println(_arduino_wake_pin); reset the pin mode - pins
             // tri-state at sleep
             pinMode(_power_pin_for_module, OUTPUT);
             pinMode(_arduino_wake_pin, OUTPUT);
-            digitalWrite(_arduino_wake_pin, LOW);
-            delay(50L);
-            digitalWrite(_arduino_wake_pin, HIGH);
+            // Only pulse the wake pin if the status pin says it's asleep
+            if (_modemStatusPin < 0 || digitalRead(_modemStatusPin) != HIGH) {
+                digitalWrite(_arduino_wake_pin, LOW);
+                delay(50L);
+                digitalWrite(_arduino_wake_pin, HIGH);
+            }
             // Serial.println(F("Testing AT to see if modem woke up"));
-            if (_lora_modem.testAT()) {
+            _isAwake = waitForReady(_lora_modem);
+            if (_isAwake) {
                 Serial.println(F("  Woke up LoRa modem"));
                 return true;
             } else {
@@ -183,7 +365,60 @@ class loraModemAWS {
                 return false;
             }
         }
+        _isAwake = true;
         return true;
     }
+
+ protected:
+    // An FNV-1a hash of the keys and network settings
+    uint32_t configHash(const char* _appEui, const char* _appKey) {
+        const uint8_t settings[] = {static_cast<uint8_t>(_loraClass),
+                                    _isPublic, static_cast<uint8_t>(_subBand),
+                                    _useADR,
+                                    static_cast<uint8_t>(_ackRetries)};
+
+        uint32_t hash = 2166136261UL;
+        for (const char* c = _appEui; *c; c++) {
+            hash = (hash ^ static_cast<uint8_t>(*c)) * 16777619UL;
+        }
+        for (const char* c = _appKey; *c; c++) {
+            hash = (hash ^ static_cast<uint8_t>(*c)) * 16777619UL;
+        }
+        for (size_t i = 0; i < sizeof(settings); i++) {
+            hash = (hash ^ settings[i]) * 16777619UL;
+        }
+        return hash;
+    }
+
+    // The hash of the configuration the modem last joined with, or 0 if
+    // there isn't one - it's lost with the power, so after a loss of power
+    // the modem is always set up and joined again
+    uint32_t getSavedConfigHash() {
+#ifdef LORA_CONFIG_HASH_ADDR
+        volatile uint32_t* saved = reinterpret_cast<volatile uint32_t*>(
+            LORA_CONFIG_HASH_ADDR);
+        if (saved[0] == LORA_CONFIG_MAGIC && saved[2] == ~saved[1]) {
+            return saved[1];
+        }
+#endif
+        return 0;
+    }
+
+    void setSavedConfigHash(uint32_t hash) {
+#ifdef LORA_CONFIG_HASH_ADDR
+        volatile uint32_t* saved = reinterpret_cast<volatile uint32_t*>(
+            LORA_CONFIG_HASH_ADDR);
+        saved[0] = LORA_CONFIG_MAGIC;
+        saved[1] = hash;
+        saved[2] = ~hash;
+#else
+        (void)hash;
+#endif
+    }
+
+    uint32_t _configHash = 0;      // the hash of the current configuration
+    bool     _mustJoin   = false;  // join even if a session could be restored
+    // The uplink counter when the session was last saved
+    int32_t _savedUplinks = 0;
 };
 #endif
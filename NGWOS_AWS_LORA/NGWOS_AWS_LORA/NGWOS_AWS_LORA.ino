@@ -78,6 +78,13 @@ const char* sketchName = "NGWOS_AWS_LORA.ino";
 const char* LoggerID = "YOUR_LORA_THING_NAME";
 // How frequently (in minutes) to log data
 const int8_t loggingInterval = 5;
+// How frequently (in minutes) to log data while the stage is changing quickly
+// NOTE: Every reading is sent while the stage is changing quickly.
+const int8_t eventLoggingInterval = 1;
+// The rise or fall of the stage, in m per hour, that starts an event
+const float stageEventRate = 0.15;
+// A stage, in m, that starts an event when it's crossed; -9999 for none
+const float stageEventThreshold = -9999;
 // The number of 1-minute intervals to take before moving to the set logging
 // interval
 const int8_t initialShortIntervals = 5;
@@ -227,6 +234,28 @@ Variable* hydrocamImageSize = new GeoluxHydroCam_ImageSize(&hydrocam);
 /** End [geolux_hydro_cam] */
 
 
+// ==========================================================================
+//  Battery Fuel Gauge and Energy Scheduler
+// ==========================================================================
+/** Start [energy_scheduler] */
+#include <Adafruit_MAX1704X.h>
+#include "EnergyScheduler.h"
+
+// Analog Devices MAX17048 3µA 1-Cell Fuel Gauge
+Adafruit_MAX17048 max17048;
+// Whether the fuel gauge was found; without it, the energy scheduler falls
+// back to the battery voltage
+bool fuelGaugeFound = false;
+
+// Decides how often to log, send, and take pictures from the battery charge,
+// its recent (dis)charge rate, and the light on the solar panel
+// NOTE: The logging interval above is the shortest used, when there's charge
+// to spare.  As the forecast charge runs low, the interval stretches to 2 and
+// then 4 times as long, and fewer readings are sent or pictured.
+energyScheduler scheduler;
+/** End [energy_scheduler] */
+
+
 // ==========================================================================
 //  Sensirion SHT4X Digital Humidity and Temperature Sensor
 // ==========================================================================
@@ -272,6 +301,19 @@ Variable* VegaPulsError       = new VegaPuls21_ErrorCode(&VegaPuls);
 /** End [vega_puls21] */
 
 
+// ==========================================================================
+//  Stage Event Detector
+// ==========================================================================
+/** Start [stage_event_detector] */
+#include "StageEventDetector.h"
+
+// Watches the Vega Puls stage for floods, to sample faster and send every
+// reading while the stage is changing quickly
+stageEventDetector stageWatch(stageEventRate, stageEventThreshold,
+                              loggingInterval * 60L);
+/** End [stage_event_detector] */
+
+
 // ==========================================================================
 //  Calculated Variables
 // ==========================================================================
@@ -288,7 +330,10 @@ const char* modemRSSIName = "RSSI";
 const char* modemRSSIUnit = "RSSI";
 // A short code for the variable
 const char* modemRSSICode = "loraRSSI";
-float       getLoRaSignalQuality() {
+// The modem is only woken for readings that are sent, so don't wake it or
+// wait on AT commands to a sleeping modem just for this
+float getLoRaSignalQuality() {
+    if (!loraModem._isAwake) { return -9999; }
     return static_cast<float>(loraAT.getSignalQuality());
 }
 // Finally, Create a calculated variable and return a variable pointer to it
@@ -298,29 +343,12 @@ Variable* modemRSSI = new Variable(getLoRaSignalQuality, modemRSSIResolution,
 //  Extra Battery as an Analog Input via Calculated Variable
 
 
-// helper function to read analog voltage
-float getAnalogBatteryVoltage(int8_t _batteryPin, float _batteryMultiplier,
-                              float _operatingVoltage = 3.3) {
-    float sensorValue_battery = -9999;
-    if (_batteryPin >= 0 && _batteryMultiplier > 0) {
-        // Get the battery voltage
-        // PRINTOUT(F("  Getting battery voltage from pin"), _batteryPin);
-        pinMode(_batteryPin, INPUT);
-        analogRead(_batteryPin);  // priming reading
-        // The return value from analogRead() is IN BITS NOT IN VOLTS!!
-        analogRead(_batteryPin);  // another priming reading
-        float rawBattery = analogRead(_batteryPin);
-        // PRINTOUT(F("  Raw battery pin reading in bits:"), rawBattery);
-        // convert bits to volts
-        sensorValue_battery =
-            (_operatingVoltage / static_cast<float>(PROCESSOR_ADC_MAX)) *
-            _batteryMultiplier * rawBattery;
-        // PRINTOUT(F("  Battery in Volts:"), sensorValue_battery);
-    } else {
-        // PRINTOUT(F("  No battery pin specified!"));
-    }
-    return sensorValue_battery;
-}
+// The analog battery voltages, each read once per loop however many times
+// they're asked for
+#include "AnalogCache.h"
+analogCache primaryBattery(A9, 4.7);  // aka 75
+// The relay has to be on to read the 12V battery, so it is turned on for it
+analogCache extraBattery(A0, 5.88, 3.3, relayPowerPin);
 
 
 // Properties of the calculated variable for the extra battery
@@ -334,26 +362,7 @@ const char* extraBatteryUnit = "volt";
 const char* extraBatteryCode = "12VBattery";
 
 float readExtraBattery() {
-    bool wasOn = false;
-    if (relayPowerPin >= 0) {
-        auto powerBitNumber = static_cast<int8_t>(
-            log(digitalPinToBitMask(relayPowerPin)) / log(2));
-        wasOn = bitRead(*portInputRegister(digitalPinToPort(relayPowerPin)),
-                        powerBitNumber) == LOW;
-        if (!wasOn) {
-            pinMode(relayPowerPin, OUTPUT);
-            digitalWrite(relayPowerPin, HIGH);  // turn on the relay power
-        }
-    }
-    float  _batteryMultiplier = 5.88;
-    float  _operatingVoltage  = 3.3;
-    int8_t _batteryPin        = A0;
-    // PRINTOUT(F("Reading 12V battery:"));
-    if (relayPowerPin >= 0 && !wasOn) {
-        digitalWrite(relayPowerPin, LOW);  // turn off the relay power
-    }
-    return getAnalogBatteryVoltage(_batteryPin, _batteryMultiplier,
-                                   _operatingVoltage);
+    return extraBattery.getVoltage();
 }
 
 // Finally, Create a calculated variable and return a variable pointer to it
@@ -444,14 +453,9 @@ void greenRedFlash(uint8_t numFlash = 4, uint8_t rate = 75) {
     digitalWrite(redLED, LOW);
 }
 
-// Helper function to read the main battery voltage
+// Helper function to read the main battery voltage, once per loop
 float getPrimaryBatteryVoltage() {
-    int8_t _batteryPin        = A9;  // aka 75
-    float  _batteryMultiplier = 4.7;
-    float  _operatingVoltage  = 3.3;
-    // PRINTOUT(F("Reading LiPo battery:"));
-    return getAnalogBatteryVoltage(_batteryPin, _batteryMultiplier,
-                                   _operatingVoltage);
+    return primaryBattery.getVoltage();
 }
 
 // Just a function to pretty-print the modbus hex frames
@@ -573,12 +577,21 @@ void setup() {
     }
     /** End [setup_sensors] */
 
+    /** Start [setup_fuel_gauge] */
+    fuelGaugeFound = max17048.begin();
+    if (fuelGaugeFound) {
+        PRINTOUT(F("Found MAX17048 fuel gauge"));
+    } else {
+        PRINTOUT(F("No MAX17048 fuel gauge; scheduling from battery voltage"));
+    }
+    /** End [setup_fuel_gauge] */
+
     /** Start [setup_lora] */
     // Power on, set up, and connect the LoRa modem
     PRINTOUT(F("Waking the LoRa module..."));
-    loraModem.modemPowerOn();
+    loraModem.modemPowerOn(loraAT);
     PRINTOUT(F("Setting up the LoRa module..."));
-    loraModem.setupModemAWS(loraAT);
+    loraModem.setupModemAWS(loraAT, appEui, appKey);
     PRINTOUT(F("Attempting to connect to LoRa network..."));
     loraModem.modemConnect(loraAT, appEui, appKey);
     /** End [setup_lora] */
@@ -641,16 +654,54 @@ void setup() {
 void loop() {
     // Reset the watchdog
     extendedWatchDog::resetWatchDog();
+    // Read the analog batteries fresh this time through
+    primaryBattery.expire();
+    extraBattery.expire();
+
+    // Decide how much the battery can afford before checking the time, since
+    // that sets the logging interval
+    // Note:  Please change the voltages in EnergyScheduler.h to match your
+    // battery if there's no fuel gauge
+    if (fuelGaugeFound) {
+        scheduler.update(max17048.cellPercent(), max17048.chargeRate(),
+                         alsPt19Lux->getValue(false),
+                         dataLogger.getNowLocalEpoch());
+    } else {
+        scheduler.updateFromVoltage(getPrimaryBatteryVoltage());
+    }
+    dataLogger.setLoggingInterval(
+        scheduler.getIntervalMinutes(loggingInterval));
+    // Sample faster while the stage is changing quickly
+    if (stageWatch.isActive() &&
+        scheduler.getLevel() != energyScheduler::CRITICAL) {
+        dataLogger.setLoggingInterval(eventLoggingInterval);
+    }
 
     // Assuming we were woken up by the clock, check if the current time is an
     // even interval of the logging interval
-    // We're only doing anything at all if the battery is above 3.4V
-    if (dataLogger.checkInterval() && getPrimaryBatteryVoltage() > 3.4) {
+    // We're only doing anything at all if the battery isn't critically low
+    if (dataLogger.checkInterval() &&
+        scheduler.getLevel() != energyScheduler::CRITICAL) {
         // Flag to notify that we're in already awake and logging a point
         Logger::isLoggingNow = true;
         startSerials();
         extendedWatchDog::resetWatchDog();
 
+        // Only some readings are sent or pictured when the battery is low
+        // Every reading is sent during an event
+        bool publishNow = stageWatch.isActive() ||
+            scheduler.shouldPublish(Logger::markedLocalUnixTime,
+                                    loggingInterval);
+        bool imageNow   = scheduler.shouldCaptureImage(
+            Logger::markedLocalUnixTime, loggingInterval);
+        PRINTOUT(F("Energy level"),
+                 energyScheduler::getLevelName(scheduler.getLevel()),
+                 F("; logging every"), dataLogger.getLoggingInterval(),
+                 F("minutes"));
+        // NOTE: A sensor with no measurements to average is skipped when the
+        // variable array is updated, so the camera isn't asked for an image.
+        hydrocam.setNumberMeasurementsToAverage(imageNow ? 1 : 0);
+
         // Print a line to show new reading
         PRINTOUT(F("------------------------------------------"));
         // Turn on the LED to show we're taking a reading
@@ -659,9 +710,13 @@ void loop() {
         dataLogger.turnOnSDcard(false);
         extendedWatchDog::resetWatchDog();
 
-        // wake up the modem
-        bool successful_wake = loraModem.modemWake(loraAT);
-        extendedWatchDog::resetWatchDog();
+        // wake up the modem before updating the variables, if this reading is
+        // being sent, so the RSSI can be read
+        bool successful_wake = false;
+        if (publishNow) {
+            successful_wake = loraModem.modemWake(loraAT);
+            extendedWatchDog::resetWatchDog();
+        }
         if (successful_wake) {
             PRINTOUT(F("Attempting to connect to LoRa network..."));
             successful_wake &= loraModem.modemConnect(loraAT, appEui, appKey);
@@ -682,6 +737,27 @@ void loop() {
         varArray.completeUpdate();
         extendedWatchDog::resetWatchDog();
 
+        // Check whether the stage is changing quickly, and send a reading that
+        // starts an event right away
+        if (stageWatch.addReading(VegaPulsStage->getValue(false),
+                                  Logger::markedLocalUnixTime)) {
+            PRINTOUT(F("Stage changing at"), stageWatch.getRate(),
+                     F("m/hr; sending every reading"));
+            if (!publishNow) {
+                publishNow      = true;
+                successful_wake = loraModem.modemWake(loraAT);
+                extendedWatchDog::resetWatchDog();
+                if (successful_wake) {
+                    PRINTOUT(F("Attempting to connect to LoRa network..."));
+                    successful_wake &= loraModem.modemConnect(loraAT, appEui,
+                                                              appKey);
+                }
+                // The modem was asleep during the update, so read the RSSI
+                // again now that it's awake
+                modemRSSI->getValue(true);
+            }
+        }
+
         // Create a csv data record and save it to the log file
         dataLogger.logToSD();
         extendedWatchDog::resetWatchDog();
@@ -800,23 +876,33 @@ void loop() {
                 MS_SERIAL_OUTPUT.print(F("Network status: "));
                 MS_SERIAL_OUTPUT.println(res ? "connected" : "not connected");
                 extendedWatchDog::resetWatchDog();
+                // only join again if the session has been lost
+                if (!res) {
+                    loraModem.modemReconnect(loraAT, appEui, appKey);
+                    extendedWatchDog::resetWatchDog();
+                }
             }
+        } else if (!publishNow) {
+            MS_SERIAL_OUTPUT.println(
+                F("Saving power - this reading is not being sent"));
         } else {
             MS_SERIAL_OUTPUT.println(
                 F("--Failed to send data! Can not communicate with modem!"));
         }
 
-        // dump anything in the LoRa buffer
-        while (loraStream.available()) { Serial.write(loraStream.read()); }
+        if (publishNow) {
+            // dump anything in the LoRa buffer
+            while (loraStream.available()) { Serial.write(loraStream.read()); }
 
-        // put the modem to sleep
-        loraModem.modemSleep(loraAT);
+            // put the modem to sleep
+            loraModem.modemSleep(loraAT);
 
-        // Dump anything in the LoRa buffer again, and then flush it
-        while (loraStream.available()) { Serial.write(loraStream.read()); }
-        // It is crucial that we flush the stream or we will not be able to
-        // sleep
-        loraStream.flush();
+            // Dump anything in the LoRa buffer again, and then flush it
+            while (loraStream.available()) { Serial.write(loraStream.read()); }
+            // It is crucial that we flush the stream or we will not be able to
+            // sleep
+            loraStream.flush();
+        }
 
         // Turn off the LED
         dataLogger.alertOff();
@@ -0,0 +1,124 @@
+// Header Guards
+#ifndef ADC_FILTER_H_
+#define ADC_FILTER_H_
+
+#include <stdint.h>
+
+// The most readings that can be taken in one burst
+#ifndef ADC_FILTER_MAX_SAMPLES
+#define ADC_FILTER_MAX_SAMPLES 64
+#endif
+
+// How far from the median a reading can be, in (robust) standard deviations,
+// before it's thrown out as an outlier
+#ifndef ADC_FILTER_OUTLIER_LIMIT
+#define ADC_FILTER_OUTLIER_LIMIT 3.0
+#endif
+
+// The least distance from the median, in bits, that can ever be an outlier,
+// so a quiet channel doesn't lose readings that are only a bit or two off
+#ifndef ADC_FILTER_MIN_SPREAD
+#define ADC_FILTER_MIN_SPREAD 2.0
+#endif
+
+/**
+ * @brief The result of filtering one burst of ADC readings, in bits.
+ */
+struct adcBurstResult {
+    float    mean;      // the average of the readings kept; -9999 if none
+    uint16_t min;       // the lowest reading kept
+    uint16_t max;       // the highest reading kept
+    uint8_t  used;      // the number of readings kept
+    uint8_t  rejected;  // the number of readings thrown out as outliers
+};
+
+/**
+ * @brief Throws out the outliers from a burst of ADC readings and averages
+ * the rest.
+ *
+ * The median of the burst is the center, and the median distance from it,
+ * scaled to match a standard deviation, is the spread.  Readings more than
+ * ADC_FILTER_OUTLIER_LIMIT spreads from the median are thrown out, so a spike
+ * from the modem transmitting or a relay clicking doesn't pull the average.
+ * Averaging the rest of the burst gives a value with a fraction of a bit of
+ * resolution; every four times as many readings is about one more bit, as
+ * long as there's a bit or so of noise on the channel to dither it.
+ *
+ * This is only arithmetic on an array, without any Arduino functions, so it
+ * can be compiled on a computer and run over recorded readings.
+ */
+class adcFilter {
+ public:
+    /**
+     * @brief Filter a burst of readings.
+     *
+     * @param samples The readings, in bits; these are sorted in place
+     * @param count The number of readings, up to ADC_FILTER_MAX_SAMPLES
+     * @param outlier_limit How many spreads from the median a reading can be
+     * before it's thrown out
+     * @return The mean, min and max of the readings kept
+     */
+    static adcBurstResult filter(
+        uint16_t* samples, uint8_t count,
+        float outlier_limit = ADC_FILTER_OUTLIER_LIMIT) {
+        adcBurstResult result = {-9999, 0, 0, 0, 0};
+        if (count == 0) { return result; }
+        if (count > ADC_FILTER_MAX_SAMPLES) { count = ADC_FILTER_MAX_SAMPLES; }
+
+        sort(samples, count);
+        float median = middle(samples, count);
+
+        // The median absolute deviation, scaled to a standard deviation.  The
+        // median of an even count can be half way between two readings, so
+        // the deviations are kept as floats rather than cut to whole bits.
+        float deviations[ADC_FILTER_MAX_SAMPLES];
+        for (uint8_t i = 0; i < count; i++) {
+            deviations[i] = samples[i] > median ? samples[i] - median
+                                                : median - samples[i];
+        }
+        sort(deviations, count);
+        float limit = outlier_limit * 1.4826 * middle(deviations, count);
+        if (limit < ADC_FILTER_MIN_SPREAD) { limit = ADC_FILTER_MIN_SPREAD; }
+
+        // The readings are sorted, so the ones kept are all together
+        uint32_t total = 0;
+        for (uint8_t i = 0; i < count; i++) {
+            float distance = samples[i] > median ? samples[i] - median
+                                                 : median - samples[i];
+            if (distance > limit) {
+                result.rejected++;
+                continue;
+            }
+            if (result.used == 0) { result.min = samples[i]; }
+            result.max = samples[i];
+            total += samples[i];
+            result.used++;
+        }
+        result.mean = static_cast<float>(total) / result.used;
+        return result;
+    }
+
+ protected:
+    // An insertion sort - the bursts are short
+    template <typename T>
+    static void sort(T* values, uint8_t count) {
+        for (uint8_t i = 1; i < count; i++) {
+            T       value = values[i];
+            uint8_t j     = i;
+            while (j > 0 && values[j - 1] > value) {
+                values[j] = values[j - 1];
+                j--;
+            }
+            values[j] = value;
+        }
+    }
+
+    // The median of sorted values
+    template <typename T>
+    static float middle(const T* values, uint8_t count) {
+        if (count % 2) { return values[count / 2]; }
+        return (values[count / 2 - 1] + values[count / 2]) / 2.0f;
+    }
+};
+
+#endif
@@ -66,6 +66,13 @@ const char* sketchName = "NGWOS_AWS_MQTT.ino";
 const char* LoggerID = THING_NAME;
 // How frequently (in minutes) to log data
 const int8_t loggingInterval = 5;
+// How frequently (in minutes) to log data while the stage is changing quickly
+// NOTE: Every reading is published while the stage is changing quickly.
+const int8_t eventLoggingInterval = 1;
+// The rise or fall of the stage, in m per hour, that starts an event
+const float stageEventRate = 0.15;
+// A stage, in m, that starts an event when it's crossed; -9999 for none
+const float stageEventThreshold = -9999;
 // The number of 1-minute intervals to take before moving to the set logging
 // interval
 const int8_t initialShortIntervals = 5;
@@ -212,6 +219,30 @@ Variable* hydrocamImageSize = new GeoluxHydroCam_ImageSize(&hydrocam);
 /** End [geolux_hydro_cam] */
 
 
+// ==========================================================================
+//  Battery Fuel Gauge and Energy Scheduler
+// ==========================================================================
+/** Start [energy_scheduler] */
+#include <Adafruit_MAX1704X.h>
+#include "EnergyScheduler.h"
+
+// Analog Devices MAX17048 3µA 1-Cell Fuel Gauge
+Adafruit_MAX17048 max17048;
+// Whether the fuel gauge was found; without it, the energy scheduler falls
+// back to the battery voltage
+bool fuelGaugeFound = false;
+
+// Decides how often to log, publish, and take pictures from the battery
+// charge, its recent (dis)charge rate, and the light on the solar panel
+// NOTE: The logging interval above is the shortest used, when there's charge
+// to spare.  As the forecast charge runs low, the interval stretches to 2 and
+// then 4 times as long, and fewer readings are published or pictured.
+energyScheduler scheduler;
+// Whether the camera is taking a picture with the current reading
+bool imageThisReading = true;
+/** End [energy_scheduler] */
+
+
 // ==========================================================================
 //  Sensirion SHT4X Digital Humidity and Temperature Sensor
 // ==========================================================================
@@ -257,34 +288,30 @@ Variable* VegaPulsError       = new VegaPuls21_ErrorCode(&VegaPuls);
 /** End [vega_puls21] */
 
 
+// ==========================================================================
+//  Stage Event Detector
+// ==========================================================================
+/** Start [stage_event_detector] */
+#include "StageEventDetector.h"
+
+// Watches the Vega Puls stage for floods, to sample faster and publish every
+// reading while the stage is changing quickly
+stageEventDetector stageWatch(stageEventRate, stageEventThreshold,
+                              loggingInterval * 60L);
+/** End [stage_event_detector] */
+
+
 // ==========================================================================
 //  Calculated Variables
 // ==========================================================================
 /** Start [calculated_variables] */
 
-// helper function to read analog voltage
-float getAnalogBatteryVoltage(int8_t _batteryPin, float _batteryMultiplier,
-                              float _operatingVoltage = 3.3) {
-    float sensorValue_battery = -9999;
-    if (_batteryPin >= 0 && _batteryMultiplier > 0) {
-        // Get the battery voltage
-        // PRINTOUT(F("  Getting battery voltage from pin"), _batteryPin);
-        pinMode(_batteryPin, INPUT);
-        analogRead(_batteryPin);  // priming reading
-        // The return value from analogRead() is IN BITS NOT IN VOLTS!!
-        analogRead(_batteryPin);  // another priming reading
-        float rawBattery = analogRead(_batteryPin);
-        // PRINTOUT(F("  Raw battery pin reading in bits:"), rawBattery);
-        // convert bits to volts
-        sensorValue_battery =
-            (_operatingVoltage / static_cast<float>(PROCESSOR_ADC_MAX)) *
-            _batteryMultiplier * rawBattery;
-        // PRINTOUT(F("  Battery in Volts:"), sensorValue_battery);
-    } else {
-        // PRINTOUT(F("  No battery pin specified!"));
-    }
-    return sensorValue_battery;
-}
+// The analog battery voltages, each read once per loop however many times
+// they're asked for
+#include "AnalogCache.h"
+analogCache primaryBattery(A9, 4.7);  // aka 75
+// The relay has to be on to read the 12V battery, so it is turned on for it
+analogCache extraBattery(A0, 5.88, 3.3, relayPowerPin);
 
 
 // Properties of the calculated variable for the extra battery
@@ -298,26 +325,7 @@ const char* extraBatteryUnit = "volt";
 const char* extraBatteryCode = "12VBattery";
 
 float readExtraBattery() {
-    bool wasOn = false;
-    if (relayPowerPin >= 0) {
-        auto powerBitNumber = static_cast<int8_t>(
-            log(digitalPinToBitMask(relayPowerPin)) / log(2));
-        wasOn = bitRead(*portInputRegister(digitalPinToPort(relayPowerPin)),
-                        powerBitNumber) == LOW;
-        if (!wasOn) {
-            pinMode(relayPowerPin, OUTPUT);
-            digitalWrite(relayPowerPin, HIGH);  // turn on the relay power
-        }
-    }
-    float  _batteryMultiplier = 5.88;
-    float  _operatingVoltage  = 3.3;
-    int8_t _batteryPin        = A0;
-    // PRINTOUT(F("Reading 12V battery:"));
-    if (relayPowerPin >= 0 && !wasOn) {
-        digitalWrite(relayPowerPin, LOW);  // turn off the relay power
-    }
-    return getAnalogBatteryVoltage(_batteryPin, _batteryMultiplier,
-                                   _operatingVoltage);
+    return extraBattery.getVoltage();
 }
 
 // Finally, Create a calculated variable and return a variable pointer to it
@@ -405,7 +413,13 @@ void IoTCallback(char* topic, byte* payload, unsigned int length) {
         // Null terminate the string
         memset(rx_url + length, '\0', 1);
         // PRINTOUT(F("Setting S3 URL to:"), rx_url);
-        s3pub.setPreSignedURL(String(rx_url));
+        if (imageThisReading) {
+            s3pub.setPreSignedURL(String(rx_url));
+        } else {
+            // There's no new picture, so don't upload the last one again
+            PRINTOUT(F("No new image to upload"));
+            s3pub.setPreSignedURL(String(""));
+        }
         // Free the memory now that the URL has been copied into a new String
         free(rx_url);
         // let the publisher know we got what we expected and it can stop
@@ -462,14 +476,18 @@ void greenRedFlash(uint8_t numFlash = 4, uint8_t rate = 75) {
     digitalWrite(redLED, LOW);
 }
 
-// Helper function to read the main battery voltage
+// Helper function to read the main battery voltage, once per loop
 float getPrimaryBatteryVoltage() {
-    int8_t _batteryPin        = A9;  // aka 75
-    float  _batteryMultiplier = 4.7;
-    float  _operatingVoltage  = 3.3;
-    // PRINTOUT(F("Reading LiPo battery:"));
-    return getAnalogBatteryVoltage(_batteryPin, _batteryMultiplier,
-                                   _operatingVoltage);
+    return primaryBattery.getVoltage();
+}
+
+// Publishes the latest reading right away, outside of the usual schedule
+void publishLatestReading() {
+    if (modem.modemWake() && modem.connectInternet(240000L)) {
+        dataLogger.publishDataToRemotes();
+        modem.disconnectInternet();
+    }
+    modem.modemSleepPowerDown();
 }
 /** End [working_functions] */
 
@@ -595,6 +613,15 @@ void setup() {
     }
     /** End [setup_sensors] */
 
+    /** Start [setup_fuel_gauge] */
+    fuelGaugeFound = max17048.begin();
+    if (fuelGaugeFound) {
+        PRINTOUT(F("Found MAX17048 fuel gauge"));
+    } else {
+        PRINTOUT(F("No MAX17048 fuel gauge; scheduling from battery voltage"));
+    }
+    /** End [setup_fuel_gauge] */
+
     /** Start [setup_sim7080] */
     modem.setModemWakeLevel(HIGH);   // ModuleFun Bee inverts the signal
     modem.setModemResetLevel(HIGH);  // ModuleFun Bee inverts the signal
@@ -668,25 +695,70 @@ void setup() {
 // ==========================================================================
 /** Start [simple_loop] */
 void loop() {
-    // Note:  Please change these battery voltages to match your battery
-    // At very low battery, just go back to sleep
     startSerials();
+    // Read the analog batteries fresh this time through
+    primaryBattery.expire();
+    extraBattery.expire();
     float batteryVoltage = getPrimaryBatteryVoltage();
     PRINTOUT(F("Current battery voltage:"), batteryVoltage, F("V"));
-    if (batteryVoltage < 3.4) {
+
+    // Decide how much the battery can afford, from the fuel gauge if there is
+    // one
+    // Note:  Please change the voltages in EnergyScheduler.h to match your
+    // battery if there's no fuel gauge
+    if (fuelGaugeFound) {
+        scheduler.update(max17048.cellPercent(), max17048.chargeRate(),
+                         alsPt19Lux->getValue(false),
+                         dataLogger.getNowLocalEpoch());
+    } else {
+        scheduler.updateFromVoltage(batteryVoltage);
+    }
+    energyScheduler::level level = scheduler.getLevel();
+    dataLogger.setLoggingInterval(
+        scheduler.getIntervalMinutes(loggingInterval));
+    // Sample faster while the stage is changing quickly
+    if (stageWatch.isActive()) {
+        dataLogger.setLoggingInterval(eventLoggingInterval);
+    }
+    uint32_t now = dataLogger.getNowLocalEpoch();
+
+    if (level == energyScheduler::CRITICAL) {
+        // At very low battery, just go back to sleep
         PRINTOUT(F("Battery too low, ("), batteryVoltage,
                  F("V) going back to sleep."));
         dataLogger.systemSleep();
-    } else if (batteryVoltage < 3.55) {
-        // At moderate voltage, log data but don't send it over the modem
-        PRINTOUT(F("Battery at"), batteryVoltage,
-                 F("V; high enough to log, but will not publish!"));
-        dataLogger.logData();
-    } else {
-        // If the battery is good, send the data to the world
-        PRINTOUT(F("Battery at"), batteryVoltage,
-                 F("V; high enough to log and publish data"));
+        return;
+    }
+
+    // Only take a picture when the battery can afford it
+    // NOTE: A sensor with no measurements to average is skipped when the
+    // variable array is updated, so the camera isn't asked for an image.
+    imageThisReading = scheduler.shouldCaptureImage(now, loggingInterval);
+    hydrocam.setNumberMeasurementsToAverage(imageThisReading ? 1 : 0);
+
+    uint32_t lastReading = Logger::markedLocalUnixTime;
+    bool     publishNow  = stageWatch.isActive() ||
+        scheduler.shouldPublish(now, loggingInterval);
+    if (publishNow) {
+        // If the battery can afford it, send the data to the world
+        PRINTOUT(F("Energy level"), energyScheduler::getLevelName(level),
+                 F("; logging and publishing data"));
         dataLogger.logDataAndPublish();
+    } else {
+        // Otherwise log the data but don't send it over the modem
+        PRINTOUT(F("Energy level"), energyScheduler::getLevelName(level),
+                 F("; logging, but will not publish this reading"));
+        dataLogger.logData();
+    }
+
+    // If a reading was just taken, check whether the stage is changing
+    // quickly, and publish a reading that starts an event right away
+    if (Logger::markedLocalUnixTime != lastReading &&
+        stageWatch.addReading(VegaPulsStage->getValue(false),
+                              Logger::markedLocalUnixTime)) {
+        PRINTOUT(F("Stage changing at"), stageWatch.getRate(),
+                 F("m/hr; publishing every reading"));
+        if (!publishNow) { publishLatestReading(); }
     }
 }
 /** End [simple_loop] */
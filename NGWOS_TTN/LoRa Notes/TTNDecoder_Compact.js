@@ -0,0 +1,157 @@
+/**
+ * THIS FILE IS GENERATED BY generate_compact_payload.py - DO NOT EDIT IT BY
+ * HAND!  Edit the table in the generator and run it again.
+ *
+ * Decoder for the compact payload sent by
+ * https://github.com/EnviroDIY/USGS_NGWOS/tree/main/NGWOS_TTN when
+ * USE_COMPACT_PAYLOAD or USE_BATCHED_UPLINKS is defined.
+ *
+ * Single sample frame layout (all multi-byte fields MSB first):
+ *   byte 0       1 | 0x80
+ *   bytes 1-3    presence mask - bit (channel - 1) is set if the channel is
+ *                in the frame
+ *   bytes 4-...  the value of every present channel, in channel order, each
+ *                packed into exactly the bits given below.  The value is
+ *                min + code * resolution; a code of all ones means the
+ *                channel was read but there was no valid value.
+ *
+ * Batched frame layout:
+ *   byte 0       2 | 0x80
+ *   bytes 1-3    presence mask
+ *   byte 4       number of samples
+ *   then, for each present channel in order: the code of the first sample in
+ *   the bits given below, a 6-bit width, and the zigzag-encoded difference
+ *   from the previous sample's code for each other sample in that width.  A
+ *   width of 63 means the other codes are sent as-is in the bits given below.
+ *   The timestamp is channel 1, so it becomes a base time and offsets.
+ *
+ * Channel  Instrument       Parameter                      Unit           Min       Resolution Bits
+ *   1       Stonefly         Measurement Timestamp (UNIX)   dimensionless  0         1          32
+ *   2       mDot             RSSI (signal strength)         dB             -150      1          8
+ *   3       SHT40            Equipment Temperature          °C             -40       0.01       15
+ *   4       SHT40            Relative Humidity              %RH            0         0.01       14
+ *   5       Vega Puls 21     Gauge Height (Stage)           m              -50       0.001      17
+ *   6       Vega Puls 21     Range                          m              0         0.001      14
+ *   7       Vega Puls 21     Temperature                    °C             -40       0.1        11
+ *   8       Vega Puls 21     Reliability                    dB             0         0.1        11
+ *   9       Vega Puls 21     Error Code                     dimensionless  0         1          8
+ *   10      EVERBRIGHT ALS   Luminosity                     lux            0         0.5        12
+ *   11      MAX17048         Battery Voltage                V              0         0.001      13
+ *   12      MAX17048         Battery Charge Percent         %              0         0.1        11
+ *   13      MAX17048         Battery (Dis)Charge Rate       %/hr           -3276.8   0.1        16
+ *   14      Meter Hydros 21  Specific Conductance           µS/cm          0         1          17
+ *   15      Meter Hydros 21  Temperature                    °C             -40       0.1        11
+ *   16      Meter Hydros 21  Water Depth                    m              0         0.001      14
+ *   17      Stonefly         Analog 3.3V Battery Voltage    V              0         0.001      13
+ *   18      Stonefly         Analog 12V Battery Voltage     V              0         0.001      15
+ *   19      Stonefly         Previous Cycle Awake Time      s              0         0.1        12
+ */
+
+function compactDecode(bytes) {
+
+    var version = 1;
+    var batchVersion = 2;
+    var maskBytes = 3;
+    var widthBits = 6;
+    var rawWidth = 63;
+    var channels = [
+        { 'channel': 1, 'key': 'time_1', 'instrument': 'Stonefly', 'parameter': 'Measurement Timestamp (UNIX)', 'unit': 'dimensionless', 'min': 0, 'resolution': 1, 'decimals': 0, 'bits': 32 },
+        { 'channel': 2, 'key': 'generic_2', 'instrument': 'mDot', 'parameter': 'RSSI (signal strength)', 'unit': 'dB', 'min': -150, 'resolution': 1, 'decimals': 0, 'bits': 8 },
+        { 'channel': 3, 'key': 'temperature_3', 'instrument': 'SHT40', 'parameter': 'Equipment Temperature', 'unit': '°C', 'min': -40, 'resolution': 0.01, 'decimals': 2, 'bits': 15 },
+        { 'channel': 4, 'key': 'humidity_4', 'instrument': 'SHT40', 'parameter': 'Relative Humidity', 'unit': '%RH', 'min': 0, 'resolution': 0.01, 'decimals': 2, 'bits': 14 },
+        { 'channel': 5, 'key': 'distance_5', 'instrument': 'Vega Puls 21', 'parameter': 'Gauge Height (Stage)', 'unit': 'm', 'min': -50, 'resolution': 0.001, 'decimals': 3, 'bits': 17 },
+        { 'channel': 6, 'key': 'distance_6', 'instrument': 'Vega Puls 21', 'parameter': 'Range', 'unit': 'm', 'min': 0, 'resolution': 0.001, 'decimals': 3, 'bits': 14 },
+        { 'channel': 7, 'key': 'temperature_7', 'instrument': 'Vega Puls 21', 'parameter': 'Temperature', 'unit': '°C', 'min': -40, 'resolution': 0.1, 'decimals': 1, 'bits': 11 },
+        { 'channel': 8, 'key': 'generic_8', 'instrument': 'Vega Puls 21', 'parameter': 'Reliability', 'unit': 'dB', 'min': 0, 'resolution': 0.1, 'decimals': 1, 'bits': 11 },
+        { 'channel': 9, 'key': 'generic_9', 'instrument': 'Vega Puls 21', 'parameter': 'Error Code', 'unit': 'dimensionless', 'min': 0, 'resolution': 1, 'decimals': 0, 'bits': 8 },
+        { 'channel': 10, 'key': 'illuminance_10', 'instrument': 'EVERBRIGHT ALS', 'parameter': 'Luminosity', 'unit': 'lux', 'min': 0, 'resolution': 0.5, 'decimals': 1, 'bits': 12 },
+        { 'channel': 11, 'key': 'voltage_11', 'instrument': 'MAX17048', 'parameter': 'Battery Voltage', 'unit': 'V', 'min': 0, 'resolution': 0.001, 'decimals': 3, 'bits': 13 },
+        { 'channel': 12, 'key': 'percentage_12', 'instrument': 'MAX17048', 'parameter': 'Battery Charge Percent', 'unit': '%', 'min': 0, 'resolution': 0.1, 'decimals': 1, 'bits': 11 },
+        { 'channel': 13, 'key': 'generic_13', 'instrument': 'MAX17048', 'parameter': 'Battery (Dis)Charge Rate', 'unit': '%/hr', 'min': -3276.8, 'resolution': 0.1, 'decimals': 1, 'bits': 16 },
+        { 'channel': 14, 'key': 'generic_14', 'instrument': 'Meter Hydros 21', 'parameter': 'Specific Conductance', 'unit': 'µS/cm', 'min': 0, 'resolution': 1, 'decimals': 0, 'bits': 17 },
+        { 'channel': 15, 'key': 'temperature_15', 'instrument': 'Meter Hydros 21', 'parameter': 'Temperature', 'unit': '°C', 'min': -40, 'resolution': 0.1, 'decimals': 1, 'bits': 11 },
+        { 'channel': 16, 'key': 'distance_16', 'instrument': 'Meter Hydros 21', 'parameter': 'Water Depth', 'unit': 'm', 'min': 0, 'resolution': 0.001, 'decimals': 3, 'bits': 14 },
+        { 'channel': 17, 'key': 'voltage_17', 'instrument': 'Stonefly', 'parameter': 'Analog 3.3V Battery Voltage', 'unit': 'V', 'min': 0, 'resolution': 0.001, 'decimals': 3, 'bits': 13 },
+        { 'channel': 18, 'key': 'voltage_18', 'instrument': 'Stonefly', 'parameter': 'Analog 12V Battery Voltage', 'unit': 'V', 'min': 0, 'resolution': 0.001, 'decimals': 3, 'bits': 15 },
+        { 'channel': 19, 'key': 'generic_19', 'instrument': 'Stonefly', 'parameter': 'Previous Cycle Awake Time', 'unit': 's', 'min': 0, 'resolution': 0.1, 'decimals': 1, 'bits': 12 }
+    ];
+
+    if (bytes.length < 1 + maskBytes) {
+        throw 'Frame too short!';
+    }
+    var isBatch = bytes[0] === (0x80 | batchVersion);
+    if (bytes[0] !== (0x80 | version) && !isBatch) {
+        throw 'Unknown compact payload version: ' + bytes[0];
+    }
+
+    var mask = 0;
+    for (var m = 0; m < maskBytes; m++) {
+        mask = mask * 256 + bytes[1 + m];
+    }
+    var maskBits = maskBytes * 8;
+    var numberSamples = isBatch ? bytes[1 + maskBytes] : 1;
+
+    // read values MSB first, one bit at a time so values up to 32 bits don't
+    // overflow the bitwise operators
+    var bitPosition = (1 + maskBytes + (isBatch ? 1 : 0)) * 8;
+    function readBits(count) {
+        var value = 0;
+        for (var b = 0; b < count; b++) {
+            var byteIndex = bitPosition >> 3;
+            if (byteIndex >= bytes.length) {
+                throw 'Frame too short!';
+            }
+            var bit = (bytes[byteIndex] >> (7 - (bitPosition & 7))) & 1;
+            value = value * 2 + bit;
+            bitPosition++;
+        }
+        return value;
+    }
+
+    var samples = [];
+    for (var s = 0; s < numberSamples; s++) {
+        samples.push({});
+    }
+    for (var i = 0; i < channels.length; i++) {
+        var ch = channels[i];
+        var present = Math.floor(mask / Math.pow(2, maskBits - ch.channel)) % 2;
+        if (!present) {
+            continue;
+        }
+        var codes = [readBits(ch.bits)];
+        if (isBatch) {
+            var width = readBits(widthBits);
+            for (var d = 1; d < numberSamples; d++) {
+                if (width === rawWidth) {
+                    codes.push(readBits(ch.bits));
+                } else {
+                    var zigzag = readBits(width);
+                    var delta = (zigzag % 2) ? -(zigzag + 1) / 2 : zigzag / 2;
+                    codes.push(codes[d - 1] + delta);
+                }
+            }
+        }
+        for (var c = 0; c < codes.length; c++) {
+            var value = null;
+            if (codes[c] !== Math.pow(2, ch.bits) - 1) {
+                value = Number((ch.min + codes[c] * ch.resolution).toFixed(ch.decimals));
+            }
+            samples[c][ch.key] = {
+                'channel': ch.channel,
+                'instrument': ch.instrument,
+                'parameter': ch.parameter,
+                'unit': ch.unit,
+                'value': value
+            };
+        }
+    }
+
+    return isBatch ? { 'samples': samples } : samples[0];
+
+}
+
+// To use with TTN
+function decodeUplink(input) {
+    var response = compactDecode(input.bytes);
+    return { data: response };
+}
@@ -0,0 +1,316 @@
+#!/usr/bin/env python3
+"""
+Generates the compact LoRa payload schema for the NGWOS_TTN sketch and the
+matching TTN payload formatter from a single channel table.
+
+Run this after changing the table below:
+
+    python3 generate_compact_payload.py
+
+It writes:
+    ../NGWOS_TTN/CompactPayloadSchema.h  - the schema used by CompactPayload.h
+                                           and CompactBatch.h
+    TTNDecoder_Compact.js                - the TTN custom Javascript formatter
+
+Frame layout (all multi-byte fields MSB first):
+    byte 0       format version, with the high bit set so the frame can never
+                 be mistaken for Cayenne LPP (where the first byte is a
+                 channel number)
+    bytes 1-3    presence mask - bit (channel - 1) is set if the channel is in
+                 the frame
+    bytes 4-...  the value of every present channel, in channel order, each
+                 packed into exactly the number of bits given in the table and
+                 stored as round((value - min) / resolution).  A code of all
+                 ones means the channel was read but there was no valid value.
+"""
+
+import os
+
+PAYLOAD_VERSION = 1
+# The version byte of a frame holding several delta-encoded samples
+BATCH_VERSION = 2
+# The bits used for the width of each channel's deltas in a batched frame, and
+# the width meaning the codes are sent as-is
+BATCH_WIDTH_BITS = 6
+BATCH_RAW_WIDTH = 63
+
+# Each channel gives the smallest value that can be sent, the resolution, and
+# the number of bits.  The largest value that can be sent is
+# min + (2^bits - 2) * resolution; the all-ones code is reserved for "no data".
+# The keys match the names the Cayenne LPP formatter gave the same values.
+# fmt: off
+SCHEMA = [
+    # channel, key,           instrument,        parameter,                      unit,            min,    resolution, bits
+    (1,  "time_1",         "Stonefly",        "Measurement Timestamp (UNIX)", "dimensionless", 0,       1,     32),
+    (2,  "generic_2",      "mDot",            "RSSI (signal strength)",       "dB",            -150,    1,     8),
+    (3,  "temperature_3",  "SHT40",           "Equipment Temperature",        "°C",            -40,     0.01,  15),
+    (4,  "humidity_4",     "SHT40",           "Relative Humidity",            "%RH",           0,       0.01,  14),
+    (5,  "distance_5",     "Vega Puls 21",    "Gauge Height (Stage)",         "m",             -50,     0.001, 17),
+    (6,  "distance_6",     "Vega Puls 21",    "Range",                        "m",             0,       0.001, 14),
+    (7,  "temperature_7",  "Vega Puls 21",    "Temperature",                  "°C",            -40,     0.1,   11),
+    (8,  "generic_8",      "Vega Puls 21",    "Reliability",                  "dB",            0,       0.1,   11),
+    (9,  "generic_9",      "Vega Puls 21",    "Error Code",                   "dimensionless", 0,       1,     8),
+    (10, "illuminance_10", "EVERBRIGHT ALS",  "Luminosity",                   "lux",           0,       0.5,   12),
+    (11, "voltage_11",     "MAX17048",        "Battery Voltage",              "V",             0,       0.001, 13),
+    (12, "percentage_12",  "MAX17048",        "Battery Charge Percent",       "%",             0,       0.1,   11),
+    (13, "generic_13",     "MAX17048",        "Battery (Dis)Charge Rate",     "%/hr",          -3276.8, 0.1,   16),
+    (14, "generic_14",     "Meter Hydros 21", "Specific Conductance",         "µS/cm",         0,       1,     17),
+    (15, "temperature_15", "Meter Hydros 21", "Temperature",                  "°C",            -40,     0.1,   11),
+    (16, "distance_16",    "Meter Hydros 21", "Water Depth",                  "m",             0,       0.001, 14),
+    (17, "voltage_17",     "Stonefly",        "Analog 3.3V Battery Voltage",  "V",             0,       0.001, 13),
+    (18, "voltage_18",     "Stonefly",        "Analog 12V Battery Voltage",   "V",             0,       0.001, 15),
+    (19, "generic_19",     "Stonefly",        "Previous Cycle Awake Time",    "s",             0,       0.1,   12),
+]
+# fmt: on
+
+MASK_BYTES = 3
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+HEADER_PATH = os.path.join(HERE, "..", "NGWOS_TTN", "CompactPayloadSchema.h")
+DECODER_PATH = os.path.join(HERE, "TTNDecoder_Compact.js")
+
+
+def check_schema():
+    channels = [row[0] for row in SCHEMA]
+    assert channels == sorted(channels), "channels must be in order"
+    assert len(set(channels)) == len(channels), "channels must be unique"
+    assert max(channels) <= MASK_BYTES * 8, "too many channels for the mask"
+    for row in SCHEMA:
+        assert 1 <= row[7] <= 32, "channel %d has a bad bit count" % row[0]
+
+
+def decimals(resolution):
+    text = repr(float(resolution))
+    if "e" in text:
+        return int(text.split("e-")[1])
+    whole, frac = text.split(".")
+    return 0 if frac == "0" else len(frac)
+
+
+def write_header():
+    max_bits = sum(row[7] for row in SCHEMA)
+    max_size = 1 + MASK_BYTES + (max_bits + 7) // 8
+    lines = []
+    lines.append("// THIS FILE IS GENERATED BY")
+    lines.append("// \"LoRa Notes/generate_compact_payload.py\" - DO NOT EDIT IT")
+    lines.append("// BY HAND!  Edit the table in the generator and run it again.")
+    lines.append("")
+    lines.append("// Header Guards")
+    lines.append("#ifndef COMPACT_PAYLOAD_SCHEMA_H_")
+    lines.append("#define COMPACT_PAYLOAD_SCHEMA_H_")
+    lines.append("")
+    lines.append("#include <Arduino.h>")
+    lines.append("")
+    lines.append("#define COMPACT_PAYLOAD_VERSION %d" % PAYLOAD_VERSION)
+    lines.append("#define COMPACT_BATCH_VERSION %d" % BATCH_VERSION)
+    lines.append("#define COMPACT_BATCH_WIDTH_BITS %d" % BATCH_WIDTH_BITS)
+    lines.append("#define COMPACT_BATCH_RAW_WIDTH %d" % BATCH_RAW_WIDTH)
+    lines.append("#define COMPACT_PAYLOAD_MASK_BYTES %d" % MASK_BYTES)
+    lines.append("#define COMPACT_PAYLOAD_NUM_CHANNELS %d" % len(SCHEMA))
+    lines.append("// Version byte, presence mask, and every channel present")
+    lines.append("#define COMPACT_PAYLOAD_MAX_SIZE %d" % max_size)
+    lines.append("")
+    lines.append("struct compactChannel {  // Structure declaration")
+    lines.append("    uint8_t channel;")
+    lines.append("    double  min;")
+    lines.append("    double  resolution;")
+    lines.append("    uint8_t bits;")
+    lines.append("};")
+    lines.append("")
+    lines.append(
+        "const compactChannel compactSchema[COMPACT_PAYLOAD_NUM_CHANNELS] = {")
+    entries = []
+    for row in SCHEMA:
+        channel, key, instrument, parameter, unit, minimum, resolution, bits = row
+        entry = "    {%d, %s, %s, %d}," % (
+            channel,
+            repr(float(minimum)),
+            repr(float(resolution)),
+            bits,
+        )
+        entries.append((entry, "%s %s" % (instrument, parameter)))
+    width = max(len(entry) for entry, comment in entries)
+    for entry, comment in entries:
+        lines.append("%s  // %s" % (entry.ljust(width), comment))
+    lines.append("};")
+    lines.append("")
+    lines.append("#endif")
+    with open(HEADER_PATH, "w", encoding="utf-8", newline="\n") as f:
+        f.write("\n".join(lines) + "\n")
+
+
+def write_decoder():
+    table = []
+    for row in SCHEMA:
+        channel, key, instrument, parameter, unit, minimum, resolution, bits = row
+        table.append(
+            "        { 'channel': %d, 'key': '%s', 'instrument': '%s', "
+            "'parameter': '%s', 'unit': '%s', 'min': %s, 'resolution': %s, "
+            "'decimals': %d, 'bits': %d }"
+            % (
+                channel,
+                key,
+                instrument,
+                parameter,
+                unit,
+                repr(minimum),
+                repr(resolution),
+                decimals(resolution),
+                bits,
+            )
+        )
+    docs = []
+    for row in SCHEMA:
+        channel, key, instrument, parameter, unit, minimum, resolution, bits = row
+        docs.append(
+            " *   %-7s %-16s %-30s %-14s %-9s %-10s %s"
+            % (channel, instrument, parameter, unit, minimum, resolution, bits)
+        )
+    text = """/**
+ * THIS FILE IS GENERATED BY generate_compact_payload.py - DO NOT EDIT IT BY
+ * HAND!  Edit the table in the generator and run it again.
+ *
+ * Decoder for the compact payload sent by
+ * https://github.com/EnviroDIY/USGS_NGWOS/tree/main/NGWOS_TTN when
+ * USE_COMPACT_PAYLOAD or USE_BATCHED_UPLINKS is defined.
+ *
+ * Single sample frame layout (all multi-byte fields MSB first):
+ *   byte 0       %d | 0x80
+ *   bytes 1-%d    presence mask - bit (channel - 1) is set if the channel is
+ *                in the frame
+ *   bytes %d-...  the value of every present channel, in channel order, each
+ *                packed into exactly the bits given below.  The value is
+ *                min + code * resolution; a code of all ones means the
+ *                channel was read but there was no valid value.
+ *
+ * Batched frame layout:
+ *   byte 0       %d | 0x80
+ *   bytes 1-%d    presence mask
+ *   byte %d       number of samples
+ *   then, for each present channel in order: the code of the first sample in
+ *   the bits given below, a %d-bit width, and the zigzag-encoded difference
+ *   from the previous sample's code for each other sample in that width.  A
+ *   width of %d means the other codes are sent as-is in the bits given below.
+ *   The timestamp is channel 1, so it becomes a base time and offsets.
+ *
+ * Channel  Instrument       Parameter                      Unit           Min       Resolution Bits
+%s
+ */
+
+function compactDecode(bytes) {
+
+    var version = %d;
+    var batchVersion = %d;
+    var maskBytes = %d;
+    var widthBits = %d;
+    var rawWidth = %d;
+    var channels = [
+%s
+    ];
+
+    if (bytes.length < 1 + maskBytes) {
+        throw 'Frame too short!';
+    }
+    var isBatch = bytes[0] === (0x80 | batchVersion);
+    if (bytes[0] !== (0x80 | version) && !isBatch) {
+        throw 'Unknown compact payload version: ' + bytes[0];
+    }
+
+    var mask = 0;
+    for (var m = 0; m < maskBytes; m++) {
+        mask = mask * 256 + bytes[1 + m];
+    }
+    var maskBits = maskBytes * 8;
+    var numberSamples = isBatch ? bytes[1 + maskBytes] : 1;
+
+    // read values MSB first, one bit at a time so values up to 32 bits don't
+    // overflow the bitwise operators
+    var bitPosition = (1 + maskBytes + (isBatch ? 1 : 0)) * 8;
+    function readBits(count) {
+        var value = 0;
+        for (var b = 0; b < count; b++) {
+            var byteIndex = bitPosition >> 3;
+            if (byteIndex >= bytes.length) {
+                throw 'Frame too short!';
+            }
+            var bit = (bytes[byteIndex] >> (7 - (bitPosition & 7))) & 1;
+            value = value * 2 + bit;
+            bitPosition++;
+        }
+        return value;
+    }
+
+    var samples = [];
+    for (var s = 0; s < numberSamples; s++) {
+        samples.push({});
+    }
+    for (var i = 0; i < channels.length; i++) {
+        var ch = channels[i];
+        var present = Math.floor(mask / Math.pow(2, maskBits - ch.channel)) %% 2;
+        if (!present) {
+            continue;
+        }
+        var codes = [readBits(ch.bits)];
+        if (isBatch) {
+            var width = readBits(widthBits);
+            for (var d = 1; d < numberSamples; d++) {
+                if (width === rawWidth) {
+                    codes.push(readBits(ch.bits));
+                } else {
+                    var zigzag = readBits(width);
+                    var delta = (zigzag %% 2) ? -(zigzag + 1) / 2 : zigzag / 2;
+                    codes.push(codes[d - 1] + delta);
+                }
+            }
+        }
+        for (var c = 0; c < codes.length; c++) {
+            var value = null;
+            if (codes[c] !== Math.pow(2, ch.bits) - 1) {
+                value = Number((ch.min + codes[c] * ch.resolution).toFixed(ch.decimals));
+            }
+            samples[c][ch.key] = {
+                'channel': ch.channel,
+                'instrument': ch.instrument,
+                'parameter': ch.parameter,
+                'unit': ch.unit,
+                'value': value
+            };
+        }
+    }
+
+    return isBatch ? { 'samples': samples } : samples[0];
+
+}
+
+// To use with TTN
+function decodeUplink(input) {
+    var response = compactDecode(input.bytes);
+    return { data: response };
+}
+""" % (
+        PAYLOAD_VERSION,
+        MASK_BYTES,
+        MASK_BYTES + 1,
+        BATCH_VERSION,
+        MASK_BYTES,
+        MASK_BYTES + 1,
+        BATCH_WIDTH_BITS,
+        BATCH_RAW_WIDTH,
+        "\n".join(docs),
+        PAYLOAD_VERSION,
+        BATCH_VERSION,
+        MASK_BYTES,
+        BATCH_WIDTH_BITS,
+        BATCH_RAW_WIDTH,
+        ",\n".join(table),
+    )
+    with open(DECODER_PATH, "w", encoding="utf-8", newline="\n") as f:
+        f.write(text)
+
+
+if __name__ == "__main__":
+    check_schema()
+    write_header()
+    write_decoder()
+    print("Wrote %s" % os.path.normpath(HEADER_PATH))
+    print("Wrote %s" % os.path.normpath(DECODER_PATH))
@@ -0,0 +1,224 @@
+// Header Guards
+#ifndef BINARY_LOG_RECORD_H_
+#define BINARY_LOG_RECORD_H_
+
+#include <Arduino.h>
+
+// The version of the binary log format
+#define BINARY_LOG_VERSION 1
+
+// The most values that can be held in a single record; the sketch logs up to
+// 28 with every sensor and option turned on
+#ifndef BINARY_LOG_MAX_CHANNELS
+#define BINARY_LOG_MAX_CHANNELS 32
+#endif
+
+// The largest encoded uplink frame that can be kept in a record
+#ifndef BINARY_LOG_MAX_FRAME
+#define BINARY_LOG_MAX_FRAME 128
+#endif
+
+// The most space the file header can take; the sketch's is up to 690 bytes
+// with every sensor and option turned on
+#ifndef BINARY_LOG_MAX_HEADER
+#define BINARY_LOG_MAX_HEADER 1024
+#endif
+
+// The size of the fixed start of the file header
+#define BINARY_LOG_FIXED_HEADER 13
+
+// Pass as the decimal places of a channel to print it as a whole number
+#define BINARY_LOG_INTEGER 0xFF
+
+/**
+ * @brief Builds the fixed-size records and the file header of the binary SD
+ * card log.
+ *
+ * Every record is the UTC timestamp as a 32-bit integer, then each value as a
+ * 32-bit float in the order the channels were added, then the length of the
+ * encoded uplink frame and the frame itself, padded to the frame size given
+ * to the constructor.  Everything is little-endian.
+ *
+ * The file header describes the channels, so the file can be turned back into
+ * the same CSV the logger would otherwise write:
+ *  - "NGWB", the version, and the number of channels
+ *  - the size of the header and of each record (16 bits each)
+ *  - the time zone of the timestamps in the CSV, in minutes (16 bits signed)
+ *  - the frame size
+ *  - the name of the frame column, as a length byte followed by the name
+ *  - for each channel: the number of decimal places to print (or
+ *    BINARY_LOG_INTEGER), then the name as a length byte followed by the name
+ *
+ * "Tools/binary_log_to_csv.py" does the conversion.
+ *
+ * A channel or value that doesn't fit is left out; check isTruncated().
+ */
+class binaryLogRecord {
+ public:
+    /**
+     * @param frame_bytes The space to keep for the encoded uplink frame in
+     * each record
+     */
+    explicit binaryLogRecord(uint8_t frame_bytes = 64)
+        : _frame_bytes(frame_bytes > BINARY_LOG_MAX_FRAME
+                           ? BINARY_LOG_MAX_FRAME
+                           : frame_bytes),
+          _numberChannels(0),
+          _header_size(BINARY_LOG_FIXED_HEADER),
+          _finished(false),
+          _headerTruncated(false) {
+        reset();
+    }
+    ~binaryLogRecord() {}
+
+    /**
+     * @brief Add a channel to the header.  Channels must be added in the same
+     * order as their values are.
+     *
+     * @param name The column name for the CSV
+     * @param decimals The number of decimal places to print in the CSV, or
+     * BINARY_LOG_INTEGER to print a whole number like String(int)
+     * @return True if there was room for the channel
+     */
+    bool addChannel(const char* name, uint8_t decimals) {
+        uint8_t name_length = strlen(name);
+        if (_finished || _numberChannels >= BINARY_LOG_MAX_CHANNELS ||
+            _header_size + 2 + name_length > BINARY_LOG_MAX_HEADER) {
+            _headerTruncated = true;
+            return false;
+        }
+        _header[_header_size++] = decimals;
+        _header_size            = writeName(_header_size, name, name_length);
+        _numberChannels++;
+        return true;
+    }
+
+    /**
+     * @brief Finish the header once all of the channels have been added.
+     *
+     * @param tz_minutes The time zone of the timestamps in the CSV, in
+     * minutes from UTC
+     * @param frame_name The column name of the frame for the CSV
+     * @return True if there was room for the frame name
+     */
+    bool finishHeader(int16_t tz_minutes, const char* frame_name) {
+        uint8_t name_length = strlen(frame_name);
+        if (_finished ||
+            _header_size + 1 + name_length > BINARY_LOG_MAX_HEADER) {
+            _headerTruncated = true;
+            return false;
+        }
+        // The frame name goes ahead of the channels, so shift them down
+        uint16_t channels_size = _header_size - BINARY_LOG_FIXED_HEADER;
+        memmove(_header + BINARY_LOG_FIXED_HEADER + 1 + name_length,
+                _header + BINARY_LOG_FIXED_HEADER, channels_size);
+        writeName(BINARY_LOG_FIXED_HEADER, frame_name, name_length);
+        _header_size += 1 + name_length;
+
+        _header[0] = 'N';
+        _header[1] = 'G';
+        _header[2] = 'W';
+        _header[3] = 'B';
+        _header[4] = BINARY_LOG_VERSION;
+        _header[5] = _numberChannels;
+        writeUInt16(_header + 6, _header_size);
+        writeUInt16(_header + 8, getRecordSize());
+        writeUInt16(_header + 10, static_cast<uint16_t>(tz_minutes));
+        _header[12] = _frame_bytes;
+        _finished   = true;
+        return true;
+    }
+
+    // Clears the values from the record
+    void reset() {
+        memset(_record, 0, sizeof(_record));
+        _value_number    = 0;
+        _valuesTruncated = false;
+    }
+
+    // Sets the UTC timestamp of the record
+    void setTime(uint32_t epoch) {
+        for (uint8_t i = 0; i < 4; i++) { _record[i] = (epoch >> (8 * i)); }
+    }
+
+    /**
+     * @brief Add the next value to the record.
+     *
+     * @param value The value to add
+     * @return True if there's a channel for the value
+     */
+    bool addValue(float value) {
+        if (_value_number >= _numberChannels) {
+            _valuesTruncated = true;
+            return false;
+        }
+        // SAMD floats are already little-endian IEEE 754
+        memcpy(_record + 4 + 4 * _value_number, &value, 4);
+        _value_number++;
+        return true;
+    }
+
+    /**
+     * @brief Set the encoded uplink frame of the record.  A frame too big for
+     * the record is left out.
+     *
+     * @param frame The encoded frame
+     * @param size The number of bytes in the frame
+     */
+    void setFrame(const uint8_t* frame, uint8_t size) {
+        uint8_t* frame_start = _record + 4 + 4 * _numberChannels;
+        if (size > _frame_bytes) { size = 0; }
+        frame_start[0] = size;
+        memcpy(frame_start + 1, frame, size);
+    }
+
+    uint8_t* getRecord() {
+        return _record;
+    }
+
+    uint16_t getRecordSize() {
+        return 4 + 4 * _numberChannels + 1 + _frame_bytes;
+    }
+
+    uint8_t* getHeader() {
+        return _header;
+    }
+
+    uint16_t getHeaderSize() {
+        return _header_size;
+    }
+
+    // Whether a channel or the frame name didn't fit in the header, or a
+    // value added since the last reset() didn't have a channel
+    bool isTruncated() const {
+        return _headerTruncated || _valuesTruncated;
+    }
+
+ protected:
+    void writeUInt16(uint8_t* buffer, uint16_t value) {
+        buffer[0] = value & 0xFF;
+        buffer[1] = value >> 8;
+    }
+
+    // Writes a length byte and a name into the header, returning the position
+    // after it
+    uint16_t writeName(uint16_t position, const char* name,
+                       uint8_t name_length) {
+        _header[position++] = name_length;
+        memcpy(_header + position, name, name_length);
+        return position + name_length;
+    }
+
+    uint8_t  _frame_bytes;
+    uint8_t  _numberChannels;
+    uint8_t  _value_number;
+    uint16_t _header_size;
+    bool     _finished;
+    bool     _headerTruncated;
+    bool     _valuesTruncated;
+    uint8_t  _header[BINARY_LOG_MAX_HEADER];
+    uint8_t  _record[4 + 4 * BINARY_LOG_MAX_CHANNELS + 1 +
+                    BINARY_LOG_MAX_FRAME];
+};
+
+#endif
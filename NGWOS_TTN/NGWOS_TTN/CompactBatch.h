@@ -0,0 +1,209 @@
+// Header Guards
+#ifndef COMPACT_BATCH_H_
+#define COMPACT_BATCH_H_
+
+#include <Arduino.h>
+#include "CompactPayload.h"
+
+// The most samples that can be held in a single batch
+#ifndef COMPACT_BATCH_MAX_SAMPLES
+#define COMPACT_BATCH_MAX_SAMPLES 12
+#endif
+
+// The largest batch frame ever built - the largest application payload
+// allowed by any US915 data rate
+#ifndef COMPACT_BATCH_MAX_SIZE
+#define COMPACT_BATCH_MAX_SIZE 242
+#endif
+
+/**
+ * @brief Holds several compact samples in RAM and sends them as one
+ * delta-encoded frame.
+ *
+ * The frame is a version byte, a presence mask covering every channel in any
+ * of the samples, and the number of samples.  Then, for each present channel
+ * in order:
+ *  - the code of the first sample in the schema's bits,
+ *  - a 6-bit width (COMPACT_BATCH_RAW_WIDTH if the deltas would be wider
+ * than the codes, and the codes are sent as-is instead), and
+ *  - the zigzag-encoded difference from the previous sample's code for every
+ * other sample, each in that width.
+ *
+ * The timestamp is channel 1, so it is sent once in full followed by the
+ * offsets between samples.  A sample without a value for a channel has the
+ * "no data" code for it.
+ */
+class compactBatch {
+ public:
+    /**
+     * @param max_samples The number of samples to hold before the batch is full
+     * @param max_size The largest frame that can be sent at the data rate in
+     * use
+     */
+    explicit compactBatch(uint8_t max_samples = COMPACT_BATCH_MAX_SAMPLES,
+                          uint8_t max_size    = COMPACT_BATCH_MAX_SIZE)
+        : _max_samples(max_samples > COMPACT_BATCH_MAX_SAMPLES
+                           ? COMPACT_BATCH_MAX_SAMPLES
+                           : max_samples),
+          _max_size(max_size > COMPACT_BATCH_MAX_SIZE ? COMPACT_BATCH_MAX_SIZE
+                                                      : max_size) {
+        reset();
+    }
+    ~compactBatch() {}
+
+    // Empties the batch
+    void reset() {
+        _numberSamples = 0;
+        _size          = 0;
+    }
+
+    /**
+     * @brief Add a sample to the batch.
+     *
+     * @param sample The compact payload holding the sample
+     * @return True if the sample was added; false if the batch is already full
+     * or the frame would be too big with it
+     */
+    bool addSample(const compactPayload& sample) {
+        if (_numberSamples >= _max_samples) { return false; }
+        for (uint8_t i = 0; i < COMPACT_PAYLOAD_NUM_CHANNELS; i++) {
+            _present[_numberSamples][i] = sample.isPresent(i);
+            _codes[_numberSamples][i]   = sample.getCode(i);
+        }
+        _numberSamples++;
+        if (encode() > _max_size) {
+            // take the sample back out
+            _numberSamples--;
+            encode();
+            return false;
+        }
+        return true;
+    }
+
+    bool isFull() {
+        return _numberSamples >= _max_samples;
+    }
+
+    /**
+     * @brief Change the number of samples to hold before the batch is full.
+     *
+     * Samples already in the batch are kept; if there are now too many, the
+     * batch is full and should be sent.
+     *
+     * @param max_samples The number of samples to hold
+     */
+    void setMaxSamples(uint8_t max_samples) {
+        _max_samples = max_samples > COMPACT_BATCH_MAX_SAMPLES
+            ? COMPACT_BATCH_MAX_SAMPLES
+            : max_samples;
+        if (_max_samples == 0) { _max_samples = 1; }
+    }
+
+    uint8_t getMaxSamples() {
+        return _max_samples;
+    }
+
+    uint8_t getNumberSamples() {
+        return _numberSamples;
+    }
+
+    uint8_t* getBuffer() {
+        return _buffer;
+    }
+
+    uint8_t getSize() {
+        return _size;
+    }
+
+ protected:
+    // The code of a channel in a sample, or "no data" if it wasn't in it
+    uint32_t codeFor(uint8_t sample, uint8_t index) {
+        if (!_present[sample][index]) {
+            return compactNoDataCode(compactSchema[index].bits);
+        }
+        return _codes[sample][index];
+    }
+
+    // Maps signed differences to unsigned so small negative numbers stay small
+    uint64_t zigzag(int64_t delta) {
+        return delta >= 0 ? static_cast<uint64_t>(delta) * 2
+                          : static_cast<uint64_t>(-delta) * 2 - 1;
+    }
+
+    uint8_t bitsNeeded(uint64_t value) {
+        uint8_t bits = 0;
+        while (value > 0) {
+            bits++;
+            value >>= 1;
+        }
+        return bits;
+    }
+
+    // Builds the frame, returning the size it would be even if that is too
+    // big for the buffer
+    uint16_t encode() {
+        uint8_t  frame[COMPACT_BATCH_MAX_SIZE];
+        uint16_t total_bits = (2 + COMPACT_PAYLOAD_MASK_BYTES) * 8;
+        for (uint8_t i = 0; i < COMPACT_BATCH_MAX_SIZE; i++) { frame[i] = 0; }
+        frame[0] = 0x80 | COMPACT_BATCH_VERSION;
+        frame[1 + COMPACT_PAYLOAD_MASK_BYTES] = _numberSamples;
+
+        uint16_t bit_position = total_bits;
+        for (uint8_t i = 0; i < COMPACT_PAYLOAD_NUM_CHANNELS; i++) {
+            bool in_any = false;
+            for (uint8_t s = 0; s < _numberSamples; s++) {
+                in_any |= _present[s][i];
+            }
+            if (!in_any) { continue; }
+            uint8_t mask_bit = compactSchema[i].channel - 1;
+            frame[1 + (mask_bit >> 3)] |= 0x80 >> (mask_bit & 7);
+
+            // find the widest delta
+            uint8_t width = 0;
+            for (uint8_t s = 1; s < _numberSamples; s++) {
+                int64_t delta = static_cast<int64_t>(codeFor(s, i)) -
+                    static_cast<int64_t>(codeFor(s - 1, i));
+                uint8_t needed = bitsNeeded(zigzag(delta));
+                if (needed > width) { width = needed; }
+            }
+            bool    raw        = width > compactSchema[i].bits;
+            uint8_t value_bits = raw ? compactSchema[i].bits : width;
+            total_bits += compactSchema[i].bits + COMPACT_BATCH_WIDTH_BITS +
+                value_bits * (_numberSamples - 1);
+            // stop writing once the frame is too big, but keep counting
+            if (total_bits > COMPACT_BATCH_MAX_SIZE * 8) { continue; }
+
+            compactWriteBits(frame, bit_position, codeFor(0, i),
+                             compactSchema[i].bits);
+            compactWriteBits(frame, bit_position,
+                             raw ? COMPACT_BATCH_RAW_WIDTH : width,
+                             COMPACT_BATCH_WIDTH_BITS);
+            for (uint8_t s = 1; s < _numberSamples; s++) {
+                uint32_t value = codeFor(s, i);
+                if (!raw) {
+                    value = static_cast<uint32_t>(
+                        zigzag(static_cast<int64_t>(value) -
+                               static_cast<int64_t>(codeFor(s - 1, i))));
+                }
+                compactWriteBits(frame, bit_position, value, value_bits);
+            }
+        }
+
+        uint16_t size = (total_bits + 7) >> 3;
+        if (size <= _max_size) {
+            for (uint8_t i = 0; i < size; i++) { _buffer[i] = frame[i]; }
+            _size = size;
+        }
+        return size;
+    }
+
+    uint8_t  _max_samples;
+    uint8_t  _max_size;
+    uint8_t  _numberSamples;
+    bool     _present[COMPACT_BATCH_MAX_SAMPLES][COMPACT_PAYLOAD_NUM_CHANNELS];
+    uint32_t _codes[COMPACT_BATCH_MAX_SAMPLES][COMPACT_PAYLOAD_NUM_CHANNELS];
+    uint8_t  _buffer[COMPACT_BATCH_MAX_SIZE];
+    uint8_t  _size;
+};
+
+#endif
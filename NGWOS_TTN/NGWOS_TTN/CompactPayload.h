@@ -0,0 +1,146 @@
+// Header Guards
+#ifndef COMPACT_PAYLOAD_H_
+#define COMPACT_PAYLOAD_H_
+
+#include <Arduino.h>
+#include <math.h>
+#include "CompactPayloadSchema.h"
+
+// The all-ones code for a given number of bits, which is reserved for "no
+// data"
+uint32_t compactNoDataCode(uint8_t bits) {
+    return bits >= 32 ? 0xFFFFFFFF : (static_cast<uint32_t>(1) << bits) - 1;
+}
+
+// Writes the lowest bits of a value into a buffer, MSB first, starting at the
+// given bit position and advancing it
+void compactWriteBits(uint8_t* buffer, uint16_t& bit_position, uint32_t value,
+                      uint8_t bits) {
+    for (int8_t b = bits - 1; b >= 0; b--) {
+        uint8_t byte_index = bit_position >> 3;
+        uint8_t bit_mask   = 0x80 >> (bit_position & 7);
+        if ((value >> b) & 1) {
+            buffer[byte_index] |= bit_mask;
+        } else {
+            buffer[byte_index] &= ~bit_mask;
+        }
+        bit_position++;
+    }
+}
+
+/**
+ * @brief Packs values into a compact, schema-driven LoRa frame.
+ *
+ * Each channel in CompactPayloadSchema.h has its own minimum, resolution, and
+ * bit width, so a value takes only as many bits as its range needs instead of
+ * a channel byte, a type byte, and a fixed size like Cayenne LPP.  The frame
+ * is a version byte, a presence mask with one bit per channel, then the
+ * values of the present channels packed MSB first.
+ *
+ * The schema and the matching TTN formatter ("LoRa Notes/
+ * TTNDecoder_Compact.js") are both generated by
+ * "LoRa Notes/generate_compact_payload.py" - edit the table there.
+ */
+class compactPayload {
+ public:
+    compactPayload() {
+        reset();
+    }
+    ~compactPayload() {}
+
+    // Clears all of the values from the frame
+    void reset() {
+        for (uint8_t i = 0; i < COMPACT_PAYLOAD_NUM_CHANNELS; i++) {
+            _present[i] = false;
+            _codes[i]   = 0;
+        }
+        _size = 0;
+    }
+
+    /**
+     * @brief Add a value to the frame.
+     *
+     * Values outside of the range of the channel are clamped to it.  NaN and
+     * -9999 are sent as "no data".
+     *
+     * @param channel The channel number from the schema
+     * @param value The value to add
+     * @return True if the channel is in the schema
+     */
+    bool addValue(uint8_t channel, double value) {
+        int8_t index = findChannel(channel);
+        if (index < 0) { return false; }
+        const compactChannel& schema = compactSchema[index];
+
+        uint32_t no_data  = compactNoDataCode(schema.bits);
+        uint32_t max_code = no_data - 1;
+        uint32_t code     = no_data;
+        if (!isnan(value) && value != -9999) {
+            double scaled = round((value - schema.min) / schema.resolution);
+            if (scaled < 0) {
+                code = 0;
+            } else if (scaled > max_code) {
+                code = max_code;
+            } else {
+                code = static_cast<uint32_t>(scaled);
+            }
+        }
+        _present[index] = true;
+        _codes[index]   = code;
+        _size           = 0;
+        return true;
+    }
+
+    uint8_t* getBuffer() {
+        if (_size == 0) { encode(); }
+        return _buffer;
+    }
+
+    uint8_t getSize() {
+        if (_size == 0) { encode(); }
+        return _size;
+    }
+
+    // Whether the channel at a position in the schema has a value
+    bool isPresent(uint8_t index) const {
+        return _present[index];
+    }
+
+    // The packed code of the channel at a position in the schema
+    uint32_t getCode(uint8_t index) const {
+        return _codes[index];
+    }
+
+ protected:
+    int8_t findChannel(uint8_t channel) {
+        for (uint8_t i = 0; i < COMPACT_PAYLOAD_NUM_CHANNELS; i++) {
+            if (compactSchema[i].channel == channel) { return i; }
+        }
+        return -1;
+    }
+
+    void encode() {
+        for (uint8_t i = 0; i < COMPACT_PAYLOAD_MAX_SIZE; i++) {
+            _buffer[i] = 0;
+        }
+        _buffer[0] = 0x80 | COMPACT_PAYLOAD_VERSION;
+
+        uint16_t bit_position = (1 + COMPACT_PAYLOAD_MASK_BYTES) * 8;
+        for (uint8_t i = 0; i < COMPACT_PAYLOAD_NUM_CHANNELS; i++) {
+            if (!_present[i]) { continue; }
+            // bit (channel - 1) of the mask, counting from the MSB
+            uint8_t mask_bit = compactSchema[i].channel - 1;
+            _buffer[1 + (mask_bit >> 3)] |= 0x80 >> (mask_bit & 7);
+            compactWriteBits(_buffer, bit_position, _codes[i],
+                             compactSchema[i].bits);
+        }
+        _size = (bit_position + 7) >> 3;
+    }
+
+    bool     _present[COMPACT_PAYLOAD_NUM_CHANNELS];
+    uint32_t _codes[COMPACT_PAYLOAD_NUM_CHANNELS];
+    uint8_t  _buffer[COMPACT_PAYLOAD_MAX_SIZE];
+    uint8_t  _size;
+};
+
+#endif
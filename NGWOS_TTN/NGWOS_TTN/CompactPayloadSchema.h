@@ -0,0 +1,49 @@
+// THIS FILE IS GENERATED BY
+// "LoRa Notes/generate_compact_payload.py" - DO NOT EDIT IT
+// BY HAND!  Edit the table in the generator and run it again.
+
+// Header Guards
+#ifndef COMPACT_PAYLOAD_SCHEMA_H_
+#define COMPACT_PAYLOAD_SCHEMA_H_
+
+#include <Arduino.h>
+
+#define COMPACT_PAYLOAD_VERSION 1
+#define COMPACT_BATCH_VERSION 2
+#define COMPACT_BATCH_WIDTH_BITS 6
+#define COMPACT_BATCH_RAW_WIDTH 63
+#define COMPACT_PAYLOAD_MASK_BYTES 3
+#define COMPACT_PAYLOAD_NUM_CHANNELS 19
+// Version byte, presence mask, and every channel present
+#define COMPACT_PAYLOAD_MAX_SIZE 37
+
+struct compactChannel {  // Structure declaration
+    uint8_t channel;
+    double  min;
+    double  resolution;
+    uint8_t bits;
+};
+
+const compactChannel compactSchema[COMPACT_PAYLOAD_NUM_CHANNELS] = {
+    {1, 0.0, 1.0, 32},       // Stonefly Measurement Timestamp (UNIX)
+    {2, -150.0, 1.0, 8},     // mDot RSSI (signal strength)
+    {3, -40.0, 0.01, 15},    // SHT40 Equipment Temperature
+    {4, 0.0, 0.01, 14},      // SHT40 Relative Humidity
+    {5, -50.0, 0.001, 17},   // Vega Puls 21 Gauge Height (Stage)
+    {6, 0.0, 0.001, 14},     // Vega Puls 21 Range
+    {7, -40.0, 0.1, 11},     // Vega Puls 21 Temperature
+    {8, 0.0, 0.1, 11},       // Vega Puls 21 Reliability
+    {9, 0.0, 1.0, 8},        // Vega Puls 21 Error Code
+    {10, 0.0, 0.5, 12},      // EVERBRIGHT ALS Luminosity
+    {11, 0.0, 0.001, 13},    // MAX17048 Battery Voltage
+    {12, 0.0, 0.1, 11},      // MAX17048 Battery Charge Percent
+    {13, -3276.8, 0.1, 16},  // MAX17048 Battery (Dis)Charge Rate
+    {14, 0.0, 1.0, 17},      // Meter Hydros 21 Specific Conductance
+    {15, -40.0, 0.1, 11},    // Meter Hydros 21 Temperature
+    {16, 0.0, 0.001, 14},    // Meter Hydros 21 Water Depth
+    {17, 0.0, 0.001, 13},    // Stonefly Analog 3.3V Battery Voltage
+    {18, 0.0, 0.001, 15},    // Stonefly Analog 12V Battery Voltage
+    {19, 0.0, 0.1, 12},      // Stonefly Previous Cycle Awake Time
+};
+
+#endif
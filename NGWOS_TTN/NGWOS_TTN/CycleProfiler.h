@@ -0,0 +1,129 @@
+// Header Guards
+#ifndef CYCLE_PROFILER_H_
+#define CYCLE_PROFILER_H_
+
+#include <Arduino.h>
+
+// The number of timed phases of a logging cycle
+#define CYCLE_PROFILE_NUM_PHASES 7
+
+/**
+ * @brief Times the phases of each logging cycle.
+ *
+ * Call beginCycle() when the logger wakes to take a reading, wrap each phase
+ * in start() and stop(), and call endCycle() before it goes back to sleep.  A
+ * phase that runs more than once in a cycle, like waking the modem for a
+ * batch and again for a sample too big for it, adds up.  Phases can overlap;
+ * the sensor power and modem awake phases span the others to give the time
+ * those are drawing power.  The times are only final once the cycle has
+ * ended, so they're read from the last whole cycle.
+ *
+ * Only micros() is read, so timing a phase costs next to nothing.  Since
+ * micros() stops while the processor sleeps, a sleep in the middle of a cycle,
+ * like Logger::sleepFor() during a sensor warm-up, is added with addSleep() to
+ * any phases running and to the cycle.
+ */
+class cycleProfiler {
+ public:
+    // The timed phases of a cycle
+    enum phase {
+        MODEM_WAKE = 0,
+        WARM_UP,
+        SDI12,
+        SD_CARD,
+        UPLINK,
+        SENSOR_POWER,  // the whole time the sensors are powered
+        MODEM_AWAKE,   // the whole time the modem is awake
+    };
+
+    cycleProfiler() : _hasLastCycle(false), _sleptMicros(0) {
+        beginCycle();
+    }
+    ~cycleProfiler() {}
+
+    // Start timing a new cycle
+    void beginCycle() {
+        _cycleStart       = now();
+        _cycleSleptMicros = 0;
+        for (uint8_t i = 0; i < CYCLE_PROFILE_NUM_PHASES; i++) {
+            _phaseMicros[i] = 0;
+        }
+    }
+
+    // Finish the cycle, keeping its times to be read
+    void endCycle() {
+        for (uint8_t i = 0; i < CYCLE_PROFILE_NUM_PHASES; i++) {
+            _lastPhaseMicros[i] = _phaseMicros[i];
+        }
+        _lastAwakeMicros = now() - _cycleStart;
+        _lastSleptMicros = _cycleSleptMicros;
+        _hasLastCycle    = true;
+    }
+
+    void start(phase which) {
+        _phaseStart[which] = now();
+    }
+
+    void stop(phase which) {
+        _phaseMicros[which] += now() - _phaseStart[which];
+    }
+
+    // Add a sleep, in milliseconds, that micros() didn't see
+    void addSleep(uint32_t ms) {
+        _sleptMicros      += ms * 1000;
+        _cycleSleptMicros += ms * 1000;
+    }
+
+    // Whether a whole cycle has been timed since the logger started
+    bool hasLastCycle() {
+        return _hasLastCycle;
+    }
+
+    // The time spent in a phase in the last whole cycle, in milliseconds
+    uint32_t getLastPhaseMillis(phase which) {
+        return (_lastPhaseMicros[which] + 500) / 1000;
+    }
+
+    // The time from the start to the end of the last whole cycle, in
+    // milliseconds, including any sleeps added to it
+    uint32_t getLastAwakeMillis() {
+        return (_lastAwakeMicros + 500) / 1000;
+    }
+
+    // The time the processor slept during the last whole cycle, in
+    // milliseconds
+    uint32_t getLastSleptMillis() {
+        return (_lastSleptMicros + 500) / 1000;
+    }
+
+    static const char* getPhaseName(phase which) {
+        switch (which) {
+            case MODEM_WAKE: return "Modem Wake";
+            case WARM_UP: return "Warm Up";
+            case SDI12: return "SDI-12";
+            case SD_CARD: return "SD Card";
+            case UPLINK: return "Uplink";
+            case SENSOR_POWER: return "Sensor Power";
+            case MODEM_AWAKE: return "Modem Awake";
+            default: return "Unknown";
+        }
+    }
+
+ protected:
+    // micros(), moved on by the sleeps it didn't see
+    uint32_t now() {
+        return micros() + _sleptMicros;
+    }
+
+    bool     _hasLastCycle;
+    uint32_t _cycleStart;
+    uint32_t _phaseStart[CYCLE_PROFILE_NUM_PHASES];
+    uint32_t _phaseMicros[CYCLE_PROFILE_NUM_PHASES];
+    uint32_t _lastPhaseMicros[CYCLE_PROFILE_NUM_PHASES];
+    uint32_t _lastAwakeMicros;
+    uint32_t _sleptMicros;
+    uint32_t _cycleSleptMicros;
+    uint32_t _lastSleptMicros;
+};
+
+#endif
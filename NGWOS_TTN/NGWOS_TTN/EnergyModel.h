@@ -0,0 +1,166 @@
+// Header Guards
+#ifndef ENERGY_MODEL_H_
+#define ENERGY_MODEL_H_
+
+#include <Arduino.h>
+#include "CycleProfiler.h"
+
+// The number of milliseconds in an hour, to turn mA * ms into mAh
+#define ENERGY_MODEL_MS_PER_HOUR 3600000.0
+
+/**
+ * @brief The current drawn by each part of the logger, in mA.
+ */
+struct energyModelCurrents {
+    float mcuActive;      // the processor awake
+    float mcuStandby;     // the whole board asleep, not counting the rest
+    float sensors;        // everything on the switched sensor power
+    float modemAwake;     // the modem awake and listening, but not sending
+    float modemTransmit;  // the modem sending
+    float modemSleep;     // the modem asleep
+    float sdWrite;        // the SD card being written
+    float sdIdle;         // the SD card powered but idle
+};
+
+/**
+ * @brief Estimates the charge used by each logging cycle from the times taken
+ * by a cycleProfiler.
+ *
+ * Each part of the logger is charged for the time the profiler says it was on
+ * at its current from energyModelCurrents, and for the rest of the cycle at
+ * its idle or sleep current.  The time the modem spends sending isn't timed,
+ * so it's the number of transmissions counted with addTransmission() times the
+ * time on air of each one.  The sleep between readings is taken to be the
+ * rest of the logging interval, since the clock the profiler uses stops while
+ * the processor sleeps.  Any sleeps in the middle of the cycle, like during a
+ * sensor warm-up, are added to the profiler, and the processor is charged its
+ * standby current for them.
+ *
+ * The estimates are meant to be checked against the battery fuel gauge, not
+ * to replace it.
+ */
+class energyModel {
+ public:
+    /**
+     * @param currents The current drawn by each part of the logger
+     * @param transmit_ms The time on air of each message, in milliseconds
+     * @param battery_mAh The capacity of the battery, in mAh
+     */
+    energyModel(const energyModelCurrents& currents, uint16_t transmit_ms,
+                float battery_mAh)
+        : _currents(currents),
+          _transmit_ms(transmit_ms),
+          _battery_mAh(battery_mAh),
+          _transmissions(0),
+          _hasLastCycle(false),
+          _lastCycle_mAh(0),
+          _lastCycleSeconds(0),
+          _today_mAh(0),
+          _today(0) {}
+    ~energyModel() {}
+
+    // Count a message sent (or tried) by the modem in this cycle
+    void addTransmission() {
+        _transmissions++;
+    }
+
+    /**
+     * @brief Estimate the charge used by the cycle the profiler just ended,
+     * and add it to the total for the day.
+     *
+     * @param profiler The profiler, after its endCycle()
+     * @param cycle_seconds The length of the whole cycle, including the sleep
+     * until the next one
+     * @param local_epoch The local time of the cycle, to know when to start a
+     * new day
+     */
+    void endCycle(cycleProfiler& profiler, uint32_t cycle_seconds,
+                  uint32_t local_epoch) {
+        float cycle_ms   = cycle_seconds * 1000.0;
+        float awake_ms   = profiler.getLastAwakeMillis();
+        float slept_ms   = profiler.getLastSleptMillis();
+        float sensor_ms  = profiler.getLastPhaseMillis(
+            cycleProfiler::SENSOR_POWER);
+        float modem_ms   = profiler.getLastPhaseMillis(
+            cycleProfiler::MODEM_AWAKE);
+        float sd_ms      = profiler.getLastPhaseMillis(cycleProfiler::SD_CARD);
+        float sending_ms = static_cast<float>(_transmissions) * _transmit_ms;
+        if (awake_ms > cycle_ms) { cycle_ms = awake_ms; }
+        if (sending_ms > modem_ms) { sending_ms = modem_ms; }
+
+        // in mA * ms
+        float charge = _currents.mcuActive * (awake_ms - slept_ms) +
+            _currents.mcuStandby * (cycle_ms - awake_ms + slept_ms) +
+            _currents.sensors * sensor_ms +
+            _currents.modemAwake * (modem_ms - sending_ms) +
+            _currents.modemTransmit * sending_ms +
+            _currents.modemSleep * (cycle_ms - modem_ms) +
+            _currents.sdWrite * sd_ms + _currents.sdIdle * (cycle_ms - sd_ms);
+
+        _lastCycle_mAh    = charge / ENERGY_MODEL_MS_PER_HOUR;
+        _lastCycleSeconds = cycle_seconds;
+        _hasLastCycle     = true;
+        _transmissions    = 0;
+
+        uint32_t day = local_epoch / 86400;
+        if (day != _today) {
+            _today     = day;
+            _today_mAh = 0;
+        }
+        _today_mAh += _lastCycle_mAh;
+    }
+
+    // Whether a whole cycle has been estimated since the logger started
+    bool hasLastCycle() {
+        return _hasLastCycle;
+    }
+
+    // The charge used by the last whole cycle, in mAh
+    float getLastCycleCharge() {
+        return _lastCycle_mAh;
+    }
+
+    // The charge used so far today, in mAh
+    float getChargeToday() {
+        return _today_mAh;
+    }
+
+    /**
+     * @brief The rate the last cycle would drain the battery, in percent of
+     * its capacity per hour.
+     *
+     * This is negative, like the (dis)charge rate of the MAX17048 while
+     * discharging, so the two can be compared directly.
+     */
+    float getDischargeRate() {
+        if (_lastCycleSeconds == 0) { return 0; }
+        float average_mA = _lastCycle_mAh * 3600.0 / _lastCycleSeconds;
+        return -100.0 * average_mA / _battery_mAh;
+    }
+
+    /**
+     * @brief The days a battery with the given charge would last if every
+     * cycle were like the last one.
+     *
+     * @param percent The charge left in the battery, in percent
+     */
+    float getDaysLeft(float percent) {
+        if (_lastCycle_mAh <= 0) { return 0; }
+        float cycles_per_day = 86400.0 / _lastCycleSeconds;
+        return (_battery_mAh * percent / 100.0) /
+            (_lastCycle_mAh * cycles_per_day);
+    }
+
+ protected:
+    energyModelCurrents _currents;
+    uint16_t            _transmit_ms;
+    float               _battery_mAh;
+    uint16_t            _transmissions;
+    bool                _hasLastCycle;
+    float               _lastCycle_mAh;
+    uint32_t            _lastCycleSeconds;
+    float               _today_mAh;
+    uint32_t            _today;
+};
+
+#endif
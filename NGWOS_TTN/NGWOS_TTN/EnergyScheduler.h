@@ -0,0 +1,300 @@
+// Header Guards
+#ifndef ENERGY_SCHEDULER_H_
+#define ENERGY_SCHEDULER_H_
+
+#include <Arduino.h>
+#include <math.h>
+
+// Below this charge, in percent, the logger only sleeps
+#ifndef ENERGY_CRITICAL_PERCENT
+#define ENERGY_CRITICAL_PERCENT 10.0
+#endif
+
+// Above this charge, in percent, the logger does everything regardless of the
+// forecast
+#ifndef ENERGY_FULL_PERCENT
+#define ENERGY_FULL_PERCENT 90.0
+#endif
+
+// With at least this many days of charge left at the recent rate, the logger
+// does everything
+#ifndef ENERGY_NORMAL_DAYS
+#define ENERGY_NORMAL_DAYS 14.0
+#endif
+
+// With at least this many days of charge left at the recent rate, the logger
+// conserves; with fewer it only does the minimum
+#ifndef ENERGY_CONSERVE_DAYS
+#define ENERGY_CONSERVE_DAYS 5.0
+#endif
+
+// How much better things must be to move up a level than to stay at it, so
+// the level doesn't flip back and forth at a boundary
+#ifndef ENERGY_LEVEL_HYSTERESIS
+#define ENERGY_LEVEL_HYSTERESIS 1.25
+#endif
+
+// The time constant of the average charge rate, in hours - a day averages out
+// the sun
+#ifndef ENERGY_RATE_HOURS
+#define ENERGY_RATE_HOURS 24.0
+#endif
+
+// The light, in lux, above which the solar panel is taken to be in the sun
+#ifndef ENERGY_SUN_LUX
+#define ENERGY_SUN_LUX 1000.0
+#endif
+
+// The battery voltages used when there's no fuel gauge
+#ifndef ENERGY_CRITICAL_VOLTS
+#define ENERGY_CRITICAL_VOLTS 3.4
+#endif
+#ifndef ENERGY_LOW_VOLTS
+#define ENERGY_LOW_VOLTS 3.55
+#endif
+
+/**
+ * @brief Decides how often to log, send, and take pictures from the charge
+ * left in the battery and the charge it expects to get.
+ *
+ * The forecast is the days the battery would last at its average charge rate
+ * over about the last day, which takes in a whole day of sun and dark.  If
+ * the last day was much darker than usual, as judged by its brightest light
+ * reading, the forecast is halved, since the battery is likely to fare worse
+ * than the average says.  The forecast sets one of four levels, and each
+ * level stretches the logging interval and the time between messages and
+ * pictures.  While the sun is out and the battery is charging, the logger
+ * works one level higher.
+ *
+ * Without a fuel gauge, the level is set from the battery voltage instead,
+ * using the same voltages the programs always used.  Even at the lowest level
+ * that still logs, a message is sent now and then rather than not at all.
+ */
+class energyScheduler {
+ public:
+    // How much the logger can afford to do
+    enum level {
+        CRITICAL = 0,  // only sleep
+        SURVIVAL,      // log rarely, send rarely, no pictures
+        CONSERVE,      // log and send less often, fewer pictures
+        NORMAL,        // do everything
+    };
+
+    energyScheduler()
+        : _level(NORMAL),
+          _hasRate(false),
+          _averageRate(0),
+          _lastEpoch(0),
+          _today(0),
+          _todayPeakLux(0),
+          _lastDayPeakLux(-1),
+          _typicalPeakLux(-1),
+          _sunny(false),
+          _daysLeft(INFINITY) {}
+    ~energyScheduler() {}
+
+    /**
+     * @brief Update the level from the battery fuel gauge.
+     *
+     * @param percent The charge left in the battery, in percent
+     * @param rate The charge rate, in percent per hour; negative while
+     * discharging
+     * @param lux The latest light reading, or -9999 if there isn't one
+     * @param local_epoch The current local time
+     */
+    void update(float percent, float rate, float lux, uint32_t local_epoch) {
+        updateRate(rate, local_epoch);
+        updateLight(lux, local_epoch);
+        _sunny = lux >= ENERGY_SUN_LUX && rate > 0;
+
+        // Days until the battery reaches the critical charge
+        _daysLeft = INFINITY;
+        if (_averageRate < 0) {
+            _daysLeft = (percent - ENERGY_CRITICAL_PERCENT) /
+                (-_averageRate * 24.0);
+            if (_lastDayPeakLux >= 0 && _typicalPeakLux > 0 &&
+                _lastDayPeakLux < _typicalPeakLux / 2) {
+                _daysLeft /= 2;
+            }
+        }
+
+        // once critical, wait for some charge to come back before waking up
+        float critical = ENERGY_CRITICAL_PERCENT;
+        if (_level == CRITICAL) { critical += 5; }
+
+        if (percent < critical) {
+            _level = CRITICAL;
+        } else if (percent >= ENERGY_FULL_PERCENT ||
+                   _daysLeft >= threshold(ENERGY_NORMAL_DAYS, NORMAL)) {
+            _level = NORMAL;
+        } else if (_daysLeft >= threshold(ENERGY_CONSERVE_DAYS, CONSERVE)) {
+            _level = CONSERVE;
+        } else {
+            _level = SURVIVAL;
+        }
+    }
+
+    /**
+     * @brief Update the level from the battery voltage, for a logger without
+     * a fuel gauge.
+     *
+     * @param volts The battery voltage
+     */
+    void updateFromVoltage(float volts) {
+        _sunny    = false;
+        _daysLeft = NAN;
+        if (volts < ENERGY_CRITICAL_VOLTS) {
+            _level = CRITICAL;
+        } else if (volts < ENERGY_LOW_VOLTS) {
+            _level = SURVIVAL;
+        } else {
+            _level = NORMAL;
+        }
+    }
+
+    // The level to work at now, including any boost from the sun
+    level getLevel() {
+        if (_sunny && _level != CRITICAL && _level != NORMAL) {
+            return static_cast<level>(_level + 1);
+        }
+        return _level;
+    }
+
+    static const char* getLevelName(level which) {
+        switch (which) {
+            case CRITICAL: return "critical";
+            case SURVIVAL: return "survival";
+            case CONSERVE: return "conserve";
+            case NORMAL: return "normal";
+            default: return "unknown";
+        }
+    }
+
+    // The days of charge left at the recent rate; infinite while charging
+    float getDaysLeft() {
+        return _daysLeft;
+    }
+
+    /**
+     * @brief The logging interval to use at the current level.
+     *
+     * @param base_minutes The logging interval when there's charge to spare
+     */
+    int16_t getIntervalMinutes(int16_t base_minutes) {
+        return base_minutes * getSettings().intervalMultiplier;
+    }
+
+    /**
+     * @brief The number of readings to take for every message sent.  Batched
+     * programs can hold this many times as many readings in each batch.
+     */
+    uint8_t getReadingsPerMessage() {
+        return getSettings().readingsPerMessage;
+    }
+
+    /**
+     * @brief Whether the reading at the given time should be sent.
+     *
+     * The messages are lined up with the clock, like the readings, so the
+     * answer doesn't depend on how long the logger has been running.
+     *
+     * @param local_epoch The local time of the reading
+     * @param base_minutes The logging interval when there's charge to spare
+     */
+    bool shouldPublish(uint32_t local_epoch, int16_t base_minutes) {
+        return isEvery(local_epoch, base_minutes,
+                       getSettings().readingsPerMessage);
+    }
+
+    /**
+     * @brief Whether a picture should be taken with the reading at the given
+     * time.
+     *
+     * @param local_epoch The local time of the reading
+     * @param base_minutes The logging interval when there's charge to spare
+     */
+    bool shouldCaptureImage(uint32_t local_epoch, int16_t base_minutes) {
+        return isEvery(local_epoch, base_minutes,
+                       getSettings().readingsPerImage);
+    }
+
+ protected:
+    // What the logger does at each level; 0 means never
+    struct levelSettings {
+        uint8_t intervalMultiplier;
+        uint8_t readingsPerMessage;
+        uint8_t readingsPerImage;
+    };
+
+    levelSettings getSettings() {
+        switch (getLevel()) {
+            case NORMAL: return {1, 1, 1};
+            case CONSERVE: return {2, 3, 4};
+            case SURVIVAL: return {4, 12, 0};
+            default: return {4, 0, 0};
+        }
+    }
+
+    // Whether the time is on a whole number of the given readings
+    bool isEvery(uint32_t local_epoch, int16_t base_minutes,
+                 uint8_t readings) {
+        if (readings == 0) { return false; }
+        uint32_t period = static_cast<uint32_t>(
+                              getIntervalMinutes(base_minutes)) *
+            60 * readings;
+        return local_epoch % period == 0;
+    }
+
+    // The forecast days needed for a level - more to move up to it than to
+    // stay at it
+    float threshold(float days, level to) {
+        return _level >= to ? days : days * ENERGY_LEVEL_HYSTERESIS;
+    }
+
+    // Adds a reading to the average charge rate, weighted by the time since
+    // the last one
+    void updateRate(float rate, uint32_t local_epoch) {
+        if (isnan(rate) || rate == -9999) { return; }
+        if (!_hasRate || local_epoch <= _lastEpoch) {
+            _averageRate = rate;
+            _hasRate     = true;
+        } else {
+            float hours  = (local_epoch - _lastEpoch) / 3600.0;
+            float weight = hours / (ENERGY_RATE_HOURS + hours);
+            _averageRate += weight * (rate - _averageRate);
+        }
+        _lastEpoch = local_epoch;
+    }
+
+    // Keeps the brightest reading of each day, and a running typical value of
+    // it, as a measure of how much sun the panel gets
+    void updateLight(float lux, uint32_t local_epoch) {
+        uint32_t day = local_epoch / 86400;
+        if (day != _today) {
+            if (_today != 0) {
+                _lastDayPeakLux = _todayPeakLux;
+                _typicalPeakLux = _typicalPeakLux < 0
+                    ? _todayPeakLux
+                    : _typicalPeakLux + (_todayPeakLux - _typicalPeakLux) / 7;
+            }
+            _today        = day;
+            _todayPeakLux = 0;
+        }
+        if (!isnan(lux) && lux != -9999 && lux > _todayPeakLux) {
+            _todayPeakLux = lux;
+        }
+    }
+
+    level    _level;
+    bool     _hasRate;
+    float    _averageRate;
+    uint32_t _lastEpoch;
+    uint32_t _today;
+    float    _todayPeakLux;
+    float    _lastDayPeakLux;
+    float    _typicalPeakLux;
+    bool     _sunny;
+    float    _daysLeft;
+};
+
+#endif
@@ -0,0 +1,157 @@
+// Header Guards
+#ifndef FAST_BOOT_H_
+#define FAST_BOOT_H_
+
+#include <Arduino.h>
+
+// Where the known-good marker is kept: the backup RAM of the SAMD51, which
+// isn't cleared by a reset
+#if defined(__SAMD51__) && !defined(FAST_BOOT_MARKER_ADDR)
+#define FAST_BOOT_MARKER_ADDR BKUPRAM_ADDR
+#endif
+
+// "FBOO", to tell the marker from whatever was in the RAM at power on
+#define FAST_BOOT_MAGIC 0x46424F4FUL
+
+/**
+ * @brief Decides whether setup() can skip what's only there for a person
+ * watching, after the logger restarts on its own.
+ *
+ * After the watchdog resets a hung logger, or the battery sags low enough to
+ * brown out, nobody is there to see the lights or read the sensor details,
+ * and the program and its settings are the same as when it last started.
+ * Once setup() has gone all the way through - finding the sensors and
+ * joining the network - it calls markGood(), which leaves a marker in RAM
+ * that survives a reset but not a loss of power.  The next start is a fast
+ * one if the reset was from the watchdog or a brown-out and the marker is
+ * there for the same program.  Any other reset, like power on, the reset
+ * button, or a new program, always gets a full start.
+ *
+ * The marker is used up by begin(), so if something goes wrong during a fast
+ * start and the watchdog resets the logger again, the next start is a full
+ * one.
+ */
+class fastBoot {
+ public:
+    // What reset the processor
+    enum resetCause {
+        POWER_ON = 0,  // power was turned on
+        EXTERNAL,      // the reset button
+        WATCHDOG,      // the watchdog timed out
+        BROWN_OUT,     // the supply voltage dropped too low
+        SYSTEM,        // the program asked for a reset
+        OTHER,
+    };
+
+    /**
+     * @param config A string that changes with the program and its settings,
+     * like the build date and time
+     */
+    explicit fastBoot(const char* config)
+        : _config(config), _cause(OTHER), _fast(false) {}
+    ~fastBoot() {}
+
+    /**
+     * @brief Check the reset cause and the marker.  Call this first thing in
+     * setup().
+     *
+     * @return True if this can be a fast start
+     */
+    bool begin() {
+        _cause = readResetCause();
+        _fast  = (_cause == WATCHDOG || _cause == BROWN_OUT) && hasMarker();
+        clearMarker();
+        return _fast;
+    }
+
+    // Whether this is a fast start
+    bool isFast() {
+        return _fast;
+    }
+
+    resetCause getResetCause() {
+        return _cause;
+    }
+
+    static const char* getResetCauseName(resetCause which) {
+        switch (which) {
+            case POWER_ON: return "power on";
+            case EXTERNAL: return "reset button";
+            case WATCHDOG: return "watchdog";
+            case BROWN_OUT: return "brown-out";
+            case SYSTEM: return "system reset";
+            default: return "unknown";
+        }
+    }
+
+    // Leave the marker for the next start, once setup() has found the sensors
+    // and joined the network
+    void markGood() {
+#ifdef FAST_BOOT_MARKER_ADDR
+        volatile uint32_t* marker = markerAddress();
+        marker[0]                 = FAST_BOOT_MAGIC;
+        marker[1]                 = configHash();
+        marker[2]                 = ~configHash();
+#endif
+    }
+
+ protected:
+    resetCause readResetCause() {
+#if defined(__SAMD51__)
+        uint8_t cause = RSTC->RCAUSE.reg;
+        if (cause & RSTC_RCAUSE_POR) { return POWER_ON; }
+        if (cause & (RSTC_RCAUSE_BODCORE | RSTC_RCAUSE_BODVDD)) {
+            return BROWN_OUT;
+        }
+        if (cause & RSTC_RCAUSE_WDT) { return WATCHDOG; }
+        if (cause & RSTC_RCAUSE_EXT) { return EXTERNAL; }
+        if (cause & RSTC_RCAUSE_SYST) { return SYSTEM; }
+#elif defined(ARDUINO_ARCH_SAMD)
+        uint8_t cause = PM->RCAUSE.reg;
+        if (cause & PM_RCAUSE_POR) { return POWER_ON; }
+        if (cause & (PM_RCAUSE_BOD12 | PM_RCAUSE_BOD33)) { return BROWN_OUT; }
+        if (cause & PM_RCAUSE_WDT) { return WATCHDOG; }
+        if (cause & PM_RCAUSE_EXT) { return EXTERNAL; }
+        if (cause & PM_RCAUSE_SYST) { return SYSTEM; }
+#endif
+        return OTHER;
+    }
+
+    bool hasMarker() {
+#ifdef FAST_BOOT_MARKER_ADDR
+        volatile uint32_t* marker = markerAddress();
+        return marker[0] == FAST_BOOT_MAGIC && marker[1] == configHash() &&
+            marker[2] == ~configHash();
+#else
+        return false;
+#endif
+    }
+
+    void clearMarker() {
+#ifdef FAST_BOOT_MARKER_ADDR
+        markerAddress()[0] = 0;
+#endif
+    }
+
+#ifdef FAST_BOOT_MARKER_ADDR
+    volatile uint32_t* markerAddress() {
+        return reinterpret_cast<volatile uint32_t*>(FAST_BOOT_MARKER_ADDR);
+    }
+#endif
+
+    // An FNV-1a hash of the configuration string
+    uint32_t configHash() {
+        uint32_t hash = 2166136261UL;
+        for (const char* c = _config; *c; c++) {
+            hash ^= static_cast<uint8_t>(*c);
+            hash *= 16777619UL;
+        }
+        return hash;
+    }
+
+    const char* _config;
+    resetCause  _cause;
+    bool        _fast;
+};
+
+#endif
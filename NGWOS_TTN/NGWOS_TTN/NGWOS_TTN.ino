@@ -13,6 +13,30 @@
 // Select Sensors
 // #define USE_VEGA_PULS
 #define USE_METER_HYDROS21
+// Send the compact bit-packed payload instead of Cayenne LPP
+// NOTE: The TTN payload formatter must be changed to
+// "LoRa Notes/TTNDecoder_Compact.js" to match!
+// #define USE_COMPACT_PAYLOAD
+// Hold several samples and send them together in one delta-encoded compact
+// frame, only waking the modem when the batch is sent
+// NOTE: This also requires "LoRa Notes/TTNDecoder_Compact.js"
+// #define USE_BATCHED_UPLINKS
+// Save fixed-size binary records on the SD card instead of lines of CSV
+// NOTE: Use "Tools/binary_log_to_csv.py" to turn the files back into CSV
+// #define USE_BINARY_LOG
+// Save how long each part of the previous reading took with every record
+// NOTE: Use "Tools/cycle_profile_summary.py" to summarize the times
+// #define USE_CYCLE_PROFILE
+// Also send how long the logger was awake for the previous reading
+// NOTE: This is only sent in the compact payload
+// #define USE_CYCLE_PROFILE_UPLINK
+// Save an estimate of the charge used by the previous reading and so far today
+// NOTE: Set the currents in the "Energy Model" section to match your hardware
+// #define USE_ENERGY_MODEL
+
+#if defined(USE_BATCHED_UPLINKS) && !defined(USE_COMPACT_PAYLOAD)
+#define USE_COMPACT_PAYLOAD
+#endif
 
 // Defines to help me print strings
 // this converts to string
@@ -63,8 +87,21 @@
 #endif
 // Local H files with separated fxns
 #include "SDI12Master.h"
+#include "SDI12BusScheduler.h"
+#include "CompactPayload.h"
+#include "CompactBatch.h"
+#include "BinaryLogRecord.h"
+#include "CycleProfiler.h"
+#include "EnergyModel.h"
+#include "EnergyScheduler.h"
+#include "StageEventDetector.h"
+#include "RecordFormatter.h"
+#include "SampleSchedule.h"
+#include "AnalogCache.h"
+#include "FastBoot.h"
 #include "LoRaModemFxns.h"
 #include "src/LoggerBase.h"
+#include "src/UplinkQueue.h"
 
 
 // ==========================================================================
@@ -74,8 +111,42 @@
 const char* sketchName = "TheThingsNetwork.ino";
 // Logger ID, also becomes the prefix for the name of the data file on SD card
 const char* LoggerID = "24008";
+// Skips the start-up lights, sensor details, and modem setup after a watchdog
+// reset or brown-out, as long as the same program started fully before
+// NOTE: Any other reset, like power on or the reset button, is a full start
+fastBoot bootMode(__DATE__ " " __TIME__);
 // How frequently (in minutes) to log data
 const int8_t loggingInterval = 5;
+// How frequently (in minutes) to log data while the stage is changing quickly
+// NOTE: Every reading is sent while the stage is changing quickly.  Keep an eye
+// on The Things Network's fair use airtime limit during long events.
+const int8_t eventLoggingInterval = 1;
+// The rise or fall of the stage, in m per hour, that starts an event
+const float stageEventRate = 0.15;
+// A stage, in m, that starts an event when it's crossed; -9999 for none
+const float stageEventThreshold = -9999;
+// Watches the stage (or the Hydros 21 depth, without a Vega Puls) for events
+stageEventDetector stageWatch(stageEventRate, stageEventThreshold,
+                              loggingInterval * 60L);
+// How often (in minutes) to read each sensor
+// NOTE: Each sensor is read at the first reading in each of its intervals, so
+// an interval at or below the logging interval means every reading.  Values
+// that aren't read are saved as -9999 and left out of the uplink.  The sensor
+// power is only turned on when the Vega Puls or Hydros 21 is due, and both are
+// read at every reading during a stage event.
+sampleSchedule vegaSchedule(5);        // the Vega Puls
+sampleSchedule hydrosSchedule(5);      // the Hydros 21
+sampleSchedule enclosureSchedule(30);  // the SHT40
+sampleSchedule lightSchedule(15);      // the ALS-PT19
+sampleSchedule batterySchedule(60);    // the fuel gauge and battery voltages
+// How long (in seconds) lines can be held in RAM before they're written to the
+// SD card; set to 0 to write every line as soon as it's taken
+// NOTE: Lines are also written whenever the buffer fills and before the logger
+// sleeps on a low battery, but any still waiting are lost on a reset.
+const uint32_t sdFlushInterval = 3600L;
+// The expected length of each line on the SD card, used to reserve a day of
+// space in each new file; set to 0 to let the files grow line by line
+const uint16_t sdRecordBytes = 200;
 // Your logger's timezone.
 const int8_t timeZone = -5;  // Eastern Standard Time
 // NOTE:  Daylight savings time will not be applied!  Please use standard time!
@@ -147,15 +218,37 @@ loraModemTTN ttn_modem(modemVccPin, modemSleepRqPin, modemStatusPin,
 //  Analog Devices MAX17048 3µA 1-Cell Fuel Gauge
 // Create the battery monitor object
 Adafruit_MAX17048 max17048;
+// Whether the battery monitor was found; without it, the energy scheduler falls
+// back to the battery voltage
+bool fuelGaugeFound = false;
 
 // Everlight ALS-PT19 Ambient Light Sensor
 // Set the analog input pin
-const int8_t alsData = 74;
+const int8_t  alsData    = 74;
+// The number of readings averaged for each light reading; the light is noisy,
+// and each reading takes well under a millisecond
+const uint8_t alsSamples = 32;
 
 // Sensirion SHT4X Digital Humidity and Temperature Sensor
 // Create the SHT object
 Adafruit_SHT4x sht4 = Adafruit_SHT4x();
 
+// ==========================================================================
+// SDI-12 Bus
+// ==========================================================================
+
+// The pin of the SDI-12 data bus shared by all of the SDI-12 sensors
+const int8_t sdi12DataPin = 3;
+// Define the SDI-12 bus
+SDI12 sdi12Bus(sdi12DataPin);
+// Runs concurrent measurements on all of the sensors on the bus, so the wait
+// for the whole bus is only as long as the slowest sensor
+// NOTE: Sensors never send a service request for a concurrent measurement, so
+// the wait always runs to the measurement time the sensor gave.  When only one
+// sensor is due, it gets a standard measurement instead, and its service
+// request ends the wait as soon as it's ready.
+sdi12BusScheduler sdi12Scheduler(sdi12Bus);
+
 #ifdef USE_VEGA_PULS
 // ==========================================================================
 // VEGAPULS C 21 Radar Sensor
@@ -163,10 +256,8 @@ Adafruit_SHT4x sht4 = Adafruit_SHT4x();
 
 // The Vega's Address
 const char VegaPulsSDI12address = '0';
-// The pin of the SDI-12 data bus
-const int8_t VegaPulsData = 3;
-// Define the SDI-12 bus
-SDI12 vegaSDI12(VegaPulsData);
+// The Vega's position in the SDI-12 bus scheduler
+int8_t vegaScheduleNumber = -1;
 #endif
 
 #ifdef USE_METER_HYDROS21
@@ -176,10 +267,8 @@ SDI12 vegaSDI12(VegaPulsData);
 
 // The Hydros 21's Address
 const char hydros21SDI12address = '2';
-// The pin of the SDI-12 data bus
-const int8_t hydros21Data = 3;
-// Define the SDI-12 bus
-SDI12 hydrosSDI12(hydros21Data);
+// The Hydros 21's position in the SDI-12 bus scheduler
+int8_t hydrosScheduleNumber = -1;
 #endif
 
 
@@ -190,6 +279,75 @@ SDI12 hydrosSDI12(hydros21Data);
 // Initialize a buffer for the Cayenne LPP message
 CayenneLPP lpp(128);
 
+// Initialize a buffer for the compact message
+// The compact frame is always built so it can be logged, but it's only sent if
+// USE_COMPACT_PAYLOAD is defined
+compactPayload compact;
+
+// Initialize the record for the binary SD card log, with room for the largest
+// Cayenne LPP frame this program builds
+// The record is always built, but it's only saved if USE_BINARY_LOG is defined
+binaryLogRecord logRecord(64);
+
+// Initialize a fixed buffer to build each line for the SD card in, so the
+// line doesn't take memory from the heap
+// It has to fit the file header as well as the longest line.  With every
+// sensor and option above turned on, the header is 668 characters, and a line
+// with a full 128 byte LPP buffer is a little shorter.
+char            csvBuffer[1024];
+recordFormatter csvOutput(csvBuffer, sizeof(csvBuffer));
+
+// Times each part of every reading
+// The times are always taken, but they're only saved if USE_CYCLE_PROFILE is
+// defined
+cycleProfiler profiler;
+
+
+// ==========================================================================
+// Energy Model
+// ==========================================================================
+
+// The current drawn by each part of the logger, in mA
+// NOTE: These are typical values from the data sheets.  Measure your own
+// hardware if you can, especially the sensors.
+energyModelCurrents siteCurrents = {
+    20.0,   // mcuActive: the Stonefly awake
+    0.2,    // mcuStandby: the Stonefly asleep
+    25.0,   // sensors: the Vega Puls and/or Hydros 21
+    32.0,   // modemAwake: the mDot awake and listening
+    100.0,  // modemTransmit: the mDot sending at full power
+    0.05,   // modemSleep: the mDot asleep
+    50.0,   // sdWrite: the SD card being written
+    0.2,    // sdIdle: the SD card powered but idle
+};
+// The time on air of each message, in milliseconds
+// NOTE: This depends on the data rate; 400 ms is about right for SF9 in US915
+const uint16_t uplinkAirtime = 400;
+// The capacity of the battery, in mAh
+const float batteryCapacity = 4400.0;
+
+// Estimates the charge used by each reading from the profiler's times
+// The estimate is always made, but it's only saved if USE_ENERGY_MODEL is
+// defined
+energyModel energy(siteCurrents, uplinkAirtime, batteryCapacity);
+
+// Decides how often to log, and how often to send, from the battery charge,
+// its recent (dis)charge rate, and the light on the solar panel
+// NOTE: The logging interval above is the shortest used, when there's charge
+// to spare.  As the forecast charge runs low, the interval stretches to 2 and
+// then 4 times as long, and fewer readings are sent.
+energyScheduler scheduler;
+
+#ifdef USE_BATCHED_UPLINKS
+// The number of samples to send in each batch
+const uint8_t batchSamples = 6;
+// The largest frame to send - this must not be more than the maximum payload
+// of the slowest data rate ADR may pick (53 bytes for US915 DR1, 125 for DR2)
+const uint8_t batchMaxSize = 125;
+// Initialize the batch of samples waiting to be sent
+compactBatch uplinkBatch(batchSamples, batchMaxSize);
+#endif
+
 // Initialize a buffer for decoding Cayenne LPP messages
 #if ARDUINOJSON_VERSION_MAJOR < 7
 DynamicJsonDocument jsonBuffer(1024);  // ArduinoJson 6
@@ -214,6 +372,20 @@ JsonDocument jsonBuffer;  // ArduinoJson 7
 // Create a new logger instance
 Logger dataLogger(LoggerID, loggingInterval);
 
+// Frames that could not be sent are kept in a queue on the SD card and sent
+// after the live frame on later cycles.  The queue holds up to 1024 frames -
+// more than a week of readings at a 10 minute interval.
+// Drain the oldest frames first to fill gaps in order, or the newest first to
+// get the recent state of the site to the cloud soonest after an outage.
+UplinkQueue uplinkQueue(dataLogger, "UPLINKQ.BIN", 1024,
+                        UplinkQueue::OLDEST_FIRST);
+// The most queued frames to send in one logging cycle
+const uint8_t queueMaxFramesPerCycle = 4;
+// The most time to spend sending queued frames in one logging cycle, in ms
+// NOTE: Each send holds the modem awake and transmitting; this bounds the
+// airtime and energy spent on backfill so it can't starve the live readings.
+const uint32_t queueMaxMillisPerCycle = 20000L;
+
 
 // ==========================================================================
 // Working Functions
@@ -261,61 +433,195 @@ void sensorPowerOff() {
         digitalWrite(sensorPowerPin, LOW);
     }
 }
-// Uses the processor sensor object to read the battery voltage
-// NOTE: This will actually return the battery level from the previous update!
+// The analog battery voltages, each read once per logging cycle however many
+// times they're asked for
+analogCache mainBattery(75, 4.7);  // A9
+analogCache extraBattery(A0, 5.88);
+
+// The 3.3V battery voltage for this cycle
 float getBatteryVoltage() {
-    // Get the battery voltage
-    // The return value from analogRead() is IN BITS NOT IN VOLTS!!
-    float  sensorValue_battery = -9999;
-    float  _batteryMultiplier  = 4.7;
-    float  _operatingVoltage   = 3.3;
-    int8_t _batteryPin         = 75;  // A9
-    pinMode(_batteryPin, INPUT);
-    if (_batteryPin >= 0 && _batteryMultiplier > 0) {
-        // Get the battery voltage
-        MS_DBG(F("Getting battery voltage from pin"), _batteryPin);
-        pinMode(_batteryPin, INPUT);
-        analogRead(_batteryPin);  // priming reading
-        // The return value from analogRead() is IN BITS NOT IN VOLTS!!
-        analogRead(_batteryPin);  // another priming reading
-        float rawBattery = analogRead(_batteryPin);
-        MS_DBG(F("Raw battery pin reading in bits:"), rawBattery);
-        // convert bits to volts
-        sensorValue_battery =
-            (_operatingVoltage / static_cast<float>(((1 << 12) - 1))) *
-            _batteryMultiplier * rawBattery;
-        MS_DBG(F("Battery in Volts:"), sensorValue_battery);
+    return mainBattery.getVoltage();
+}
+
+// The 12V battery voltage for this cycle
+float readExtraBattery() {
+    return extraBattery.getVoltage();
+}
+
+// The ALS-PT19 voltage, read in a burst once per logging cycle
+analogCache lightSensor(alsData, 1.0, 3.3, -1, alsSamples);
+
+// Converts the ALS-PT19 voltage to lux
+float voltsToLux(float volt_val) {
+    if (volt_val == -9999) { return -9999; }
+    // convert volts to current
+    // resistance is entered in kΩ and we want µA
+    float current_val = (volt_val / (10 * 1000)) * 1e6;
+    // convert current to illuminance
+    // from sensor datasheet, typical 200µA current for 1000 Lux
+    return current_val * (1000. / 200.);
+}
+
+// Reads the light from the ALS-PT19, in lux
+float readLight() {
+    return voltsToLux(lightSensor.getVoltage());
+}
+
+// The light from the last reading, in lux, for the energy scheduler
+float lastLux = -9999;
+
+// The battery from the last reading, for the energy scheduler
+float lastCellPercent    = -9999;
+float lastChargeRate     = -9999;
+float lastBatteryVoltage = -9999;
+
+// Updates the energy scheduler from the battery monitor, or from the battery
+// voltage if there's no battery monitor, and sets the logging interval from it
+// NOTE: The battery is only read here when it's due to be logged; in between,
+// the last reading is used.  Nothing is logged while the battery is critically
+// low, so then it stays due and is read each time to see when it recovers.
+void updateEnergySchedule() {
+    uint32_t now = dataLogger.getNowLocalEpoch();
+    if (batterySchedule.isDue(now) || lastBatteryVoltage == -9999) {
+        if (fuelGaugeFound) {
+            lastCellPercent = max17048.cellPercent();
+            lastChargeRate  = max17048.chargeRate();
+        }
+        lastBatteryVoltage = getBatteryVoltage();
+    }
+    if (fuelGaugeFound) {
+        scheduler.update(lastCellPercent, lastChargeRate, lastLux, now);
     } else {
-        MS_DBG(F("No battery pin specified!"));
+        scheduler.updateFromVoltage(lastBatteryVoltage);
     }
-    return sensorValue_battery;
+    dataLogger.setLoggingInterval(
+        scheduler.getIntervalMinutes(loggingInterval));
 }
 
-float readExtraBattery() {
-    float  _batteryMultiplier  = 5.88;
-    float  _operatingVoltage   = 3.3;
-    int8_t _batteryPin         = A0;
-    float  sensorValue_battery = -9999;
-    if (_batteryPin >= 0 && _batteryMultiplier > 0) {
-        // Get the battery voltage
-        MS_DBG(F("Getting battery voltage from pin"), _batteryPin);
-        pinMode(_batteryPin, INPUT);
-        analogRead(_batteryPin);  // priming reading
-        // The return value from analogRead() is IN BITS NOT IN VOLTS!!
-        analogRead(_batteryPin);  // another priming reading
-        float rawBattery = analogRead(_batteryPin);
-        MS_DBG(F("Raw battery pin reading in bits:"), rawBattery);
-        // convert bits to volts
-        sensorValue_battery =
-            (_operatingVoltage / static_cast<float>(((1 << 12) - 1))) *
-            _batteryMultiplier * rawBattery;
-        MS_DBG(F("Battery in Volts:"), sensorValue_battery);
+// The local day of the last clock sync from the LoRa network
+uint32_t lastClockSyncDay = 0;
+
+// Sends a frame out over LoRa and runs the daily clock sync after the first
+// successful send at or after noon
+// NOTE: The modem must already be awake
+bool sendUplink(uint8_t* buffer, uint8_t size) {
+    energy.addTransmission();
+    bool success = loraStream.write(buffer, size) == size;
+    if (success) {
+        Serial.println(F("  Successfully sent data"));
+        dataLogger.watchDogTimer.resetWatchDog();
+        uint32_t localDay = Logger::markedLocalEpochTime / 86400;
+        if ((Logger::markedLocalEpochTime != 0 &&
+             Logger::markedLocalEpochTime % 86400 >= 43200 &&
+             localDay != lastClockSyncDay) ||
+            !dataLogger.isRTCSane()) {
+            Serial.println(F("Running a daily clock sync..."));
+            // get the epoch time from the LoRa network
+            uint32_t epochTime = ttn_modem.modemGetTime(lora_modem);
+            // set the RTC time from the epoch
+            if (epochTime != 0) {
+                Serial.print(F("Setting RTC epoch to "));
+                Serial.println(epochTime);
+                dataLogger.setNowUTCEpoch(epochTime);
+                lastClockSyncDay = localDay;
+            }
+            dataLogger.watchDogTimer.resetWatchDog();
+        }
+    } else {
+        Serial.println(F("--Failed to send data!"));
+        bool res = lora_modem.isNetworkConnected();
+        Serial.print(F("Network status: "));
+        Serial.println(res ? "connected" : "not connected");
+        dataLogger.watchDogTimer.resetWatchDog();
+        // only join again if the session has been lost
+        if (!res) {
+            ttn_modem.modemReconnect(lora_modem, appEui, appKey);
+            dataLogger.watchDogTimer.resetWatchDog();
+        }
+    }
+
+    while (loraStream.available()) { Serial.write(loraStream.read()); }
+    return success;
+}
+
+// Sends frames waiting in the store-and-forward queue until the queue is
+// empty, a send fails, or the per-cycle budget is used up
+// NOTE: The modem must already be awake
+void drainUplinkQueue() {
+    uint8_t  frame[UPLINK_QUEUE_SLOT_SIZE - 1];
+    uint8_t  numberSent = 0;
+    uint32_t startTime  = millis();
+    while (uplinkQueue.getCount() > 0 &&
+           numberSent < queueMaxFramesPerCycle &&
+           millis() - startTime < queueMaxMillisPerCycle) {
+        dataLogger.watchDogTimer.resetWatchDog();
+        uint8_t size = uplinkQueue.peek(frame, sizeof(frame));
+        if (size == 0) {
+            // drop a frame that can't be read so it doesn't block the rest
+            Serial.println(F("--Unable to read a queued frame, dropping it"));
+            if (!uplinkQueue.pop()) { break; }
+            continue;
+        }
+        Serial.print(F("Sending a queued frame of "));
+        Serial.print(size);
+        Serial.println(F(" bytes:"));
+        printFrameHex(frame, size);
+        if (!sendUplink(frame, size)) { break; }
+        uplinkQueue.pop();
+        numberSent++;
+    }
+    Serial.print(numberSent);
+    Serial.print(F(" queued frames sent, "));
+    Serial.print(uplinkQueue.getCount());
+    Serial.println(F(" still waiting"));
+}
+
+// Sends a frame, adding it to the store-and-forward queue if it can't be sent
+// and backfilling from the queue if it was
+// NOTE: The modem must already be awake
+bool sendOrQueueUplink(uint8_t* buffer, uint8_t size) {
+    if (sendUplink(buffer, size)) {
+        if (uplinkQueue.getCount() > 0) { drainUplinkQueue(); }
+        return true;
+    }
+    if (uplinkQueue.push(buffer, size)) {
+        Serial.print(F("Saved the frame to the uplink queue, "));
+        Serial.print(uplinkQueue.getCount());
+        Serial.println(F(" frames waiting"));
     } else {
-        MS_DBG(F("No battery pin specified!"));
+        Serial.println(F("--Failed to save the frame to the uplink queue!"));
     }
-    return sensorValue_battery;
+    return false;
 }
 
+#ifdef USE_BATCHED_UPLINKS
+// Wakes the modem, sends all of the samples waiting in the batch as one frame,
+// and puts the modem back to sleep
+// NOTE: The batch is emptied even if the send fails; the frame is kept in the
+// uplink queue instead.
+bool sendBatch() {
+    Serial.print(F("Sending a batch of "));
+    Serial.print(uplinkBatch.getNumberSamples());
+    Serial.print(F(" samples in "));
+    Serial.print(uplinkBatch.getSize());
+    Serial.println(F(" bytes:"));
+    printFrameHex(uplinkBatch.getBuffer(), uplinkBatch.getSize());
+    profiler.start(cycleProfiler::MODEM_AWAKE);
+    profiler.start(cycleProfiler::MODEM_WAKE);
+    ttn_modem.modemWake(lora_modem);
+    profiler.stop(cycleProfiler::MODEM_WAKE);
+    dataLogger.watchDogTimer.resetWatchDog();
+    profiler.start(cycleProfiler::UPLINK);
+    bool success = sendOrQueueUplink(uplinkBatch.getBuffer(),
+                                     uplinkBatch.getSize());
+    ttn_modem.modemSleep(lora_modem);
+    profiler.stop(cycleProfiler::UPLINK);
+    profiler.stop(cycleProfiler::MODEM_AWAKE);
+    uplinkBatch.reset();
+    return success;
+}
+#endif
+
 void buttonISR(void) {
     Serial.println(F("\nButton interrupt!"));
     Serial1.println(F("\nButton interrupt!"));
@@ -325,27 +631,36 @@ void buttonISR(void) {
 // Arduino Setup Function
 // ==========================================================================
 void setup() {
-    // Blink the LEDs to show the board is on and starting up
-    greenRedFlash(3, 35);
+    // After a watchdog reset or brown-out, nobody's watching, so skip the
+    // lights and waits that are only there for a person
+    bool fastStart = bootMode.begin();
+
+    if (!fastStart) {
+        // Blink the LEDs to show the board is on and starting up
+        greenRedFlash(3, 35);
 
 // Wait for USB connection to be established by PC
 // NOTE:  Only use this when debugging - if not connected to a PC, this adds an
 // unnecessary startup delay
 #if defined(SERIAL_PORT_USBVIRTUAL)
-    while (!SERIAL_PORT_USBVIRTUAL && (millis() < 10000L));
+        while (!SERIAL_PORT_USBVIRTUAL && (millis() < 10000L));
 #endif
+    }
 
     // Start the primary serial connection
     Serial.begin(serialBaud);
     Serial1.begin(serialBaud);
     delay(10);
-    greenRedFlash(5, 50);
+    if (!fastStart) { greenRedFlash(5, 50); }
 
     // Print a start-up note to the first serial port
     Serial.print(F("\n\nNow running "));
     Serial.print(sketchName);
     Serial.print(F(" on Logger "));
     Serial.println(LoggerID);
+    Serial.print(F("Reset by "));
+    Serial.print(fastBoot::getResetCauseName(bootMode.getResetCause()));
+    Serial.println(fastStart ? F(" - fast start") : F(" - full start"));
     Serial.println();
 
     // Start the serial connection with the modem
@@ -355,13 +670,15 @@ void setup() {
     SerialBee.begin(modemBaud);
 
     // Set up pins for the LED's
-    Serial.println(F("Flashing lights"));
     pinMode(greenLED, OUTPUT);
     digitalWrite(greenLED, LOW);
     pinMode(redLED, OUTPUT);
     digitalWrite(redLED, LOW);
-    // Blink the LEDs to show the board is on and starting up
-    greenRedFlash(5, 100);
+    if (!fastStart) {
+        // Blink the LEDs to show the board is on and starting up
+        Serial.println(F("Flashing lights"));
+        greenRedFlash(5, 100);
+    }
 
     // Start the SPI library
     Serial.println(F("Starting SPI"));
@@ -428,8 +745,17 @@ void setup() {
     // It is STRONGLY RECOMMENDED that you set the RTC to be in UTC (UTC+0)
     Logger::setRTCTimeZone(0);
 
+    // Register the SDI-12 sensors with the bus scheduler
+#ifdef USE_VEGA_PULS
+    vegaScheduleNumber = sdi12Scheduler.addSensor(VegaPulsSDI12address, 4, 0);
+#endif
+#ifdef USE_METER_HYDROS21
+    hydrosScheduleNumber = sdi12Scheduler.addSensor(hydros21SDI12address);
+#endif
+
     // Set up the sensors, except at lowest battery level
-    if (getBatteryVoltage() > 3.4) {
+    bool sensorsSetUp = getBatteryVoltage() > 3.4;
+    if (sensorsSetUp) {
         if (!sht4.begin()) {
             Serial.println(F("Couldn't find SHT4x"));
         } else {
@@ -444,59 +770,61 @@ void setup() {
                 F("Couldn't find Adafruit MAX17048?\nMake sure a battery "
                   "is plugged in!"));
         } else {
+            fuelGaugeFound = true;
             Serial.print(F("Found MAX17048"));
             Serial.print(F(" with Chip ID: 0x"));
             Serial.println(max17048.getChipID(), HEX);
         }
 
 
-        // turn on sensor power
-        sensorPowerOn();
+        // The SDI-12 sensors were already found in the full start that left
+        // the fast start marker, so don't wake them up just to print their
+        // details again
+        if (!fastStart) {
+            // turn on sensor power
+            sensorPowerOn();
 
-#ifdef USE_METER_HYDROS21
-        Serial.print("Opening SDI-12 bus on pin ");
-        Serial.print(String(hydros21Data));
-        Serial.println(" for Vega Puls...");
-        hydrosSDI12.begin();
-        delay(500);  // allow things to settle
+            Serial.print("Opening SDI-12 bus on pin ");
+            Serial.println(sdi12DataPin);
+            sdi12Bus.begin();
+            dataLogger.sleepFor(500);  // allow things to settle
+
+            Serial.print(F("Timeout value for SDI-12 bus: "));
+            Serial.println(sdi12Bus.TIMEOUT);
 
-        Serial.print(F("Timeout value for Hydros21: "));
-        Serial.println(hydrosSDI12.TIMEOUT);
-        Serial.println("Waiting 500ms for Vega Puls to warm up");
-        delay(500);
-        // Print SDI-12 sensor info
-        printInfo(hydrosSDI12, hydros21SDI12address, false);
+#ifdef USE_METER_HYDROS21
+            Serial.println("Waiting 500ms for Hydros21 to warm up");
+            dataLogger.sleepFor(500);
+            // Print SDI-12 sensor info
+            printInfo(sdi12Bus, hydros21SDI12address, false);
 #endif
 
 #ifdef USE_VEGA_PULS
-        Serial.print("Opening SDI-12 bus on pin ");
-        Serial.print(String(VegaPulsData));
-        Serial.println(" for Vega Puls...");
-        vegaSDI12.begin();
-        delay(500);  // allow things to settle
-
-        Serial.print(F("Timeout value for Vega Puls: "));
-        Serial.println(vegaSDI12.TIMEOUT);
-
-        // turn on sensor power to check Vega Puls metadata
-        sensorPowerOn();
-        Serial.println("Waiting 5.2s for Vega Puls to warm up");
-        delay(5200);
-        // Print SDI-12 sensor info
-        printInfo(vegaSDI12, VegaPulsSDI12address, false);
+            Serial.println("Waiting 5.2s for Vega Puls to warm up");
+            dataLogger.sleepFor(5200);
+            // Print SDI-12 sensor info
+            printInfo(sdi12Bus, VegaPulsSDI12address, false);
 #endif
+            sdi12Bus.end();
 
-        // Turn off sensor power
-        sensorPowerOff();
+            // Turn off sensor power
+            sensorPowerOff();
+        }
     }
 
     // Power on, set up, and connect the LoRa modem
-    ttn_modem.modemPowerOn();
-    ttn_modem.setupModemTTN(lora_modem);
-    ttn_modem.modemConnect(lora_modem, appEui, appKey);
+    // On a fast start, the modem keeps the configuration and session it saved
+    // during the full start, so only set it up again if that's been lost
+    ttn_modem.modemPowerOn(lora_modem);
+    if (!fastStart || !ttn_modem.resumeModemTTN(lora_modem)) {
+        ttn_modem.setupModemTTN(lora_modem, appEui, appKey);
+    }
+    bool modemJoined = ttn_modem.modemConnect(lora_modem, appEui, appKey);
 
     // Sync the clock if it isn't valid or we have battery to spare
-    if (getBatteryVoltage() > 3.55 || !dataLogger.isRTCSane()) {
+    // On a fast start, the clock was synced by the full start
+    if ((!fastStart && getBatteryVoltage() > 3.55) ||
+        !dataLogger.isRTCSane()) {
         // get the epoch time from the LoRa network
         uint32_t epochTime = ttn_modem.modemGetTime(lora_modem);
 
@@ -524,46 +852,136 @@ void setup() {
     if (getBatteryVoltage() > 3.4) {
         Serial.println(F("Setting up file on SD card"));
         dataLogger.turnOnSDcard(true);
-        dataLogger.createLogFile();
-        // write a new header to the file
-        String header = "";
-        header += "Time,";
-        header += "Unix Timestamp,";
-        header += "mDOT RSSI,";
-        header += "SHT Temperature,";
-        header += "SHT Humidity,";
+        // set the header to write to each new file
+        csvOutput.reset();
+        csvOutput += "Time,";
+        csvOutput += "Unix Timestamp,";
+        csvOutput += "mDOT RSSI,";
+        csvOutput += "SHT Temperature,";
+        csvOutput += "SHT Humidity,";
+#ifdef USE_VEGA_PULS
+        csvOutput += "VegaPuls Stage,";
+        csvOutput += "VegaPuls Distance,";
+        csvOutput += "VegaPuls Temperature,";
+        csvOutput += "VegaPuls Reliability,";
+        csvOutput += "VegaPuls Error Code,";
+#endif
+#ifdef USE_METER_HYDROS21
+        csvOutput += "Hydro21 Specific Conductance,";
+        csvOutput += "Hydro21 Temperature,";
+        csvOutput += "Hydro21 Depth,";
+#endif
+        csvOutput += "ALS Lux,";
+        csvOutput += "Battery Voltage,";
+        csvOutput += "Battery Percent,";
+        csvOutput += "Battery (Dis)Charge Rate,";
+#ifdef USE_ENERGY_MODEL
+        csvOutput += "Model Previous Cycle Charge (mAh),";
+        csvOutput += "Model Charge Today (mAh),";
+        csvOutput += "Model (Dis)Charge Rate,";
+#endif
+        csvOutput += "Analog Battery Voltage,";
+        csvOutput += "Analog 12V Battery Voltage,";
+#ifdef USE_CYCLE_PROFILE
+        csvOutput += "Previous Cycle Modem Wake (ms),";
+        csvOutput += "Previous Cycle Warm Up (ms),";
+        csvOutput += "Previous Cycle SDI-12 (ms),";
+        csvOutput += "Previous Cycle SD Card (ms),";
+        csvOutput += "Previous Cycle Uplink (ms),";
+        csvOutput += "Previous Cycle Sensor Power (ms),";
+        csvOutput += "Previous Cycle Modem Awake (ms),";
+        csvOutput += "Previous Cycle Awake (ms),";
+#endif
+#ifdef USE_COMPACT_PAYLOAD
+        csvOutput += "Encoded Compact Buffer";
+#else
+        csvOutput += "Encoded LPP Buffer";
+#endif
+        if (csvOutput.isTruncated()) {
+            Serial.println(F("--The file header is too long for csvBuffer, "
+                             "so it's missing columns!"));
+        }
+        Serial.println(csvOutput.c_str());
+        dataLogger.setFileHeader(csvOutput.c_str());
+#ifdef USE_BINARY_LOG
+        // describe the same columns in the binary header
+        logRecord.addChannel("mDOT RSSI", BINARY_LOG_INTEGER);
+        logRecord.addChannel("SHT Temperature", 2);
+        logRecord.addChannel("SHT Humidity", 2);
 #ifdef USE_VEGA_PULS
-        header += "VegaPuls Stage,";
-        header += "VegaPuls Distance,";
-        header += "VegaPuls Temperature,";
-        header += "VegaPuls Reliability,";
-        header += "VegaPuls Error Code,";
+        logRecord.addChannel("VegaPuls Stage", 3);
+        logRecord.addChannel("VegaPuls Distance", 3);
+        logRecord.addChannel("VegaPuls Temperature", 1);
+        logRecord.addChannel("VegaPuls Reliability", 1);
+        logRecord.addChannel("VegaPuls Error Code", 2);
 #endif
 #ifdef USE_METER_HYDROS21
-        header += "Hydro21 Specific Conductance,";
-        header += "Hydro21 Temperature,";
-        header += "Hydro21 Depth,";
-#endif
-        header += "ALS Lux,";
-        header += "Battery Voltage,";
-        header += "Battery Percent,";
-        header += "Battery (Dis)Charge Rate,";
-        header += "Analog Battery Voltage,";
-        header += "Encoded LPP Buffer";
-        Serial.println(F("Writing header to SD card"));
-        Serial.println(header);
-        if (dataLogger.logToSD(header)) {
+        logRecord.addChannel("Hydro21 Specific Conductance", 3);
+        logRecord.addChannel("Hydro21 Temperature", 1);
+        logRecord.addChannel("Hydro21 Depth", 0);
+#endif
+        logRecord.addChannel("ALS Lux", 1);
+        logRecord.addChannel("Battery Voltage", 3);
+        logRecord.addChannel("Battery Percent", 1);
+        logRecord.addChannel("Battery (Dis)Charge Rate", 1);
+#ifdef USE_ENERGY_MODEL
+        logRecord.addChannel("Model Previous Cycle Charge (mAh)", 4);
+        logRecord.addChannel("Model Charge Today (mAh)", 2);
+        logRecord.addChannel("Model (Dis)Charge Rate", 3);
+#endif
+        logRecord.addChannel("Analog Battery Voltage", 3);
+        logRecord.addChannel("Analog 12V Battery Voltage", 3);
+#ifdef USE_CYCLE_PROFILE
+        logRecord.addChannel("Previous Cycle Modem Wake (ms)",
+                             BINARY_LOG_INTEGER);
+        logRecord.addChannel("Previous Cycle Warm Up (ms)", BINARY_LOG_INTEGER);
+        logRecord.addChannel("Previous Cycle SDI-12 (ms)", BINARY_LOG_INTEGER);
+        logRecord.addChannel("Previous Cycle SD Card (ms)", BINARY_LOG_INTEGER);
+        logRecord.addChannel("Previous Cycle Uplink (ms)", BINARY_LOG_INTEGER);
+        logRecord.addChannel("Previous Cycle Sensor Power (ms)",
+                             BINARY_LOG_INTEGER);
+        logRecord.addChannel("Previous Cycle Modem Awake (ms)",
+                             BINARY_LOG_INTEGER);
+        logRecord.addChannel("Previous Cycle Awake (ms)", BINARY_LOG_INTEGER);
+#endif
+#ifdef USE_COMPACT_PAYLOAD
+        logRecord.finishHeader(dataLogger.rtc.getTimeZoneQuarterHours() * 15,
+                               "Encoded Compact Buffer");
+#else
+        logRecord.finishHeader(dataLogger.rtc.getTimeZoneQuarterHours() * 15,
+                               "Encoded LPP Buffer");
+#endif
+        if (logRecord.isTruncated()) {
+            Serial.println(F("--The binary log header is too big, so it's "
+                             "missing columns!  Raise BINARY_LOG_MAX_CHANNELS "
+                             "or BINARY_LOG_MAX_HEADER."));
+        }
+        dataLogger.setBinaryFormat(logRecord.getHeader(),
+                                   logRecord.getHeaderSize(),
+                                   logRecord.getRecordSize());
+#endif
+        dataLogger.setFilePreallocation(sdRecordBytes);
+        if (dataLogger.createLogFile()) {
             Serial.println(F("SD card success"));
         } else {
             Serial.println(F("Failed to write to SD card!"));
         }
+        // Read the state of the uplink queue left from before the restart
+        uplinkQueue.begin();
         dataLogger.turnOffSDcard(true);
         // true = wait for internal housekeeping after write
     }
 
+    // Start buffering lines for the SD card now that the header is written
+    dataLogger.setSDFlushInterval(sdFlushInterval);
+
     pinMode(buttonPin, INPUT_PULLDOWN);
     attachInterrupt(buttonPin, buttonISR, RISING);
 
+    // With the sensors found and the network joined, the next restart after a
+    // watchdog reset or brown-out can be a fast one
+    if (sensorsSetUp && modemJoined) { bootMode.markGood(); }
+
     // Call the processor sleep
     Serial.println(F("Putting processor to sleep\n"));
     dataLogger.systemSleep();
@@ -572,15 +990,45 @@ void setup() {
 void loop() {
     // Reset the watchdog
     dataLogger.watchDogTimer.resetWatchDog();
+    // Read the analog channels fresh this time through
+    mainBattery.expire();
+    extraBattery.expire();
+    lightSensor.expire();
+
+    // Decide how much the battery can afford before checking the time, since
+    // that sets the logging interval
+    updateEnergySchedule();
+    // Sample faster while the stage is changing quickly
+    if (stageWatch.isActive() &&
+        scheduler.getLevel() != energyScheduler::CRITICAL) {
+        dataLogger.setLoggingInterval(eventLoggingInterval);
+    }
 
     // Assuming we were woken up by the clock, check if the current time is an
     // even interval of the logging interval
-    // We're only doing anything at all if the battery is above 3.4V
-    if (dataLogger.checkInterval() && getBatteryVoltage() > 3.4) {
+    // We're only doing anything at all if the battery isn't critically low
+    if (dataLogger.checkInterval() &&
+        scheduler.getLevel() != energyScheduler::CRITICAL) {
         // Flag to notify that we're in already awake and logging a point
         Logger::isLoggingNow = true;
+        profiler.beginCycle();
         dataLogger.watchDogTimer.resetWatchDog();
 
+        Serial.print(F("Energy level: "));
+        Serial.print(energyScheduler::getLevelName(scheduler.getLevel()));
+        Serial.print(F(", logging every "));
+        Serial.print(dataLogger.getLoggingInterval());
+        Serial.print(F(" minutes, "));
+        Serial.print(scheduler.getDaysLeft(), 1);
+        Serial.println(F(" days of charge left"));
+#ifndef USE_BATCHED_UPLINKS
+        // Only some readings are sent when the battery is low; the rest are
+        // only saved to the SD card.  Every reading is sent during an event.
+        bool publishNow = stageWatch.isActive() ||
+            scheduler.shouldPublish(Logger::markedLocalEpochTime,
+                                    loggingInterval);
+#endif
+
         // Print a line to show new reading
         Serial.println(F("------------------------------------------"));
         // Turn on the LED to show we're taking a reading
@@ -589,9 +1037,53 @@ void loop() {
         dataLogger.turnOnSDcard(true);
         dataLogger.watchDogTimer.resetWatchDog();
 
+        // Work out which sensors are due to be read
+        uint32_t readingTime = Logger::markedLocalEpochTime;
+        bool     vegaDue     = false;
+        bool     hydrosDue   = false;
+#ifdef USE_VEGA_PULS
+        vegaDue = stageWatch.isActive() || vegaSchedule.isDue(readingTime);
+        if (vegaDue) { vegaSchedule.markRead(readingTime); }
+        sdi12Scheduler.setEnabled(vegaScheduleNumber, vegaDue);
+#endif
+#ifdef USE_METER_HYDROS21
+        hydrosDue = stageWatch.isActive() || hydrosSchedule.isDue(readingTime);
+        if (hydrosDue) { hydrosSchedule.markRead(readingTime); }
+        sdi12Scheduler.setEnabled(hydrosScheduleNumber, hydrosDue);
+#endif
+        bool sdi12Due     = vegaDue || hydrosDue;
+        bool enclosureDue = enclosureSchedule.isDue(readingTime);
+        bool lightDue     = lightSchedule.isDue(readingTime);
+        bool batteryDue   = batterySchedule.isDue(readingTime);
+        if (enclosureDue) { enclosureSchedule.markRead(readingTime); }
+        if (lightDue) { lightSchedule.markRead(readingTime); }
+        if (batteryDue) { batterySchedule.markRead(readingTime); }
+
+        // Start the slowest part first: power up the SDI-12 sensors, if one of
+        // them is due, so they warm up while the modem wakes and everything
+        // else is read
+        uint32_t warmUp      = 0;
+        uint32_t warmUpStart = millis();
+        if (sdi12Due) {
+            profiler.start(cycleProfiler::SENSOR_POWER);
+            profiler.start(cycleProfiler::WARM_UP);
+            sensorPowerOn();
+            // time for the VegaPuls (or only the Hydros 21) to warm up
+            warmUp      = vegaDue ? 5200L : 500L;
+            warmUpStart = millis();
+        }
+
+#ifndef USE_BATCHED_UPLINKS
         // wake up the modem
-        ttn_modem.modemWake(lora_modem);
-        dataLogger.watchDogTimer.resetWatchDog();
+        // When batching, the modem is only woken when the batch is sent
+        if (publishNow) {
+            profiler.start(cycleProfiler::MODEM_AWAKE);
+            profiler.start(cycleProfiler::MODEM_WAKE);
+            ttn_modem.modemWake(lora_modem);
+            profiler.stop(cycleProfiler::MODEM_WAKE);
+            dataLogger.watchDogTimer.resetWatchDog();
+        }
+#endif
 
         // Confirm the date and time using the ISO 8601 timestamp
         dataLogger.rtc.updateTime();
@@ -599,90 +1091,129 @@ void loop() {
         Serial.println(dataLogger.rtc.stringTime8601TZ());
         dataLogger.watchDogTimer.resetWatchDog();
 
-        sensorPowerOn();
-        // time for the VegaPuls to warm up, kicking the dog while waiting
-        uint32_t start = millis();
-        while (millis() - 5200L < start) {
-            dataLogger.watchDogTimer.resetWatchDog();
-            delay(100L);
+        // Read the quick sensors while the SDI-12 sensors warm up; they're
+        // added to the record in column order once the SDI-12 sensors are in
+#ifdef USE_BATCHED_UPLINKS
+        // The modem is asleep, so there's no signal quality to get
+        int rssi = -9999;
+#else
+        int rssi = publishNow ? lora_modem.getSignalQuality() : -9999;
+#endif
+        sensors_event_t humidity;
+        sensors_event_t temp;
+        if (enclosureDue) {
+            // populate temp and humidity objects with fresh data
+            sht4.getEvent(&humidity, &temp);
+        }
+        float lux_val     = lightDue ? readLight() : -9999;
+        float cellVoltage = -9999;
+        float chargeRate  = -9999;
+        float cellPercent = -9999;
+        float analogBatt  = -9999;
+        float analogBatt2 = -9999;
+        if (batteryDue) {
+            cellVoltage = max17048.cellVoltage();
+            chargeRate  = max17048.chargeRate();
+            cellPercent = max17048.cellPercent();
+            analogBatt  = getBatteryVoltage();
+            analogBatt2 = readExtraBattery();
+            if (fuelGaugeFound) {
+                lastCellPercent = cellPercent;
+                lastChargeRate  = chargeRate;
+            }
+            lastBatteryVoltage = analogBatt;
         }
+        dataLogger.watchDogTimer.resetWatchDog();
 
         // set lpp buffer pointer back to the head of the buffer
         lpp.reset();
+        compact.reset();
+        logRecord.reset();
         // Create a JsonArray object for decoding/debugging
         JsonObject root = jsonBuffer.to<JsonObject>();
 
-        String csvOutput = "";
+        csvOutput.reset();
 
         // get the time from the on-board RTC
         // Add the time to the Cayenne LPP Buffer
         lpp.addUnixTime(1, Logger::markedUTCEpochTime);
+        compact.addValue(1, Logger::markedUTCEpochTime);
         // Add to the CSV
         csvOutput += dataLogger.rtc.stringTime8601TZ();
         csvOutput += ",";
         csvOutput += Logger::markedUTCEpochTime;
+        logRecord.setTime(Logger::markedUTCEpochTime);
         dataLogger.watchDogTimer.resetWatchDog();
 
-        // Get modem signal quality
+        // Add the modem signal quality
         // NOTE: This is trivial, because the quality is added automatically
-        int rssi = lora_modem.getSignalQuality();
         Serial.print(F("Signal quality: "));
         Serial.println(rssi);
         // Add the RSSI to the Cayenne LPP Buffer
         // lpp.addGenericSensor(2, rssi);
+        compact.addValue(2, rssi);
         // Add to the CSV
         csvOutput += ",";
         csvOutput += rssi;
+        logRecord.addValue(rssi);
         dataLogger.watchDogTimer.resetWatchDog();
 
-        // Get temperature and humidity from the SHT40
-        sensors_event_t humidity;
-        sensors_event_t temp;
-        sht4.getEvent(
-            &humidity,
-            &temp);  // populate temp and humidity objects with fresh data
-        Serial.print(F("Temperature: "));
-        Serial.println(temp.temperature, 2);
-        Serial.print(F("Humidity: "));
-        Serial.println(humidity.relative_humidity, 2);
-        // Add the temperature and humidity to the Cayenne LPP Buffer
-        lpp.addTemperature(3, temp.temperature);
-        lpp.addRelativeHumidity(4, humidity.relative_humidity);
-        // Add to the CSV
-        csvOutput += ",";
-        csvOutput += String(temp.temperature, 2);
-        csvOutput += ",";
-        csvOutput += String(humidity.relative_humidity, 2);
+        // Add the temperature and humidity from the SHT40
+        if (enclosureDue) {
+            Serial.print(F("Temperature: "));
+            Serial.println(temp.temperature, 2);
+            Serial.print(F("Humidity: "));
+            Serial.println(humidity.relative_humidity, 2);
+            // Add the temperature and humidity to the Cayenne LPP Buffer
+            lpp.addTemperature(3, temp.temperature);
+            lpp.addRelativeHumidity(4, humidity.relative_humidity);
+            compact.addValue(3, temp.temperature);
+            compact.addValue(4, humidity.relative_humidity);
+            // Add to the CSV
+            csvOutput += ",";
+            csvOutput.addFloat(temp.temperature, 2);
+            csvOutput += ",";
+            csvOutput.addFloat(humidity.relative_humidity, 2);
+            logRecord.addValue(temp.temperature);
+            logRecord.addValue(humidity.relative_humidity);
+        } else {
+            // not due - add empty values to the csv so columns stay aligned
+            csvOutput += ",-9999,-9999";
+            for (uint8_t i = 0; i < 2; i++) { logRecord.addValue(-9999); }
+        }
         dataLogger.watchDogTimer.resetWatchDog();
 
+        // Sleep out whatever's left of the warm-up
+        if (sdi12Due) {
+            uint32_t elapsed = millis() - warmUpStart;
+            if (elapsed < warmUp) {
+                profiler.addSleep(dataLogger.sleepFor(warmUp - elapsed));
+            }
+            profiler.stop(cycleProfiler::WARM_UP);
+        }
 
-#ifdef USE_VEGA_PULS
         // Get SDI-12 Data
-        vegaSDI12.begin();
-        startMeasurementResult startResult = startMeasurement(
-            vegaSDI12, VegaPulsSDI12address, false, true, "", true);
+        // Start concurrent measurements on every sensor on the bus that's
+        // due, then collect the results as each sensor finishes
+        profiler.start(cycleProfiler::SDI12);
+        sdi12Bus.begin();
+        sdi12Scheduler.startAll();
         dataLogger.watchDogTimer.resetWatchDog();
-        if (startResult.numberResults > 0) {
-            uint32_t timerStart = millis();
-            // wait up to 1 second longer than the specified return time
-            while ((millis() - timerStart) <
-                   (static_cast<uint32_t>(startResult.meas_time_s) + 1) *
-                       1000) {
-                if (vegaSDI12.available()) {
-                    break;
-                }  // sensor can interrupt us to let us know it is done
-                   // early
-            }
-            String interrupt_response = vegaSDI12.readStringUntil('\n');
-
-            // array to hold sdi-12 results
-            float sdi12_results[10];
-
-            getResults(vegaSDI12, VegaPulsSDI12address,
-                       startResult.numberResults, sdi12_results, true, true, 4,
-                       0);
-            vegaSDI12.end();
+        while (sdi12Scheduler.collectNext() >= 0) {
             dataLogger.watchDogTimer.resetWatchDog();
+        }
+        sdi12Bus.end();
+        profiler.stop(cycleProfiler::SDI12);
+        // The stage to check for events, in m
+        float stage = -9999;
+
+#ifdef USE_VEGA_PULS
+        sdi12ScheduledSensor& vega =
+            sdi12Scheduler.getSensor(vegaScheduleNumber);
+        if (vega.numberResults > 0) {
+            // array holding the sdi-12 results
+            float* sdi12_results = vega.results;
+            stage                = sdi12_results[0];
             // stage in m (resolution 1mm)
             lpp.addDistance(5, sdi12_results[0]);
             // distance in m (resolution 1mm)
@@ -693,6 +1224,10 @@ void loop() {
             // lpp.addGenericSensor(8, sdi12_results[3]);
             // error code
             // lpp.addGenericSensor(9, sdi12_results[4]);
+            // The compact payload has room for all of them
+            for (uint8_t i = 0; i < 5; i++) {
+                compact.addValue(5 + i, sdi12_results[i]);
+            }
             Serial.print(F("Stage: "));
             Serial.println(sdi12_results[0], 3);
             Serial.print(F("Distance: "));
@@ -705,17 +1240,22 @@ void loop() {
             Serial.println(sdi12_results[4], 2);
             // Add to the CSV
             csvOutput += ",";
-            csvOutput += String(sdi12_results[0], 3);
+            csvOutput.addFloat(sdi12_results[0], 3);
             csvOutput += ",";
-            csvOutput += String(sdi12_results[1], 3);
+            csvOutput.addFloat(sdi12_results[1], 3);
             csvOutput += ",";
-            csvOutput += String(sdi12_results[2], 1);
+            csvOutput.addFloat(sdi12_results[2], 1);
             csvOutput += ",";
-            csvOutput += String(sdi12_results[3], 1);
+            csvOutput.addFloat(sdi12_results[3], 1);
             csvOutput += ",";
             csvOutput += sdi12_results[4];
+            for (uint8_t i = 0; i < 5; i++) {
+                logRecord.addValue(sdi12_results[i]);
+            }
             dataLogger.watchDogTimer.resetWatchDog();
         } else {
+            // mark the values as missing in the compact payload
+            for (uint8_t i = 0; i < 5; i++) { compact.addValue(5 + i, -9999); }
             // if no data, add empty values to the csv so columns stay aligned
             csvOutput += ",";
             csvOutput += "-9999";
@@ -727,36 +1267,20 @@ void loop() {
             csvOutput += "-9999";
             csvOutput += ",";
             csvOutput += "-9999";
+            for (uint8_t i = 0; i < 5; i++) { logRecord.addValue(-9999); }
         }
 #endif
 
 #ifdef USE_METER_HYDROS21
-        // Get SDI-12 Data
-        hydrosSDI12.begin();
-        startMeasurementResult startResult = startMeasurement(
-            hydrosSDI12, hydros21SDI12address, false, true, "", true);
-        dataLogger.watchDogTimer.resetWatchDog();
-        if (startResult.numberResults > 0) {
-            uint32_t timerStart = millis();
-            // wait up to 1 second longer than the specified return time
-            while ((millis() - timerStart) <
-                   (static_cast<uint32_t>(startResult.meas_time_s) + 1) *
-                       1000) {
-                if (hydrosSDI12.available()) {
-                    break;
-                }  // sensor can interrupt us to let us know it is done
-                   // early
-            }
-            String interrupt_response = hydrosSDI12.readStringUntil('\n');
-
-            // array to hold sdi-12 results
-            float sdi12_results[10];
-
-            getResults(hydrosSDI12, hydros21SDI12address,
-                       startResult.numberResults, sdi12_results, true, true, 0,
-                       0);
-            hydrosSDI12.end();
-            dataLogger.watchDogTimer.resetWatchDog();
+        sdi12ScheduledSensor& hydros =
+            sdi12Scheduler.getSensor(hydrosScheduleNumber);
+        if (hydros.numberResults > 0) {
+            // array holding the sdi-12 results
+            float* sdi12_results = hydros.results;
+#ifndef USE_VEGA_PULS
+            // without a Vega Puls, watch the depth instead
+            stage = sdi12_results[0] / 1000;
+#endif
             // distance in m (resolution 1mm)
             // must convert mm to m
             lpp.addDistance(16, sdi12_results[0] / 1000);
@@ -765,6 +1289,9 @@ void loop() {
             // specific conductance in µS/cm
             // Only Supported by CayenneLPP as generic sensor
             lpp.addGenericSensor(14, sdi12_results[2]);
+            compact.addValue(14, sdi12_results[2]);
+            compact.addValue(15, sdi12_results[1]);
+            compact.addValue(16, sdi12_results[0] / 1000);
             Serial.print(F("Water Depth: "));
             Serial.println(sdi12_results[0], 0);
             Serial.print(F("Temperature: "));
@@ -773,13 +1300,20 @@ void loop() {
             Serial.println(sdi12_results[2], 3);
             // Add to the CSV
             csvOutput += ",";
-            csvOutput += String(sdi12_results[2], 3);
+            csvOutput.addFloat(sdi12_results[2], 3);
             csvOutput += ",";
-            csvOutput += String(sdi12_results[1], 1);
+            csvOutput.addFloat(sdi12_results[1], 1);
             csvOutput += ",";
-            csvOutput += String(sdi12_results[0], 0);
+            csvOutput.addFloat(sdi12_results[0], 0);
+            logRecord.addValue(sdi12_results[2]);
+            logRecord.addValue(sdi12_results[1]);
+            logRecord.addValue(sdi12_results[0]);
             dataLogger.watchDogTimer.resetWatchDog();
         } else {
+            // mark the values as missing in the compact payload
+            compact.addValue(14, -9999);
+            compact.addValue(15, -9999);
+            compact.addValue(16, -9999);
             // if no data, add empty values to the csv so columns stay aligned
             csvOutput += ",";
             csvOutput += "-9999";
@@ -787,83 +1321,170 @@ void loop() {
             csvOutput += "-9999";
             csvOutput += ",";
             csvOutput += "-9999";
+            for (uint8_t i = 0; i < 3; i++) { logRecord.addValue(-9999); }
         }
 #endif
 
-        // measure from the als
-        analogReadResolution(12);
-        // First reading will be low - discard
-        analogRead(alsData);
-        // Take the reading we'll keep
-        uint32_t sensor_adc = analogRead(alsData);
-        // convert bits to volts
-        float volt_val = (3.3 / static_cast<float>(((1 << 12) - 1))) *
-            static_cast<float>(sensor_adc);
-        // convert volts to current
-        // resistance is entered in kΩ and we want µA
-        float current_val = (volt_val / (10 * 1000)) * 1e6;
-        // convert current to illuminance
-        // from sensor datasheet, typical 200µA current for 1000 Lux
-        float lux_val = current_val * (1000. / 200.);
-        Serial.print(F("Lux: "));
-        Serial.println(lux_val);
-        // Add to LPP buffer
-        lpp.addLuminosity(10, lux_val);
-        // Add to the CSV
-        csvOutput += ",";
-        csvOutput += String(lux_val, 1);
+        // Check whether the stage is changing quickly
+        if (stageWatch.addReading(stage, Logger::markedUTCEpochTime)) {
+            Serial.print(F("Stage changing at "));
+            Serial.print(stageWatch.getRate(), 3);
+            Serial.println(F(" m/hr - sending every reading"));
+        }
+#ifndef USE_BATCHED_UPLINKS
+        // Send a reading that starts an event right away, waking the modem if
+        // it wasn't going to be sent
+        if (stageWatch.isActive() && !publishNow) {
+            publishNow = true;
+            profiler.start(cycleProfiler::MODEM_AWAKE);
+            profiler.start(cycleProfiler::MODEM_WAKE);
+            ttn_modem.modemWake(lora_modem);
+            profiler.stop(cycleProfiler::MODEM_WAKE);
+        }
+#endif
         dataLogger.watchDogTimer.resetWatchDog();
 
-        // Read the battery monitor
-        float cellVoltage = max17048.cellVoltage();
-        float cellPercent = max17048.cellPercent();
-        float chargeRate  = max17048.chargeRate();
-        Serial.print(F("Batt Voltage: "));
-        Serial.print(cellVoltage, 3);
-        Serial.println(" V");
-        Serial.print(F("Battery Percent: "));
-        Serial.print(cellPercent, 1);
-        Serial.println(" %");
-        Serial.print(F("(Dis)Charge rate: "));
-        Serial.print(chargeRate, 1);
-        Serial.println(" %/hr");
-        // Add to LPP buffer
-        lpp.addVoltage(11, cellVoltage);
-        lpp.addPercentage(12, cellPercent);
-        lpp.addGenericSensor(13, chargeRate);
-        // Add to the CSV
-        csvOutput += ",";
-        csvOutput += String(cellVoltage, 3);
-        csvOutput += ",";
-        csvOutput += String(cellPercent, 1);
-        csvOutput += ",";
-        csvOutput += String(chargeRate, 1);
+        // Add the light from the als
+        if (lightDue) {
+            lastLux = lux_val;
+            Serial.print(F("Lux: "));
+            Serial.print(lux_val);
+            Serial.print(F(" ("));
+            Serial.print(voltsToLux(lightSensor.getMinVoltage()));
+            Serial.print(F(" to "));
+            Serial.print(voltsToLux(lightSensor.getMaxVoltage()));
+            Serial.print(F(", "));
+            Serial.print(lightSensor.getRejectedCount());
+            Serial.println(F(" outliers)"));
+            // Add to LPP buffer
+            lpp.addLuminosity(10, lux_val);
+            compact.addValue(10, lux_val);
+            // Add to the CSV
+            csvOutput += ",";
+            csvOutput.addFloat(lux_val, 1);
+            logRecord.addValue(lux_val);
+        } else {
+            csvOutput += ",-9999";
+            logRecord.addValue(-9999);
+        }
         dataLogger.watchDogTimer.resetWatchDog();
 
-        // Read the real battery voltage monitor
-        float analogBatt = getBatteryVoltage();
-        Serial.print(F("Analog 3.3V Batt Voltage: "));
-        Serial.print(analogBatt, 3);
-        Serial.println(" V");
-        // Add to LPP buffer
-        lpp.addVoltage(14, analogBatt);
-        // Add to the CSV
+        // Add the battery monitor
+        if (batteryDue) {
+            Serial.print(F("Batt Voltage: "));
+            Serial.print(cellVoltage, 3);
+            Serial.println(" V");
+            Serial.print(F("Battery Percent: "));
+            Serial.print(cellPercent, 1);
+            Serial.println(" %");
+            Serial.print(F("(Dis)Charge rate: "));
+            Serial.print(chargeRate, 1);
+            Serial.println(" %/hr");
+            // Add to LPP buffer
+            lpp.addVoltage(11, cellVoltage);
+            lpp.addPercentage(12, cellPercent);
+            lpp.addGenericSensor(13, chargeRate);
+            compact.addValue(11, cellVoltage);
+            compact.addValue(12, cellPercent);
+            compact.addValue(13, chargeRate);
+            // Add to the CSV
+            csvOutput += ",";
+            csvOutput.addFloat(cellVoltage, 3);
+            csvOutput += ",";
+            csvOutput.addFloat(cellPercent, 1);
+            csvOutput += ",";
+            csvOutput.addFloat(chargeRate, 1);
+            logRecord.addValue(cellVoltage);
+            logRecord.addValue(cellPercent);
+            logRecord.addValue(chargeRate);
+        } else {
+            csvOutput += ",-9999,-9999,-9999";
+            for (uint8_t i = 0; i < 3; i++) { logRecord.addValue(-9999); }
+        }
+#ifdef USE_ENERGY_MODEL
+        // Add the estimate of the charge used next to the fuel gauge, so they
+        // can be compared
         csvOutput += ",";
-        csvOutput += String(analogBatt, 3);
+        if (energy.hasLastCycle()) {
+            csvOutput.addFloat(energy.getLastCycleCharge(), 4);
+            csvOutput += ",";
+            csvOutput.addFloat(energy.getChargeToday(), 2);
+            csvOutput += ",";
+            csvOutput.addFloat(energy.getDischargeRate(), 3);
+            logRecord.addValue(energy.getLastCycleCharge());
+            logRecord.addValue(energy.getChargeToday());
+            logRecord.addValue(energy.getDischargeRate());
+        } else {
+            csvOutput += "-9999,-9999,-9999";
+            for (uint8_t i = 0; i < 3; i++) { logRecord.addValue(-9999); }
+        }
+#endif
         dataLogger.watchDogTimer.resetWatchDog();
 
-        // Read the real battery voltage monitor
-        float analogBatt2 = readExtraBattery();
-        Serial.print(F("Analog 12V Batt Voltage: "));
-        Serial.print(analogBatt2, 3);
-        Serial.println(" V");
-        // Add to LPP buffer
-        lpp.addVoltage(15, analogBatt2);
-        // Add to the CSV
-        csvOutput += ",";
-        csvOutput += String(analogBatt2, 3);
+        if (batteryDue) {
+            // Add the real battery voltage monitor
+            Serial.print(F("Analog 3.3V Batt Voltage: "));
+            Serial.print(analogBatt, 3);
+            Serial.print(F(" V, read "));
+            Serial.print(mainBattery.getAgeMillis());
+            Serial.println(F(" ms ago"));
+            // Add to LPP buffer
+            lpp.addVoltage(14, analogBatt);
+            compact.addValue(17, analogBatt);
+            // Add to the CSV
+            csvOutput += ",";
+            csvOutput.addFloat(analogBatt, 3);
+            logRecord.addValue(analogBatt);
+            dataLogger.watchDogTimer.resetWatchDog();
+
+            // Add the real battery voltage monitor
+            Serial.print(F("Analog 12V Batt Voltage: "));
+            Serial.print(analogBatt2, 3);
+            Serial.print(F(" V, read "));
+            Serial.print(extraBattery.getAgeMillis());
+            Serial.println(F(" ms ago"));
+            // Add to LPP buffer
+            lpp.addVoltage(15, analogBatt2);
+            compact.addValue(18, analogBatt2);
+            // Add to the CSV
+            csvOutput += ",";
+            csvOutput.addFloat(analogBatt2, 3);
+            logRecord.addValue(analogBatt2);
+        } else {
+            csvOutput += ",-9999,-9999";
+            for (uint8_t i = 0; i < 2; i++) { logRecord.addValue(-9999); }
+        }
         dataLogger.watchDogTimer.resetWatchDog();
 
+#ifdef USE_CYCLE_PROFILE
+        // Add how long each part of the previous reading took
+        // The times of this reading aren't known until it's finished
+        for (uint8_t i = 0; i < CYCLE_PROFILE_NUM_PHASES; i++) {
+            cycleProfiler::phase which = static_cast<cycleProfiler::phase>(i);
+            csvOutput += ",";
+            if (profiler.hasLastCycle()) {
+                csvOutput += profiler.getLastPhaseMillis(which);
+                logRecord.addValue(profiler.getLastPhaseMillis(which));
+            } else {
+                csvOutput += "-9999";
+                logRecord.addValue(-9999);
+            }
+        }
+        csvOutput += ",";
+        if (profiler.hasLastCycle()) {
+            csvOutput += profiler.getLastAwakeMillis();
+            logRecord.addValue(profiler.getLastAwakeMillis());
+        } else {
+            csvOutput += "-9999";
+            logRecord.addValue(-9999);
+        }
+#endif
+#ifdef USE_CYCLE_PROFILE_UPLINK
+        if (profiler.hasLastCycle()) {
+            compact.addValue(19, profiler.getLastAwakeMillis() / 1000.0);
+        }
+#endif
+
         // decode and print the Cayenne LPP buffer we just created
         Serial.println("Cayenne LPP Buffer:");
         printFrameHex(lpp.getBuffer(), lpp.getSize());
@@ -871,67 +1492,149 @@ void loop() {
         lpp.decodeTTN(lpp.getBuffer(), lpp.getSize(), root);
         serializeJsonPretty(root, Serial);
         Serial.println();
+        Serial.println("Compact Buffer:");
+        printFrameHex(compact.getBuffer(), compact.getSize());
+#ifdef USE_COMPACT_PAYLOAD
+        uint8_t* uplinkBuffer = compact.getBuffer();
+        uint8_t  uplinkSize   = compact.getSize();
+#else
+        uint8_t* uplinkBuffer = lpp.getBuffer();
+        uint8_t  uplinkSize   = lpp.getSize();
+#endif
         csvOutput += ",";
-        for (int i = 0; i < lpp.getSize(); i++) {
-            if (lpp.getBuffer()[i] < 16) { csvOutput += "0"; }
-            csvOutput += String(lpp.getBuffer()[i], HEX);
+        for (int i = 0; i < uplinkSize; i++) {
+            if (uplinkBuffer[i] < 16) { csvOutput += "0"; }
+            csvOutput.addHex(uplinkBuffer[i]);
         }
+        logRecord.setFrame(uplinkBuffer, uplinkSize);
         dataLogger.watchDogTimer.resetWatchDog();
 
         // turn off the sensors since we have all data
-        sensorPowerOff();
+        if (sdi12Due) {
+            sensorPowerOff();
+            profiler.stop(cycleProfiler::SENSOR_POWER);
+        }
 
         // Save data to the SD Card
 
         Serial.println(F("Writing line to SD card"));
-        Serial.println(csvOutput);
-        if (dataLogger.logToSD(csvOutput)) {
+        if (csvOutput.isTruncated()) {
+            Serial.println(F("--The line is too long for csvBuffer, so it's "
+                             "missing columns!"));
+        }
+        Serial.println(csvOutput.c_str());
+        profiler.start(cycleProfiler::SD_CARD);
+#ifdef USE_BINARY_LOG
+        if (logRecord.isTruncated()) {
+            Serial.println(F("--The binary record is missing values!"));
+        }
+        bool logged = dataLogger.logToSD(logRecord.getRecord());
+#else
+        bool logged = dataLogger.logToSD(csvOutput.c_str());
+#endif
+        profiler.stop(cycleProfiler::SD_CARD);
+        if (logged) {
             Serial.println(F("SD card success"));
         } else {
-            Serial.println(F("Failed to write to SD card!"));
+            Serial.print(F("Failed to write to SD card! Lines dropped: "));
+            Serial.println(dataLogger.getSDLinesDropped());
         }
-        // Cut power from the SD card
-        dataLogger.turnOffSDcard(true);
         dataLogger.watchDogTimer.resetWatchDog();
 
 
-        // Send out the Cayenne LPP buffer
-        if (loraStream.write(lpp.getBuffer(), lpp.getSize()) == lpp.getSize()) {
-            Serial.println(F("  Successfully sent data"));
-            dataLogger.watchDogTimer.resetWatchDog();
-            if ((Logger::markedLocalEpochTime != 0 &&
-                 Logger::markedLocalEpochTime % 86400 == 43200) ||
-                !dataLogger.isRTCSane()) {
-                Serial.println(F("Running a daily clock sync..."));
-                // get the epoch time from the LoRa network
-                uint32_t epochTime = ttn_modem.modemGetTime(lora_modem);
-                // set the RTC time from the epoch
-                if (epochTime != 0) {
-                    Serial.print(F("Setting RTC epoch to "));
-                    Serial.println(epochTime);
-                    dataLogger.setNowUTCEpoch(epochTime);
-                }
-                dataLogger.watchDogTimer.resetWatchDog();
+#ifdef USE_BATCHED_UPLINKS
+        // Hold more samples in each batch when the battery is low, so the modem
+        // is woken less often
+        uint16_t maxSamples = static_cast<uint16_t>(batchSamples) *
+            scheduler.getReadingsPerMessage();
+        uplinkBatch.setMaxSamples(maxSamples > COMPACT_BATCH_MAX_SAMPLES
+                                      ? COMPACT_BATCH_MAX_SAMPLES
+                                      : maxSamples);
+        // Hold the sample in the batch, sending the batch first if the sample
+        // won't fit in it
+        if (!uplinkBatch.addSample(compact)) {
+            if (uplinkBatch.getNumberSamples() > 0) { sendBatch(); }
+            if (!uplinkBatch.addSample(compact)) {
+                // a single sample is too big for the batch - send it alone
+                profiler.start(cycleProfiler::MODEM_AWAKE);
+                profiler.start(cycleProfiler::MODEM_WAKE);
+                ttn_modem.modemWake(lora_modem);
+                profiler.stop(cycleProfiler::MODEM_WAKE);
+                profiler.start(cycleProfiler::UPLINK);
+                sendOrQueueUplink(compact.getBuffer(), compact.getSize());
+                ttn_modem.modemSleep(lora_modem);
+                profiler.stop(cycleProfiler::UPLINK);
+                profiler.stop(cycleProfiler::MODEM_AWAKE);
             }
+        }
+        Serial.print(uplinkBatch.getNumberSamples());
+        Serial.print(F(" of "));
+        Serial.print(uplinkBatch.getMaxSamples());
+        Serial.println(F(" samples waiting in the uplink batch"));
+        // During an event, send the batch with every reading
+        if (uplinkBatch.isFull() ||
+            (stageWatch.isActive() && uplinkBatch.getNumberSamples() > 0)) {
+            sendBatch();
+        }
+#else
+        if (publishNow) {
+            // Send out the Cayenne LPP or compact buffer
+            profiler.start(cycleProfiler::UPLINK);
+            sendOrQueueUplink(uplinkBuffer, uplinkSize);
+
+            // put the modem to sleep
+            ttn_modem.modemSleep(lora_modem);
+            profiler.stop(cycleProfiler::UPLINK);
+            profiler.stop(cycleProfiler::MODEM_AWAKE);
         } else {
-            Serial.println(F("--Failed to send data!"));
-            bool res = lora_modem.isNetworkConnected();
-            Serial.print(F("Network status: "));
-            Serial.println(res ? "connected" : "not connected");
-            dataLogger.watchDogTimer.resetWatchDog();
+            Serial.println(F("Saving power - this reading is not being sent"));
         }
+#endif
 
-        while (loraStream.available()) { Serial.write(loraStream.read()); }
-
-        // put the modem to sleep
-        ttn_modem.modemSleep(lora_modem);
+        // Cut power from the SD card now that the uplink queue is done with it
+        dataLogger.turnOffSDcard(true);
+        dataLogger.watchDogTimer.resetWatchDog();
 
         // Turn off the LED
         dataLogger.alertOff();
+        // Print how long each part of the reading took
+        profiler.endCycle();
+        for (uint8_t i = 0; i < CYCLE_PROFILE_NUM_PHASES; i++) {
+            cycleProfiler::phase which = static_cast<cycleProfiler::phase>(i);
+            Serial.print(cycleProfiler::getPhaseName(which));
+            Serial.print(F(": "));
+            Serial.print(profiler.getLastPhaseMillis(which));
+            Serial.println(F(" ms"));
+        }
+        Serial.print(F("Awake: "));
+        Serial.print(profiler.getLastAwakeMillis());
+        Serial.println(F(" ms"));
+        // Estimate the charge used, counting the sleep until the next reading
+        energy.endCycle(profiler, dataLogger.getLoggingInterval() * 60L,
+                        Logger::markedLocalEpochTime);
+        Serial.print(F("Estimated charge used: "));
+        Serial.print(energy.getLastCycleCharge(), 4);
+        Serial.print(F(" mAh, "));
+        Serial.print(energy.getChargeToday(), 2);
+        Serial.println(F(" mAh today"));
+        if (cellPercent != -9999) {
+            Serial.print(F("Estimated days left at this rate: "));
+            Serial.println(energy.getDaysLeft(cellPercent), 1);
+        }
         // Print a line to show reading ended
         Serial.println(F("------------------------------------------\n"));
     }
 
+    // Write out any buffered lines before sleeping on a low battery, since the
+    // battery may not last until the buffer fills
+    if (dataLogger.getSDBufferUsed() > 0 &&
+        scheduler.getLevel() == energyScheduler::CRITICAL) {
+        Serial.println(F("Battery is low, writing buffered lines to SD card"));
+        dataLogger.turnOnSDcard(true);
+        dataLogger.flushSDBuffer();
+        dataLogger.turnOffSDcard(true);
+    }
+
     // Call the processor sleep
     dataLogger.systemSleep();
 }
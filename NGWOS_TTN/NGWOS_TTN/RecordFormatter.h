@@ -0,0 +1,196 @@
+// Header Guards
+#ifndef RECORD_FORMATTER_H_
+#define RECORD_FORMATTER_H_
+
+#include <Arduino.h>
+#include <math.h>
+
+/**
+ * @brief Builds a line of text in a fixed buffer, without using the heap.
+ *
+ * The output matches what String concatenation would give byte-for-byte:
+ * floats are formatted like String(value, decimals), which pads the number to
+ * at least decimals + 2 characters with leading spaces, and rounds the exact
+ * value of the float with ties going to the even digit.  The rounding is done
+ * in fixed point by scaling the float by a power of ten, which is exact in a
+ * double for any float and up to 8 decimal places.
+ *
+ * Text that doesn't fit in the buffer is cut off; check isTruncated().
+ */
+class recordFormatter {
+ public:
+    /**
+     * @param buffer The buffer to build the line in - it's reused for every
+     * line
+     * @param size The size of the buffer, including the terminating null
+     */
+    recordFormatter(char* buffer, size_t size)
+        : _buffer(buffer), _size(size) {
+        reset();
+    }
+    ~recordFormatter() {}
+
+    // Empties the line
+    void reset() {
+        _length    = 0;
+        _truncated = false;
+        _buffer[0] = '\0';
+    }
+
+    recordFormatter& operator+=(const char* text) {
+        while (*text) { append(*text++); }
+        return *this;
+    }
+    recordFormatter& operator+=(char c) {
+        append(c);
+        return *this;
+    }
+    recordFormatter& operator+=(int value) {
+        addInteger(value);
+        return *this;
+    }
+    recordFormatter& operator+=(long value) {
+        addInteger(value);
+        return *this;
+    }
+    recordFormatter& operator+=(unsigned int value) {
+        addUnsigned(value);
+        return *this;
+    }
+    recordFormatter& operator+=(unsigned long value) {
+        addUnsigned(value);
+        return *this;
+    }
+    // Like String(float), floats get two decimal places
+    recordFormatter& operator+=(float value) {
+        addFloat(value, 2);
+        return *this;
+    }
+
+    // Adds a signed whole number
+    void addInteger(int32_t value) {
+        if (value < 0) {
+            append('-');
+            // negate as unsigned so the most negative value doesn't overflow
+            uint32_t magnitude = 0 - static_cast<uint32_t>(value);
+            addUnsigned(magnitude);
+        } else {
+            addUnsigned(value);
+        }
+    }
+
+    // Adds an unsigned whole number
+    void addUnsigned(uint64_t value) {
+        char    digits[20];
+        uint8_t n = 0;
+        do {
+            digits[n++] = '0' + (value % 10);
+            value /= 10;
+        } while (value > 0);
+        while (n > 0) { append(digits[--n]); }
+    }
+
+    // Adds a byte as hex, like String(value, HEX) - lower case and without a
+    // leading zero
+    void addHex(uint8_t value) {
+        static const char hex_digits[] = "0123456789abcdef";
+        if (value >= 16) { append(hex_digits[value >> 4]); }
+        append(hex_digits[value & 0x0F]);
+    }
+
+    /**
+     * @brief Adds a float like String(value, decimals).
+     *
+     * @param value The value to add
+     * @param decimals The number of decimal places, up to 8
+     */
+    void addFloat(float value, uint8_t decimals) {
+        if (decimals > 8) { decimals = 8; }
+        uint8_t width = decimals + 2;
+
+        if (isnan(value) || isinf(value)) {
+            const char* text = isnan(value) ? "nan"
+                : value < 0                 ? "-inf"
+                                            : "inf";
+            pad(strlen(text), width);
+            *this += text;
+            return;
+        }
+
+        bool   negative = signbit(value);
+        double scaled   = fabs(static_cast<double>(value)) *
+            powerOfTen(decimals);
+        // Too big for fixed point - this won't be seen from any real sensor
+        if (scaled >= 1e18) {
+            // the biggest float has 39 digits, plus the sign, point, and
+            // up to 8 decimals
+            char text[52];
+            snprintf(text, sizeof(text), "%*.*f", width, decimals, value);
+            *this += text;
+            return;
+        }
+
+        // Round to the nearest whole number, with ties to even like printf
+        uint64_t whole    = static_cast<uint64_t>(scaled);
+        double   fraction = scaled - static_cast<double>(whole);
+        if (fraction > 0.5 || (fraction == 0.5 && (whole & 1))) { whole++; }
+
+        uint64_t divisor  = static_cast<uint64_t>(powerOfTen(decimals));
+        uint64_t integer  = whole / divisor;
+        uint64_t decimal  = whole % divisor;
+        uint8_t  int_size = 1;
+        for (uint64_t i = integer; i >= 10; i /= 10) { int_size++; }
+        pad(negative + int_size + (decimals > 0 ? decimals + 1 : 0), width);
+
+        if (negative) { append('-'); }
+        addUnsigned(integer);
+        if (decimals > 0) {
+            append('.');
+            // print the decimal part with its leading zeros
+            for (uint64_t d = divisor / 10; d > 0; d /= 10) {
+                append('0' + (decimal / d) % 10);
+            }
+        }
+    }
+
+    const char* c_str() const {
+        return _buffer;
+    }
+
+    size_t length() const {
+        return _length;
+    }
+
+    // Whether any text was cut off because the buffer was full
+    bool isTruncated() const {
+        return _truncated;
+    }
+
+ protected:
+    void append(char c) {
+        if (_length + 1 >= _size) {
+            _truncated = true;
+            return;
+        }
+        _buffer[_length++] = c;
+        _buffer[_length]   = '\0';
+    }
+
+    // Adds spaces in front of text to make it at least the given width
+    void pad(uint8_t text_length, uint8_t width) {
+        for (uint8_t i = text_length; i < width; i++) { append(' '); }
+    }
+
+    static double powerOfTen(uint8_t exponent) {
+        double result = 1;
+        while (exponent--) { result *= 10; }
+        return result;
+    }
+
+    char*  _buffer;
+    size_t _size;
+    size_t _length;
+    bool   _truncated;
+};
+
+#endif
@@ -0,0 +1,230 @@
+// Header Guards
+#ifndef SDI_12_BUS_SCHEDULER_H_
+#define SDI_12_BUS_SCHEDULER_H_
+
+#include <Arduino.h>
+#include "SDI12Master.h"
+
+// The most sensors that can be registered on a single bus
+#ifndef SDI12_SCHEDULER_MAX_SENSORS
+#define SDI12_SCHEDULER_MAX_SENSORS 4
+#endif
+
+struct sdi12ScheduledSensor {  // Structure declaration
+    char             address;
+    int8_t           errorResultNumber;
+    float            noErrorValue;
+    uint8_t          numberResults;
+    uint8_t          meas_time_s;
+    uint32_t         startedAt;   // millis() when the sensor acknowledged
+    uint32_t         readyAt;     // millis() when the results should be ready
+    uint32_t         finishedAt;  // millis() when the wait for results ended
+    sdi12WaitResult  waitResult;
+    bool             enabled;  // whether to measure it in the next round
+    bool             started;
+    bool             collected;
+    getResultsResult result;
+    float            results[10];
+};
+
+/**
+ * @brief Runs concurrent measurements on every enabled sensor registered on a
+ * single SDI-12 bus.
+ *
+ * All of the sensors are sent a concurrent measurement command (aC! or aCC!)
+ * back-to-back, then their data is collected with aDn! commands in the order
+ * their measurements finish.  The time spent waiting for the whole bus is the
+ * longest single measurement time rather than the sum of all of them.
+ *
+ * When only one sensor is measured in a round there's nothing to overlap, so
+ * it's started with a standard measurement (aM! or aMC!) instead.  A sensor
+ * sends a service request as soon as a standard measurement is done, so the
+ * wait ends then rather than at the measurement time the sensor gave.
+ * Concurrent measurements never send a service request, so with more than one
+ * sensor the wait for each always runs to its deadline.
+ *
+ * A data page with a bad address or CRC is re-requested up to page_retries
+ * times per sensor per measurement before giving up on that sensor.
+ */
+class sdi12BusScheduler {
+ public:
+    sdi12BusScheduler(SDI12_BUS_CLASS& bus, bool request_crc = true,
+                      bool is_concurrent = true, bool printCommands = true,
+                      uint8_t page_retries = 2)
+        : _bus(bus),
+          _request_crc(request_crc),
+          _is_concurrent(is_concurrent),
+          _roundConcurrent(is_concurrent),
+          _printCommands(printCommands),
+          _page_retries(page_retries),
+          _numberSensors(0),
+          _nextToStart(0) {}
+    ~sdi12BusScheduler() {}
+
+    /**
+     * @brief Add a sensor to the bus.
+     *
+     * @param address The SDI-12 address of the sensor
+     * @param error_result_number The 1-based result number holding an error
+     * code, or 0 if the sensor does not return one
+     * @param no_error_value The value of the error code when there is no error
+     * @return The index of the sensor in the scheduler, or -1 if the scheduler
+     * is full
+     */
+    int8_t addSensor(char address, int8_t error_result_number = 0,
+                     float no_error_value = 0) {
+        if (_numberSensors >= SDI12_SCHEDULER_MAX_SENSORS) { return -1; }
+        sdi12ScheduledSensor& sensor = _sensors[_numberSensors];
+        sensor.address               = address;
+        sensor.errorResultNumber     = error_result_number;
+        sensor.noErrorValue          = no_error_value;
+        sensor.enabled               = true;
+        resetSensor(sensor);
+        return _numberSensors++;
+    }
+
+    sdi12ScheduledSensor& getSensor(uint8_t index) {
+        return _sensors[index];
+    }
+
+    uint8_t getNumberSensors() {
+        return _numberSensors;
+    }
+
+    /**
+     * @brief Choose whether a sensor is measured by startAll().  A sensor
+     * that isn't is left with no results.
+     *
+     * @param index The index of the sensor in the scheduler
+     * @param enabled True to measure the sensor
+     */
+    void setEnabled(int8_t index, bool enabled) {
+        if (index < 0 || index >= _numberSensors) { return; }
+        _sensors[index].enabled = enabled;
+    }
+
+    /**
+     * @brief Start a measurement on every enabled sensor.
+     *
+     * Standard (aM!) measurements can't overlap on the bus, so when not using
+     * concurrent measurements only the first sensor is started here and each
+     * of the others is started as the one before it is collected.  A single
+     * enabled sensor always gets a standard measurement.
+     *
+     * @return The number of sensors that acknowledged the measurement command
+     * and will return results
+     */
+    uint8_t startAll() {
+        uint8_t numberEnabled = 0;
+        for (uint8_t i = 0; i < _numberSensors; i++) {
+            resetSensor(_sensors[i]);
+            if (_sensors[i].enabled) { numberEnabled++; }
+        }
+        _roundConcurrent = _is_concurrent && numberEnabled > 1;
+        _nextToStart     = 0;
+        return startNext();
+    }
+
+    /**
+     * @brief Wait for the next sensor to finish its measurement and get its
+     * results.
+     *
+     * @return The index of the sensor whose results were collected, or -1 if
+     * there are no more sensors waiting to be collected
+     */
+    int8_t collectNext() {
+        int8_t next = nextToCollect();
+        if (next < 0 && startNext() > 0) { next = nextToCollect(); }
+        if (next < 0) { return -1; }
+
+        sdi12ScheduledSensor& sensor = _sensors[next];
+        // Sleep until the sensor is ready - only standard measurements send
+        // service requests
+        sensor.waitResult = waitForMeasurement(
+            _bus, sensor.address, sensor.readyAt, !_roundConcurrent);
+        sensor.finishedAt = millis();
+        if (_printCommands) {
+            Serial.print("Sensor ");
+            Serial.print(sensor.address);
+            Serial.print(" wait ended by ");
+            Serial.print(sdi12WaitResultName(sensor.waitResult));
+            Serial.print(" after ");
+            Serial.print(sensor.finishedAt - sensor.startedAt);
+            Serial.print(" ms of an expected ");
+            Serial.print(static_cast<uint32_t>(sensor.meas_time_s) * 1000);
+            Serial.println(" ms");
+        }
+        sensor.result = getResults(_bus, sensor.address, sensor.numberResults,
+                                   sensor.results, _request_crc,
+                                   _printCommands, sensor.errorResultNumber,
+                                   sensor.noErrorValue, _page_retries);
+        sensor.collected = true;
+        return next;
+    }
+
+ protected:
+    // Starts measurements on the sensors not yet started - all of them for
+    // concurrent measurements or only up to the next one that acknowledges
+    // for standard measurements.
+    uint8_t startNext() {
+        uint8_t numberStarted = 0;
+        while (_nextToStart < _numberSensors) {
+            sdi12ScheduledSensor& sensor = _sensors[_nextToStart++];
+            if (!sensor.enabled) { continue; }
+            startMeasurementResult startResult = startMeasurement(
+                _bus, sensor.address, _roundConcurrent, _request_crc, "",
+                _printCommands);
+            sensor.startedAt     = millis();
+            sensor.numberResults = startResult.numberResults;
+            sensor.meas_time_s   = startResult.meas_time_s;
+            sensor.readyAt       = sensor.startedAt +
+                static_cast<uint32_t>(startResult.meas_time_s) * 1000;
+            if (sensor.numberResults > 0) {
+                sensor.started = true;
+                numberStarted++;
+                if (!_roundConcurrent) { break; }
+            }
+        }
+        return numberStarted;
+    }
+
+    // Finds the started sensor that will be ready soonest
+    int8_t nextToCollect() {
+        int8_t next = -1;
+        for (uint8_t i = 0; i < _numberSensors; i++) {
+            sdi12ScheduledSensor& sensor = _sensors[i];
+            if (!sensor.started || sensor.collected) { continue; }
+            if (next < 0 ||
+                static_cast<int32_t>(sensor.readyAt - _sensors[next].readyAt) <
+                    0) {
+                next = i;
+            }
+        }
+        return next;
+    }
+
+    void resetSensor(sdi12ScheduledSensor& sensor) {
+        sensor.numberResults = 0;
+        sensor.meas_time_s   = 0;
+        sensor.startedAt     = 0;
+        sensor.readyAt       = 0;
+        sensor.finishedAt    = 0;
+        sensor.waitResult    = SDI12_WAIT_DEADLINE;
+        sensor.started       = false;
+        sensor.collected     = false;
+        sensor.result        = getResultsResult();
+        for (uint8_t j = 0; j < 10; j++) { sensor.results[j] = -9999; }
+    }
+
+    SDI12_BUS_CLASS&     _bus;
+    bool                 _request_crc;
+    bool                 _is_concurrent;
+    bool                 _roundConcurrent;  // concurrent in this round
+    bool                 _printCommands;
+    uint8_t              _page_retries;
+    uint8_t              _numberSensors;
+    uint8_t              _nextToStart;
+    sdi12ScheduledSensor _sensors[SDI12_SCHEDULER_MAX_SENSORS];
+};
+
+#endif
@@ -3,12 +3,21 @@
 #define SDI_12_MASTER_H_
 
 #include <Arduino.h>
+
+// The class used to talk to the bus.  Any class with the same stream interface
+// as the SDI-12 library (sendCommand, clearBuffer, available, read,
+// readBytesUntil and readStringUntil) can be used instead by defining
+// SDI12_BUS_CLASS before including this file - ie, the simulated bus in
+// Tools/host/SDI12Sim.h for running these functions on a computer.
+#ifndef SDI12_BUS_CLASS
+#define SDI12_BUS_CLASS SDI12
 // The SDI-12 library for the Vega Puls
 #ifdef SDI12_EXTERNAL_PCINT
 #include <SDI12.h>
 #else
 #include <SDI12_ExtInts.h>
 #endif
+#endif
 
 
 // Extra time needed for the sensor to wake (0-100ms)
@@ -21,32 +30,231 @@ struct startMeasurementResult {  // Structure declaration
 };
 
 struct getResultsResult {  // Structure declaration
-    uint8_t resultsReceived;
-    uint8_t maxDataCommand;
-    bool    addressMatch;
+    uint8_t  resultsReceived;
+    uint8_t  maxDataCommand;
+    bool     addressMatch;
+    bool     crcMatch;
+    bool     valuesValid;  // false if a value had too many digits to keep
+    bool     errorCode;
+    bool     success;
+    uint16_t retriedPages;  // bit n is set if aDn! had to be re-sent
+    uint8_t  retries;       // the total number of data commands re-sent
+};
+
+// The maximum number of characters that can be returned in the <values> part
+// of the response to a D command is either 35 or 75. If the D command is issued
+// to retrieve data in response to a concurrent measurement command, or in
+// response to a high-volume ASCII measurement command, the maximum is 75. The
+// maximum is also 75 in response to a continuous measurement command.
+// Otherwise, the maximum is 35.
+// Add one for the address, three for the CRC, two for the <CR><LF> and one for
+// a terminating null.
+#define SDI12_MAX_RESPONSE 82
+
+// The maximum number of values that can fit into a single response to a D
+// command - each value is at least a sign and a digit
+#define SDI12_MAX_VALUES_PER_RESPONSE 38
+
+// The maximum number of digits we will keep for a single value.  The SDI-12
+// standard allows at most 7; 9 is the most that always fits in a uint32_t.
+// Leading zeros before the decimal place aren't counted.  A response with a
+// longer value is rejected rather than cut short, which would be off by a
+// power of ten.
+#define SDI12_MAX_VALUE_DIGITS 9
+
+// A single value from the <values> field of an SDI-12 response, split into
+// its sign, all of its digits as one integer, and the number of those digits
+// that came after the decimal place.  "-12.345" is {true, 12345, 3}.
+struct sdi12Value {  // Structure declaration
+    bool     negative;
+    uint32_t digits;
+    uint8_t  decimalPlaces;
+};
+
+struct sdi12ParsedResponse {  // Structure declaration
+    char    address;
+    uint8_t numberValues;
     bool    crcMatch;
-    bool    errorCode;
-    bool    success;
+    bool    valuesValid;  // false if a value had too many digits to keep
 };
 
-getResultsResult getResults(SDI12& _SDI12Internal, char address,
+// Powers of ten for converting the integer digits of a value into a float
+// without going through atof
+const float sdi12PowersOfTen[SDI12_MAX_VALUE_DIGITS + 1] = {
+    1.0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f};
+
+float sdi12ValueToFloat(const sdi12Value& value) {
+    float result = static_cast<float>(value.digits) /
+        sdi12PowersOfTen[value.decimalPlaces];
+    return value.negative ? -result : result;
+}
+
+// Adds a single character into a running SDI-12 CRC-16 (polynomial 0xA001,
+// initial value 0), per section 4.4.12.1 of the SDI-12 specification
+uint16_t sdi12UpdateCRC(uint16_t crc, char c) {
+    crc ^= static_cast<uint8_t>(c);
+    for (uint8_t bit = 0; bit < 8; bit++) {
+        if (crc & 0x0001) {
+            crc >>= 1;
+            crc ^= 0xA001;
+        } else {
+            crc >>= 1;
+        }
+    }
+    return crc;
+}
+
+// Checks the three ASCII CRC characters at the end of a response against a
+// calculated CRC
+bool sdi12CheckCRC(uint16_t crc, const char* crc_chars) {
+    return crc_chars[0] == static_cast<char>(0x40 | (crc >> 12)) &&
+        crc_chars[1] == static_cast<char>(0x40 | ((crc >> 6) & 0x3F)) &&
+        crc_chars[2] == static_cast<char>(0x40 | (crc & 0x3F));
+}
+
+/**
+ * @brief Splits the response to a D command into its address and values,
+ * checking the CRC in the same pass.
+ *
+ * No heap memory is used - values are written into the caller's array.
+ *
+ * @param response The response, with the <CR><LF> already removed
+ * @param response_length The number of characters in the response
+ * @param has_crc True if the last three characters of the response are a CRC
+ * @param values An array to hold the parsed values
+ * @param max_values The number of values the array can hold
+ * @return The address, number of values, whether the CRC matched, and
+ * whether every value could be kept
+ */
+sdi12ParsedResponse parseSDI12Response(const char* response,
+                                       size_t response_length, bool has_crc,
+                                       sdi12Value* values, uint8_t max_values) {
+    sdi12ParsedResponse parsed;
+    parsed.address      = response_length > 0 ? response[0] : '\0';
+    parsed.numberValues = 0;
+    parsed.crcMatch     = !has_crc;
+    parsed.valuesValid  = true;
+
+    size_t data_length = response_length;
+    if (has_crc) {
+        // can't have a valid CRC without at least an address and the CRC
+        if (response_length < 4) { return parsed; }
+        data_length = response_length - 3;
+    }
+
+    uint16_t    crc          = 0;
+    sdi12Value* current      = nullptr;
+    bool        past_decimal = false;
+    uint8_t     num_digits   = 0;
+    for (size_t i = 0; i < data_length; i++) {
+        char c = response[i];
+        if (has_crc) { crc = sdi12UpdateCRC(crc, c); }
+        // NOTE: start at 1 since position 0 is the address!
+        if (i == 0) { continue; }
+
+        bool is_sign  = (c == '+' || c == '-');
+        bool is_digit = (c >= '0' && c <= '9');
+        bool is_dec   = (c == '.');
+        if (!is_sign && !is_digit && !is_dec) {
+            // anything else ends the current value
+            current = nullptr;
+            continue;
+        }
+        // every value should start with a sign, but start a new value on any
+        // number-esque character if we're not already in one
+        if (is_sign || current == nullptr) {
+            if (parsed.numberValues >= max_values) {
+                current = nullptr;
+                continue;
+            }
+            current                = &values[parsed.numberValues++];
+            current->negative      = (c == '-');
+            current->digits        = 0;
+            current->decimalPlaces = 0;
+            past_decimal           = false;
+            num_digits             = 0;
+            if (is_sign) { continue; }
+        }
+        if (is_dec) {
+            past_decimal = true;
+        } else if (c == '0' && current->digits == 0 && !past_decimal) {
+            // a leading zero doesn't change the value
+        } else if (num_digits < SDI12_MAX_VALUE_DIGITS) {
+            current->digits = current->digits * 10 + (c - '0');
+            num_digits++;
+            if (past_decimal) { current->decimalPlaces++; }
+        } else {
+            parsed.valuesValid = false;
+        }
+    }
+
+    if (has_crc) {
+        parsed.crcMatch = sdi12CheckCRC(crc, &response[data_length]);
+    }
+    return parsed;
+}
+
+// Sends a single data command and reads the response into the buffer,
+// returning the number of characters in the response without the <CR><LF>
+size_t requestDataPage(SDI12_BUS_CLASS& _SDI12Internal, const char* command,
+                       char resp_buffer[SDI12_MAX_RESPONSE],
+                       bool printCommands = true) {
+    _SDI12Internal.clearBuffer();
+    _SDI12Internal.sendCommand(command, wake_delay);
+
+    if (printCommands) {
+        Serial.print(">>>");
+        Serial.println(command);
+    }
+
+    // read bytes into the char array until we get to a new line (\r\n)
+    size_t bytes_read = _SDI12Internal.readBytesUntil('\n', resp_buffer,
+                                                      SDI12_MAX_RESPONSE - 1);
+    // strip the \r before the \n
+    if (bytes_read > 0 && resp_buffer[bytes_read - 1] == '\r') {
+        bytes_read--;
+    }
+    resp_buffer[bytes_read] = '\0';
+    if (printCommands) {
+        Serial.print("<<<");
+        Serial.println(resp_buffer);
+    }
+    // read and clear anything else from the buffer
+    int extra_chars = 0;
+    while (_SDI12Internal.available()) {
+        Serial.write(_SDI12Internal.read());
+        extra_chars++;
+    }
+    if (extra_chars > 0) {
+        Serial.print(extra_chars);
+        Serial.println(" additional characters received.");
+    }
+    _SDI12Internal.clearBuffer();
+    return bytes_read;
+}
+
+/**
+ * @brief Gets the results of a finished measurement with aDn! commands.
+ *
+ * If the response to a data command has the wrong address, a bad CRC, or a
+ * value with more than SDI12_MAX_VALUE_DIGITS digits, that page alone is
+ * requested again, using up one of the page retries.  Values from the pages
+ * that were read correctly are always kept.
+ *
+ * @param page_retries The total number of data commands that can be re-sent
+ * for this measurement
+ * @return The results, including a bit set in retriedPages for each data
+ * command that had to be re-sent
+ */
+getResultsResult getResults(SDI12_BUS_CLASS& _SDI12Internal, char address,
                             int resultsExpected, float sdi12_results[10],
                             bool verify_crc = false, bool printCommands = true,
-                            int8_t error_result_number = 0,
-                            float  no_error_value      = 0) {
+                            int8_t  error_result_number = 0,
+                            float   no_error_value      = 0,
+                            uint8_t page_retries        = 0) {
     uint8_t resultsReceived = 0;
     uint8_t cmd_number      = 0;
-    // The maximum number of characters that can be returned in the <values>
-    // part of the response to a D command is either 35 or 75. If the D command
-    // is issued to retrieve data in response to a concurrent measurement
-    // command, or in response to a high-volume ASCII measurement command, the
-    // maximum is 75. The maximum is also 75 in response to a continuous
-    // measurement command. Otherwise, the maximum is 35.
-    int max_sdi_response = 76;
-    // max chars in a unsigned 64 bit number
-    int max_sdi_digits = 21;
-
-    String compiled_response = "";
+    uint8_t retries_left    = page_retries;
 
     bool success = true;
 
@@ -56,146 +264,107 @@ getResultsResult getResults(SDI12& _SDI12Internal, char address,
     return_result.maxDataCommand  = 0;
     return_result.addressMatch    = true;
     return_result.crcMatch        = true;
+    return_result.valuesValid     = true;
     return_result.errorCode       = false;
     return_result.success         = true;
+    return_result.retriedPages    = 0;
+    return_result.retries         = 0;
 
-    while (resultsReceived < resultsExpected && cmd_number <= 9) {
-        _SDI12Internal.clearBuffer();
-        String command = "";
-        command += address;
-        command += "D";
-        command += cmd_number;
-        command +=
-            "!";  // SDI-12 command to get data [address][D][dataOption][!]
-        _SDI12Internal.sendCommand(command, wake_delay);
-
-        if (printCommands) {
-            Serial.print(">>>");
-            Serial.println(command);
-        }
-        char resp_buffer[max_sdi_response] = {'\0'};
-
-        // read bytes into the char array until we get to a new line (\r\n)
-        size_t bytes_read = _SDI12Internal.readBytesUntil('\n', resp_buffer,
-                                                          max_sdi_response);
-
-        size_t data_bytes_read = bytes_read -
-            1;  // subtract one for the /r before the /n
-        String sdiResponse = String(resp_buffer);
-        compiled_response += sdiResponse;
-        sdiResponse.trim();
-        if (printCommands) {
-            Serial.print("<<<");
-            Serial.println(sdiResponse);
-        }
-        // read and clear anything else from the buffer
-        int extra_chars = 0;
-        while (_SDI12Internal.available()) {
-            Serial.write(_SDI12Internal.read());
-            extra_chars++;
-        }
-        if (extra_chars > 0) {
-            Serial.print(extra_chars);
-            Serial.println(" additional characters received.");
-        }
-        _SDI12Internal.clearBuffer();
+    // SDI-12 command to get data [address][D][dataOption][!]
+    char command[] = {address, 'D', '0', '!', '\0'};
+    // Fixed buffers for the response and the values parsed from it
+    char       resp_buffer[SDI12_MAX_RESPONSE];
+    sdi12Value values[SDI12_MAX_VALUES_PER_RESPONSE];
 
-        // check the address, break if it's incorrect
-        char returned_address = resp_buffer[0];
-        if (returned_address != address) {
+    while (resultsReceived < resultsExpected && cmd_number <= 9) {
+        command[2] = '0' + cmd_number;
+
+        // Request the page, re-requesting only this page if the response is
+        // garbled and we still have retries left
+        sdi12ParsedResponse parsed;
+        bool                address_ok = false;
+        bool                crc_ok     = false;
+        bool                page_ok    = false;
+        while (true) {
+            size_t bytes_read = requestDataPage(_SDI12Internal, command,
+                                                resp_buffer, printCommands);
+
+            // Split the values out of the response and check the CRC in one
+            // pass
+            parsed = parseSDI12Response(resp_buffer, bytes_read, verify_crc,
+                                        values, SDI12_MAX_VALUES_PER_RESPONSE);
+
+            address_ok = parsed.address == address;
+            crc_ok     = !verify_crc || parsed.crcMatch;
+            page_ok    = address_ok && crc_ok && parsed.valuesValid;
             if (printCommands) {
-                Serial.println("Wrong address returned!");
-                Serial.print("Expected ");
-                Serial.print(String(address));
-                Serial.print(" Got ");
-                Serial.println(String(returned_address));
-                Serial.println(String(resp_buffer));
+                if (!address_ok) {
+                    Serial.println("Wrong address returned!");
+                    Serial.print("Expected ");
+                    Serial.print(address);
+                    Serial.print(" Got ");
+                    Serial.println(parsed.address);
+                } else if (!crc_ok) {
+                    Serial.println("CRC check failed!");
+                } else if (!parsed.valuesValid) {
+                    Serial.println("Value with too many digits!");
+                } else if (verify_crc) {
+                    Serial.println("CRC valid");
+                }
+            }
+            if (page_ok || retries_left == 0) { break; }
+            retries_left--;
+            return_result.retries++;
+            return_result.retriedPages |= 1 << cmd_number;
+            if (printCommands) {
+                Serial.print("Retrying ");
+                Serial.println(command);
             }
-            success                    = false;
-            return_result.addressMatch = false;
-            break;
         }
 
-        // check the crc, break if it's incorrect
-        if (verify_crc) {
-            bool crcMatch   = _SDI12Internal.verifyCRC(sdiResponse);
-            data_bytes_read = data_bytes_read - 3;
-            if (crcMatch) {
-                if (printCommands) { Serial.println("CRC valid"); }
-            } else {
-                if (printCommands) { Serial.println("CRC check failed!"); }
+        // break if the page could not be read; the values from any earlier
+        // pages are kept
+        if (!page_ok) {
+            if (!address_ok) {
+                return_result.addressMatch = false;
+            } else if (!crc_ok) {
                 return_result.crcMatch = false;
-                success                = false;
-                break;
+            } else {
+                return_result.valuesValid = false;
             }
+            success = false;
+            break;
         }
 
-        bool    gotResults                   = false;
-        char    float_buffer[max_sdi_digits] = {'\0'};
-        char*   dec_pl                       = float_buffer;
-        uint8_t fb_pos                       = 0;  // start at start of buffer
-        bool    finished_last_number         = false;
-        // iterate through the char array and to check results
-        // NOTE: start at 1 since we already looked at the address!
-        for (size_t i = 1; i < data_bytes_read; i++) {
-            // Get the character at position
-            char c = resp_buffer[i];
-            // if we didn't get something number-esque or we're at the end of
-            // the buffer, assume the last number finished and parse it
-            //(c != '-' && (c < '0' || c > '9') && c != '.')
-            if (c == '-' || (c >= '0' && c <= '9') || c == '.') {
-                // if there's a number, a decimal, or a negative sign next in
-                // the buffer, add it to the float buffer.
-                float_buffer[fb_pos] = c;
-                fb_pos++;
-                float_buffer[fb_pos] = '\0';  // null terminate the buffer
-                finished_last_number = false;
-            } else {
-                finished_last_number = true;
+        bool gotResults = false;
+        for (uint8_t v = 0; v < parsed.numberValues && resultsReceived < 10;
+             v++) {
+            float result                   = sdi12ValueToFloat(values[v]);
+            sdi12_results[resultsReceived] = result;
+            if (printCommands) {
+                Serial.print("Result ");
+                Serial.print(resultsReceived);
+                Serial.print(", Len after decimal: ");
+                Serial.print(values[v].decimalPlaces);
+                Serial.print(", Parsed value: ");
+                Serial.println(result, values[v].decimalPlaces);
             }
-            // if we've gotten to the end of a number or the end of the buffer,
-            // parse the character
-            if ((finished_last_number || i == data_bytes_read - 1) &&
-                strnlen(float_buffer, max_sdi_digits) > 0) {
-                float result                   = atof(float_buffer);
-                sdi12_results[resultsReceived] = result;
-                if (printCommands) {
-                    Serial.print("Result ");
-                    Serial.print(resultsReceived);
-                    Serial.print(", Raw value: ");
-                    Serial.print(float_buffer);
-                    dec_pl              = strchr(float_buffer, '.');
-                    size_t len_post_dec = 0;
-                    if (dec_pl != nullptr) {
-                        len_post_dec = strnlen(dec_pl, max_sdi_digits) - 1;
-                    }
-                    Serial.print(", Len after decimal: ");
-                    Serial.print(len_post_dec);
-                    Serial.print(", Parsed value: ");
-                    Serial.println(String(result, len_post_dec));
-                }
-                // add how many results we have
-                if (result != -9999) {
-                    gotResults = true;
-                    resultsReceived++;
-                }
-                // check for a failure error code at the end
-                if (error_result_number >= 1) {
-                    if (resultsReceived == error_result_number &&
-                        result != no_error_value) {
-                        success                 = false;
-                        return_result.errorCode = true;
-                        if (printCommands) {
-                            Serial.print("Got a failure code of ");
-                            Serial.println(String(
-                                result, strnlen(dec_pl, max_sdi_digits) - 1));
-                        }
+            // add how many results we have
+            if (result != -9999) {
+                gotResults = true;
+                resultsReceived++;
+            }
+            // check for a failure error code at the end
+            if (error_result_number >= 1) {
+                if (resultsReceived == error_result_number &&
+                    result != no_error_value) {
+                    success                 = false;
+                    return_result.errorCode = true;
+                    if (printCommands) {
+                        Serial.print("Got a failure code of ");
+                        Serial.println(result, values[v].decimalPlaces);
                     }
                 }
-
-                // empty the buffer
-                float_buffer[0] = '\0';
-                fb_pos          = 0;
             }
         }
 
@@ -229,6 +398,18 @@ getResultsResult getResults(SDI12& _SDI12Internal, char address,
         Serial.print(" expected. This is a ");
         Serial.println(resultsReceived == resultsExpected ? "success."
                                                           : "failure.");
+        if (return_result.retries > 0) {
+            Serial.print("Re-sent ");
+            Serial.print(return_result.retries);
+            Serial.print(" data commands for pages:");
+            for (uint8_t page = 0; page <= 9; page++) {
+                if (return_result.retriedPages & (1 << page)) {
+                    Serial.print(" D");
+                    Serial.print(page);
+                }
+            }
+            Serial.println();
+        }
     }
 
     success &= resultsReceived == resultsExpected;
@@ -238,7 +419,8 @@ getResultsResult getResults(SDI12& _SDI12Internal, char address,
     return return_result;
 }
 
-startMeasurementResult startMeasurement(SDI12& _SDI12Internal, char address,
+startMeasurementResult startMeasurement(SDI12_BUS_CLASS& _SDI12Internal,
+                                        char   address,
                                         bool   is_concurrent = false,
                                         bool   request_crc   = false,
                                         String meas_type     = "",
@@ -309,6 +491,86 @@ startMeasurementResult startMeasurement(SDI12& _SDI12Internal, char address,
     return return_result;
 }
 
+// How a wait for a measurement to finish ended
+enum sdi12WaitResult {
+    SDI12_WAIT_SERVICE_REQUEST = 0,  // the sensor sent a service request
+    SDI12_WAIT_DEADLINE,  // the measurement time given by the sensor passed
+    SDI12_WAIT_TIMEOUT    // no service request came, even after extra time
+};
+
+const char* sdi12WaitResultName(sdi12WaitResult wait_result) {
+    switch (wait_result) {
+        case SDI12_WAIT_SERVICE_REQUEST: return "service request";
+        case SDI12_WAIT_DEADLINE: return "deadline";
+        default: return "timeout";
+    }
+}
+
+// Puts the processor into idle sleep until the next interrupt.  The clocks
+// and peripherals keep running, so the SDI-12 pin change interrupt wakes us
+// for any incoming character and the SysTick interrupt wakes us every
+// millisecond so millis() stays correct.
+void sdi12IdleSleep() {
+#if defined(__SAMD51__)
+    // Logger::systemSleep() leaves the sleep mode set to standby, which would
+    // stop the SysTick, so always set idle explicitly.
+    PM->SLEEPCFG.bit.SLEEPMODE = PM_SLEEPCFG_SLEEPMODE_IDLE2_Val;
+    while (PM->SLEEPCFG.bit.SLEEPMODE != PM_SLEEPCFG_SLEEPMODE_IDLE2_Val);
+    __DSB();
+    __WFI();
+#elif defined(ARDUINO_ARCH_SAMD)
+    SCB->SCR &= ~SCB_SCR_SLEEPDEEP_Msk;
+    PM->SLEEP.reg = PM_SLEEP_IDLE_APB;
+    __DSB();
+    __WFI();
+#else
+    yield();
+#endif
+}
+
+/**
+ * @brief Sleeps until a started measurement should be finished.
+ *
+ * A sensor started with a standard (aM!) measurement sends a service request
+ * (its address followed by <CR><LF>) as soon as its data is ready, which may
+ * be before the time it gave in its acknowledgement.  Sensors started with a
+ * concurrent (aC!) measurement never send a service request, so for those we
+ * can only wait for the deadline.
+ *
+ * @param address The address of the sensor being waited on
+ * @param deadline The millis() value when the sensor said its data would be
+ * ready
+ * @param expect_service_request True to watch for a service request
+ * @param extra_wait_ms How long to keep waiting for a service request after
+ * the deadline has passed
+ * @return How the wait ended
+ */
+sdi12WaitResult waitForMeasurement(SDI12_BUS_CLASS& _SDI12Internal,
+                                   char     address,
+                                   uint32_t deadline,
+                                   bool     expect_service_request = false,
+                                   uint32_t extra_wait_ms          = 1000) {
+    uint32_t timeout = deadline;
+    if (expect_service_request) { timeout += extra_wait_ms; }
+    bool got_address = false;
+
+    while (static_cast<int32_t>(millis() - timeout) < 0) {
+        while (expect_service_request && _SDI12Internal.available()) {
+            char c = _SDI12Internal.read();
+            if (c == address) {
+                got_address = true;
+            } else if (c == '\n' && got_address) {
+                _SDI12Internal.clearBuffer();
+                return SDI12_WAIT_SERVICE_REQUEST;
+            } else if (c != '\r') {
+                got_address = false;
+            }
+        }
+        sdi12IdleSleep();
+    }
+    return expect_service_request ? SDI12_WAIT_TIMEOUT : SDI12_WAIT_DEADLINE;
+}
+
 /**
  * @brief gets identification information from a sensor, and prints it to the
  * serial port
@@ -316,7 +578,8 @@ startMeasurementResult startMeasurement(SDI12& _SDI12Internal, char address,
  * @param i a character between '0'-'9', 'a'-'z', or 'A'-'Z'.
  * @param printCommands true to print the raw output and input from the command
  */
-bool printInfo(SDI12& _SDI12Internal, char i, bool printCommands = true) {
+bool printInfo(SDI12_BUS_CLASS& _SDI12Internal, char i,
+               bool printCommands = true) {
     _SDI12Internal.clearBuffer();
     String command = "";
     command += i;
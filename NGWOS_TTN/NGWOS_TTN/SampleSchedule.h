@@ -0,0 +1,56 @@
+// Header Guards
+#ifndef SAMPLE_SCHEDULE_H_
+#define SAMPLE_SCHEDULE_H_
+
+#include <Arduino.h>
+
+/**
+ * @brief Decides when a sensor, or a group of sensors sharing a power supply,
+ * is due to be read.
+ *
+ * A sensor is due on the first logging cycle in each of its sampling
+ * intervals, lined up with the clock like the logging interval.  A sampling
+ * interval shorter than the logging interval just means every cycle, and a
+ * cycle that's late or missed doesn't throw the schedule off.  A sensor that
+ * hasn't been read since the logger started is always due.
+ */
+class sampleSchedule {
+ public:
+    /**
+     * @param interval_minutes How often to read the sensor, in minutes
+     */
+    explicit sampleSchedule(uint16_t interval_minutes)
+        : _interval(static_cast<uint32_t>(interval_minutes) * 60),
+          _hasRead(false),
+          _lastRead(0) {
+        if (_interval == 0) { _interval = 60; }
+    }
+    ~sampleSchedule() {}
+
+    /**
+     * @brief Whether the sensor is due to be read.
+     *
+     * @param epoch The time of the logging cycle, in seconds
+     */
+    bool isDue(uint32_t epoch) {
+        return !_hasRead || epoch / _interval != _lastRead / _interval;
+    }
+
+    // Note that the sensor was read at the given time
+    void markRead(uint32_t epoch) {
+        _hasRead  = true;
+        _lastRead = epoch;
+    }
+
+    // How often to read the sensor, in minutes
+    uint16_t getIntervalMinutes() {
+        return _interval / 60;
+    }
+
+ protected:
+    uint32_t _interval;
+    bool     _hasRead;
+    uint32_t _lastRead;
+};
+
+#endif
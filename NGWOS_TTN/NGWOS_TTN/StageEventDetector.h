@@ -0,0 +1,144 @@
+// Header Guards
+#ifndef STAGE_EVENT_DETECTOR_H_
+#define STAGE_EVENT_DETECTOR_H_
+
+#include <Arduino.h>
+#include <math.h>
+
+// The number of readings in a row that must change slowly to end an event
+#ifndef STAGE_EVENT_CALM_READINGS
+#define STAGE_EVENT_CALM_READINGS 3
+#endif
+// The number of recent readings kept to measure the rate over the window
+#ifndef STAGE_EVENT_HISTORY
+#define STAGE_EVENT_HISTORY 16
+#endif
+
+/**
+ * @brief Watches the stage for a flood, or anything else making it change
+ * quickly.
+ *
+ * An event starts when the stage rises or falls faster than a set rate, or
+ * when it crosses a set level in either direction.  The event ends once the
+ * stage has changed at less than half that rate for STAGE_EVENT_CALM_READINGS
+ * readings in a row, so a peak that only pauses doesn't end it.  Readings with
+ * no data are ignored and don't end an event.
+ *
+ * The rate is measured from the newest reading that's at least a set window
+ * old, not from the last reading.  Readings taken a minute apart during an
+ * event would otherwise turn a couple of millimeters of noise into a rate big
+ * enough to keep the event from ever ending.
+ */
+class stageEventDetector {
+ public:
+    /**
+     * @param trigger_rate The rate of change that starts an event, in units of
+     * the stage per hour
+     * @param threshold The stage that starts an event when it's crossed, or
+     * -9999 for none
+     * @param window_seconds The shortest time to measure the rate over, in
+     * seconds - usually the logging interval outside of an event
+     */
+    stageEventDetector(float trigger_rate, float threshold = -9999,
+                       uint32_t window_seconds = 300)
+        : _triggerRate(trigger_rate),
+          _threshold(threshold),
+          _window(window_seconds),
+          _active(false),
+          _calmReadings(0),
+          _count(0),
+          _newest(0),
+          _rate(0) {}
+    ~stageEventDetector() {}
+
+    /**
+     * @brief Add a stage reading.
+     *
+     * @param stage The stage, or -9999 if there's no reading
+     * @param epoch The time of the reading, in seconds
+     * @return True if this reading started an event
+     */
+    bool addReading(float stage, uint32_t epoch) {
+        if (isnan(stage) || stage == -9999) { return false; }
+
+        bool triggered = false;
+        if (_count > 0 && epoch > _epochs[_newest]) {
+            // The newest reading at least the window old, or the oldest kept
+            // if none are that old yet
+            uint8_t reference = oldest();
+            for (uint8_t i = 0; i < _count; i++) {
+                uint8_t index = (_newest + STAGE_EVENT_HISTORY - i) %
+                    STAGE_EVENT_HISTORY;
+                if (epoch - _epochs[index] >= _window) {
+                    reference = index;
+                    break;
+                }
+            }
+            _rate = (stage - _stages[reference]) * 3600.0 /
+                (epoch - _epochs[reference]);
+            triggered = fabs(_rate) >= _triggerRate;
+            if (_threshold != -9999 &&
+                (stage >= _threshold) != (_stages[_newest] >= _threshold)) {
+                triggered = true;
+            }
+        } else if (_count > 0) {
+            // The clock went backwards, so start over
+            _count = 0;
+        }
+        addToHistory(stage, epoch);
+
+        if (triggered) {
+            bool started  = !_active;
+            _active       = true;
+            _calmReadings = 0;
+            return started;
+        }
+        if (_active) {
+            if (fabs(_rate) < _triggerRate / 2) {
+                _calmReadings++;
+            } else {
+                _calmReadings = 0;
+            }
+            if (_calmReadings >= STAGE_EVENT_CALM_READINGS) { _active = false; }
+        }
+        return false;
+    }
+
+    // Whether an event is going on
+    bool isActive() {
+        return _active;
+    }
+
+    // The rate of change over the window at the last reading, in units of the
+    // stage per hour
+    float getRate() {
+        return _rate;
+    }
+
+ protected:
+    uint8_t oldest() {
+        return (_newest + STAGE_EVENT_HISTORY + 1 - _count) %
+            STAGE_EVENT_HISTORY;
+    }
+
+    void addToHistory(float stage, uint32_t epoch) {
+        _newest          = (_newest + 1) % STAGE_EVENT_HISTORY;
+        _stages[_newest] = stage;
+        _epochs[_newest] = epoch;
+        if (_count < STAGE_EVENT_HISTORY) { _count++; }
+    }
+
+    float    _triggerRate;
+    float    _threshold;
+    uint32_t _window;
+    bool     _active;
+    uint8_t  _calmReadings;
+    // The recent readings, oldest first, in a ring ending at _newest
+    float    _stages[STAGE_EVENT_HISTORY];
+    uint32_t _epochs[STAGE_EVENT_HISTORY];
+    uint8_t  _count;
+    uint8_t  _newest;
+    float    _rate;
+};
+
+#endif
@@ -118,6 +118,8 @@ void Logger::turnOffSDcard(bool waitForHousekeeping) {
         // TODO(SRGDamia1): set ALL SPI pins HIGH (~30k pull-up)
         pinMode(_SDCardPowerPin, OUTPUT);
         digitalWrite(_SDCardPowerPin, LOW);
+        // the card will need to be initialized again after power up
+        _sdCardReady = false;
         // TODO(SRGDamia1):  wait in lower power mode
         if (waitForHousekeeping) {
             MS_DEEP_DBG(
@@ -485,6 +487,32 @@ void Logger::wakeISR(void) {
 }
 
 
+// Sets the RTC alarm to go off at the start of the next logging interval
+bool Logger::setAlarmForNextInterval(void) {
+    // The RTC keeps its own local time, which is the same time checkInterval()
+    // uses, so the alarm lines up with the intervals it checks for
+    uint32_t intervalSeconds = static_cast<uint32_t>(_loggingIntervalMinutes) *
+        60;
+    uint32_t now       = getNowLocalEpoch();
+    uint32_t untilNext = intervalSeconds - (now % intervalSeconds);
+    // The alarm only matches whole minutes, so it would be missed if the
+    // minute turned over while it's being set
+    if (untilNext < LOGGER_MIN_SLEEP_SECONDS) { return false; }
+
+    uint32_t nextWake = now + untilNext;
+    MS_DBG(F("Setting the alarm for"), formatDateTime_ISO8601(nextWake));
+    // Intervals all start on a whole minute, so the alarm goes off as the
+    // seconds roll over to zero at the minute and hour of the next one.  The
+    // date isn't matched, so with an interval longer than a day, the logger
+    // wakes once a day at that time until the day comes.
+    rtc.setItemsToMatchForAlarm(true, true, false, false);
+    rtc.setAlarmMinute((nextWake / 60) % 60);
+    rtc.setAlarmHour((nextWake / 3600) % 24);
+    rtc.enableHardwareInterrupt(ALARM_INTERRUPT);
+    return true;
+}
+
+
 // Puts the system to sleep to conserve battery life.
 // This DOES NOT sleep or wake the sensors!!
 void Logger::systemSleep(void) {
@@ -501,11 +529,99 @@ void Logger::systemSleep(void) {
     rtc.disableAllInterrupts();
     // Clear all flags in case any interrupts have occurred.
     rtc.clearAllInterruptFlags();
-    // Enable a periodic update for every minute
-    rtc.setPeriodicTimeUpdateFrequency(TIME_UPDATE_1_MINUTE);
-    // Enable the hardware interrupt
-    rtc.enableHardwareInterrupt(UPDATE_INTERRUPT);
+    // Set the alarm for the next logging interval, instead of waking every
+    // minute to check whether it's time yet
+    if (!setAlarmForNextInterval()) {
+        MS_DBG(F("Too close to the next interval to sleep"));
+        return;
+    }
+
+    sleepUntilInterrupt();
+
+    // Stop the clock from sending out any interrupts while we're awake.
+    // There's no reason to waste thought on the clock interrupt if it
+    // happens while the processor is awake and doing other things.
+    rtc.disableHardwareInterrupt(ALARM_INTERRUPT);
+
+    // Wake-up message
+    MS_DBG(F("\n\n\n... zzzZZ Processor is now awake!"));
+
+    // The logger will now start the next function after the systemSleep
+    // function in either the loop or setup
+}
+
+
+// Sleeps for a set time, using the RTC countdown timer to wake up
+uint32_t Logger::sleepFor(uint32_t ms) {
+    uint32_t slept    = 0;
+    uint32_t left     = ms;
+    bool     canSleep = true;
+#if !defined(MS_USE_RTC_ZERO)
+    // Without a wake pin, the whole wait is spent awake
+    canSleep = _mcuWakePin >= 0;
+#endif
+    // The countdown timer holds at most 4095 ticks, so a long wait is slept
+    // in pieces - whole seconds first, then the rest in 64ths of a second.
+    // The most 4095 64ths can cover, with the rounding up below, is 63984 ms.
+    while (canSleep && left >= LOGGER_MIN_SLEEP_MS) {
+        uint16_t ticks;
+        uint32_t piece;
+        rtc.disableAllInterrupts();
+        rtc.clearAllInterruptFlags();
+        rtc.setCountdownTimerEnable(false);
+        if (left > 4095L * 1000L / 64) {
+            ticks = left / 1000L > 4095 ? 4095 : left / 1000L;
+            piece = ticks * 1000L;
+            rtc.setCountdownTimerFrequency(COUNTDOWN_TIMER_FREQUENCY_1_HZ);
+        } else {
+            // rounded up, since the first tick can come early
+            ticks = (left * 64 + 999) / 1000;
+            piece = left;
+            rtc.setCountdownTimerFrequency(COUNTDOWN_TIMER_FREQUENCY_64_HZ);
+        }
+        rtc.setCountdownTimerClockTicks(ticks);
+        rtc.enableHardwareInterrupt(TIMER_INTERRUPT);
+        rtc.setCountdownTimerEnable(true);
+
+        MS_DBG(F("Sleeping for"), piece, F("ms"));
+        uint32_t start = getRTCMillis();
+        sleepUntilInterrupt();
+
+        rtc.disableHardwareInterrupt(TIMER_INTERRUPT);
+        rtc.setCountdownTimerEnable(false);
+        // Something else, like a button, woke the mcu before the timer ran
+        // out, so only count the time the RTC says went by
+        if (!rtc.getInterruptFlag(FLAG_TIMER)) {
+            uint32_t woke = getRTCMillis() - start;
+            MS_DBG(F("Woken early, after"), woke, F("ms"));
+            if (woke < piece) { piece = woke; }
+        }
+        slept += piece;
+        left -= piece;
+    }
+
+    // Too short to be worth stopping and restarting I2C and USB for, so wait
+    // it out awake, keeping the dog quiet
+    while (left > 0) {
+        uint32_t step = left > 100L ? 100L : left;
+        watchDogTimer.resetWatchDog();
+        delay(step);
+        left -= step;
+    }
+    return slept;
+}
+
 
+// Gets the RTC time, to the hundredth of a second, in milliseconds
+uint32_t Logger::getRTCMillis(void) {
+    rtc.updateTime();
+    return rtc.getEpoch() * 1000L + rtc.getHundredths() * 10L;
+}
+
+
+// Puts the processor in standby until an interrupt on the wake pin, leaving
+// the wake pin and the RTC interrupt set as they were
+void Logger::sleepUntilInterrupt(void) {
     // Set up a pin to hear clock interrupt and attach the wake ISR to it
     pinMode(_mcuWakePin, INPUT_PULLUP);
     enableInterrupt(_mcuWakePin, wakeISR, RISING);
@@ -539,6 +655,7 @@ void Logger::systemSleep(void) {
 
     // Disable the watch-dog timer
     MS_DEEP_DBG(F("Disabling the watchdog"));
+    bool watchDogWasOn = watchDogTimer.isWatchDogEnabled();
     watchDogTimer.disableWatchDog();
 
 #ifndef USE_TINYUSB
@@ -624,8 +741,9 @@ void Logger::systemSleep(void) {
     // ^^ USB->DEVICE.CTRLB.bit.DETACH = 0; enables USB interrupts
 #endif
 
-    // Re-enable the watch-dog timer
-    watchDogTimer.enableWatchDog();
+    // Re-enable the watch-dog timer, if it was running, with a full count of
+    // barks
+    if (watchDogWasOn) { watchDogTimer.enableWatchDog(); }
 
     // Re-start the I2C interface
     MS_DEEP_DBG(F("Restarting I2C"));
@@ -645,18 +763,8 @@ void Logger::systemSleep(void) {
     // the timeout period is a useless delay.
     Wire.setTimeout(0);
 
-    // Stop the clock from sending out any interrupts while we're awake.
-    // There's no reason to waste thought on the clock interrupt if it
-    // happens while the processor is awake and doing other things.
-    rtc.disableHardwareInterrupt(UPDATE_INTERRUPT);
     // Detach the from the pin
     disableInterrupt(_mcuWakePin);
-
-    // Wake-up message
-    MS_DBG(F("\n\n\n... zzzZZ Processor is now awake!"));
-
-    // The logger will now start the next function after the systemSleep
-    // function in either the loop or setup
 }
 
 
@@ -666,7 +774,11 @@ void Logger::systemSleep(void) {
 
 // This sets a file name, if you want to decide on it in advance
 void Logger::setFileName(String& fileName) {
-    _fileName = fileName;
+    _fileName     = fileName;
+    _autoFileName = false;
+    // The end of the new file's data hasn't been found yet
+    _dataEnd  = 0;
+    _zeroedTo = 0;
 }
 // Same as above, with a character array (overload function)
 void Logger::setFileName(const char* fileName) {
@@ -683,9 +795,10 @@ void Logger::generateAutoFileName(void) {
     auto fileName = String(_loggerID);
     fileName += "_";
     fileName += formatDateTime_ISO8601(getNowLocalEpoch()).substring(0, 10);
-    fileName += ".csv";
+    fileName += _binaryRecordSize > 0 ? ".bin" : ".csv";
     setFileName(fileName);
-    _fileName = fileName;
+    _fileName     = fileName;
+    _autoFileName = true;
 }
 
 // Protected helper function - This checks if the SD card is available and ready
@@ -696,6 +809,8 @@ bool Logger::initializeSDCard(void) {
         PRINTOUT(F("Data will not be saved!"));
         return false;
     }
+    // Skip the initialization if the card is still ready from before
+    if (_sdCardReady) { return true; }
     // Initialise the SD card
     // If you have a dedicated SPI for the SD card, you can overrride the
     // default shared SPI using this:
@@ -739,7 +854,8 @@ bool Logger::initializeSDCard(void) {
                                &SDCARD_SPI);
 #endif
 
-    if (!sd.begin(customSdConfig)) {
+    _sdCardReady = sd.begin(customSdConfig);
+    if (!_sdCardReady) {
         PRINTOUT(F("Error: SD card failed to initialize or is missing."));
         PRINTOUT(F("Data will not be saved!"));
         return false;
@@ -778,23 +894,38 @@ bool Logger::openFile(String& filename, bool createFile) {
     // don't try to re-create something that's already there.
     // This should also prevent the header from being written over and over
     // in the file.
-    if (logFile.open(charFileName, O_WRITE | O_AT_END)) {
+    // NOTE: The file is opened for reading too, so we can find the end of the
+    // data in a preallocated file.
+    if (logFile.open(charFileName, O_RDWR | O_AT_END)) {
         MS_DBG(F("Opened existing file:"), filename);
+        // Skip back over any unused preallocated space, only searching for
+        // the end of the data the first time the current file is opened
+        if (_preallocateRecordBytes > 0) {
+            bool     current = filename == _fileName;
+            uint32_t dataEnd = current && _dataEnd > 0 ? _dataEnd
+                                                       : findDataEnd(logFile);
+            if (current) {
+                _dataEnd = dataEnd;
+                if (_zeroedTo < dataEnd) { _zeroedTo = dataEnd; }
+            }
+            logFile.seekSet(dataEnd);
+        }
         // Set access date time
         setFileTimestamp(logFile, T_ACCESS);
         return true;
     } else if (createFile) {
         // Create and then open the file in write mode
-        if (logFile.open(charFileName, O_CREAT | O_WRITE | O_AT_END)) {
+        if (logFile.open(charFileName, O_CREAT | O_RDWR | O_AT_END)) {
             MS_DBG(F("Created new file:"), filename);
-            // Set creation date time
-            setFileTimestamp(logFile, T_CREATE);
-            // Set access date time
-            setFileTimestamp(logFile, T_ACCESS);
+            // Set creation and access date time
+            setFileTimestamp(logFile, T_CREATE | T_ACCESS);
             return true;
         } else {
             // Return false if we couldn't create the file
             MS_DBG(F("Unable to create new file:"), filename);
+            // Initialize the card again next time in case it was swapped
+            _sdCardReady = false;
+            _dataEnd     = 0;
             return false;
         }
     } else {
@@ -816,6 +947,41 @@ bool Logger::openFile(String& filename, bool createFile) {
 bool Logger::createLogFile(String& filename) {
     // Attempt to create and open a file
     if (openFile(filename, true)) {
+        // Set up a file we just made
+        if (logFile.fileSize() == 0) {
+            if (_preallocateRecordBytes > 0) {
+                // Reserve space for a day of records plus the header
+                uint32_t records = _loggingIntervalMinutes > 0
+                    ? 1440L / _loggingIntervalMinutes + 1
+                    : 1441L;
+                uint32_t length = _binaryRecordSize > 0
+                    ? records * _binaryRecordSize + _binaryHeaderSize
+                    : records * _preallocateRecordBytes +
+                        _fileHeader.length() + 2;
+                // Round up to a whole number of sectors
+                length = (length + 511) & ~static_cast<uint32_t>(511);
+                if (!logFile.preAllocate(length)) {
+                    MS_DBG(F("Unable to preallocate"), length, F("bytes"));
+                }
+                // The space holds whatever was on the card before; only the
+                // part just past the data is zeroed, as the data reaches it
+                logFile.seekSet(0);
+                if (filename == _fileName) {
+                    _dataEnd  = 0;
+                    _zeroedTo = 0;
+                }
+                zeroAhead(filename, _binaryRecordSize > 0
+                              ? _binaryHeaderSize
+                              : _fileHeader.length() + 2);
+                MS_DBG(F("Preallocated"), length, F("bytes for"), filename);
+            }
+            if (_binaryRecordSize > 0) {
+                logFile.write(_binaryHeader, _binaryHeaderSize);
+            } else if (_fileHeader.length() > 0) {
+                logFile.println(_fileHeader);
+            }
+            noteDataEnd(filename, true);
+        }
         // Close the file to save it (only do this if we'd opened it)
         logFile.close();
         PRINTOUT(F("Data will be saved as"), _fileName);
@@ -838,6 +1004,10 @@ bool Logger::createLogFile() {
 // the file does not already exist, the file will be created. This can be used
 // to force a logger to write to a file with a secondary file name.
 bool Logger::logToSD(String& filename, String& rec) {
+    // Write out anything buffered for this file first to keep the lines in
+    // order
+    if (_sdBufferUsed > 0 && filename == _fileName) { flushSDBuffer(); }
+
     // First attempt to open the file without creating a new one
     if (!openFile(filename, false)) {
         PRINTOUT(F("Could not write to existing file on SD card, attempting to "
@@ -845,29 +1015,266 @@ bool Logger::logToSD(String& filename, String& rec) {
         // Next try to create the file, bail if we couldn't create it
         // This will not attempt to generate a new file name or add a header!
         if (!openFile(filename, true)) {
-            PRINTOUT(F("Unable to write to SD card!"));
+            _sdLinesDropped++;
+            PRINTOUT(F("Unable to write to SD card!"), _sdLinesDropped,
+                     F("lines dropped so far"));
             return false;
         }
     }
 
     // If we could successfully open or create the file, write the data to it
-    logFile.println(rec);
+    zeroAhead(filename, rec.length() + 2);
+    noteDataEnd(filename, logFile.println(rec) == rec.length() + 2);
     // Echo the line to the serial port
     PRINTOUT(F("\n \\/---- Line Saved to SD Card ----\\/"));
     PRINTOUT(rec);
 
-    // Set write/modification date time
-    setFileTimestamp(logFile, T_WRITE);
-    // Set access date time
-    setFileTimestamp(logFile, T_ACCESS);
+    // Set write/modification and access date time
+    setFileTimestamp(logFile, T_WRITE | T_ACCESS);
     // Close the file to save it
     logFile.close();
     return true;
 }
 bool Logger::logToSD(String& rec) {
+    return logToSD(rec.c_str());
+}
+bool Logger::logToSD(const char* rec) {
+    // Get a new file name if the name is blank
+    if (_fileName == "") generateAutoFileName();
+    // Or start a new file if the date has changed
+    checkFileRollover();
+    // Write the line immediately if we're not buffering or it's too long to
+    // ever fit in the buffer
+    size_t recLength  = strlen(rec);
+    size_t lineLength = recLength + 2;  // with the "\r\n"
+    if (_sdFlushInterval == 0 || lineLength > LOGGER_SD_BUFFER_SIZE) {
+        String line = rec;
+        return logToSD(_fileName, line);
+    }
+
+    // Echo the line to the serial port
+    PRINTOUT(F("\n \\/---- Line Buffered for SD Card ----\\/"));
+    PRINTOUT(rec);
+    return bufferForSD(reinterpret_cast<const uint8_t*>(rec), recLength,
+                       true);
+}
+bool Logger::logToSD(const uint8_t* record) {
+    if (_binaryRecordSize == 0) { return false; }
     // Get a new file name if the name is blank
     if (_fileName == "") generateAutoFileName();
-    return logToSD(_fileName, rec);
+    // Or start a new file if the date has changed
+    checkFileRollover();
+    if (_sdFlushInterval > 0 && _binaryRecordSize <= LOGGER_SD_BUFFER_SIZE) {
+        return bufferForSD(record, _binaryRecordSize, false);
+    }
+
+    if (!openLogFileForAppend()) {
+        _sdLinesDropped++;
+        PRINTOUT(F("Unable to write to SD card!"), _sdLinesDropped,
+                 F("lines dropped so far"));
+        return false;
+    }
+    zeroAhead(_fileName, _binaryRecordSize);
+    bool success = logFile.write(record, _binaryRecordSize) ==
+        _binaryRecordSize;
+    noteDataEnd(_fileName, success);
+    setFileTimestamp(logFile, T_WRITE | T_ACCESS);
+    logFile.close();
+    if (!success) { _sdLinesDropped++; }
+    MS_DBG(F("Wrote a"), _binaryRecordSize, F("byte record to"), _fileName);
+    return success;
+}
+
+
+// Sets the header and record size of the binary file format
+void Logger::setBinaryFormat(const uint8_t* header, uint16_t headerSize,
+                             uint16_t recordSize) {
+    // write out anything held in the old format
+    flushSDBuffer();
+    _binaryHeader     = header;
+    _binaryHeaderSize = headerSize;
+    _binaryRecordSize = recordSize;
+}
+
+
+// Adds data to the buffer for the SD card, writing the buffer out first if the
+// data won't fit in it or afterwards if the oldest data has waited long enough
+bool Logger::bufferForSD(const uint8_t* data, uint16_t length,
+                         bool addLineEnd) {
+    uint16_t totalLength = length + (addLineEnd ? 2 : 0);
+    // Make room for the data, dropping it if the buffer can't be written out
+    // even after initializing the card again
+    if (_sdBufferUsed + totalLength > LOGGER_SD_BUFFER_SIZE &&
+        !flushSDBuffer()) {
+        _sdLinesDropped++;
+        PRINTOUT(F("Unable to write to SD card!"), _sdLinesDropped,
+                 F("lines dropped so far"));
+        return false;
+    }
+
+    if (_sdBufferUsed == 0) { _sdBufferStart = getNowLocalEpoch(); }
+    memcpy(_sdBuffer + _sdBufferUsed, data, length);
+    _sdBufferUsed += length;
+    if (addLineEnd) {
+        _sdBuffer[_sdBufferUsed++] = '\r';
+        _sdBuffer[_sdBufferUsed++] = '\n';
+    }
+
+    // Write out the buffer once the oldest data has waited long enough
+    if (getNowLocalEpoch() - _sdBufferStart >= _sdFlushInterval) {
+        return flushSDBuffer();
+    }
+    return true;
+}
+
+
+// Opens the current file to add to it, creating it with its header if it
+// doesn't exist yet
+bool Logger::openLogFileForAppend(void) {
+    if (openFile(_fileName, false)) { return true; }
+    return createLogFile(_fileName) && openFile(_fileName, false);
+}
+
+
+// Sets how long lines can wait in the buffer before being written to the card
+void Logger::setSDFlushInterval(uint32_t flushIntervalSeconds) {
+    // write out anything held under the old interval
+    if (flushIntervalSeconds == 0) { flushSDBuffer(); }
+    _sdFlushInterval = flushIntervalSeconds;
+}
+
+
+// Starts a new auto-named file when the date changes
+bool Logger::checkFileRollover(void) {
+    if (!_autoFileName) { return true; }
+    String today = formatDateTime_ISO8601(getNowLocalEpoch()).substring(0, 10);
+    if (_fileName.indexOf("_" + today + ".") >= 0) { return true; }
+
+    PRINTOUT(F("Date has changed, closing"), _fileName);
+    flushSDBuffer();
+    if (_preallocateRecordBytes > 0) { truncateLogFile(_fileName); }
+    generateAutoFileName();
+    return createLogFile();
+}
+
+
+// Finds the first zero byte after the data in a preallocated file
+uint32_t Logger::findDataEnd(File& file) {
+    if (_binaryRecordSize > 0) { return findBinaryDataEnd(file); }
+    // The data never contains a zero, but only the space just past the data
+    // is sure to be zeroed, so read forward from the start to the first zero
+    uint8_t  sector[512];
+    uint32_t position = 0;
+    int      count    = 0;
+    if (!file.seekSet(0)) { return 0; }
+    while ((count = file.read(sector, sizeof(sector))) > 0) {
+        const uint8_t* zero = static_cast<const uint8_t*>(
+            memchr(sector, 0, count));
+        if (zero != nullptr) { return position + (zero - sector); }
+        position += count;
+    }
+    return position;
+}
+
+
+// Finds the first empty record after the data in a preallocated binary file
+uint32_t Logger::findBinaryDataEnd(File& file) {
+    if (file.fileSize() <= _binaryHeaderSize) { return file.fileSize(); }
+    // Binary records contain zeros, but never start with four of them, so
+    // step forward a whole record at a time
+    uint32_t records = (file.fileSize() - _binaryHeaderSize) /
+        _binaryRecordSize;
+    uint32_t record  = 0;
+    for (; record < records; record++) {
+        uint8_t start[4] = {0, 0, 0, 0};
+        if (!file.seekSet(_binaryHeaderSize + record * _binaryRecordSize) ||
+            file.read(start, 4) != 4) {
+            break;
+        }
+        if ((start[0] | start[1] | start[2] | start[3]) == 0) { break; }
+    }
+    return _binaryHeaderSize + record * _binaryRecordSize;
+}
+
+
+// Zeroes the space in a preallocated file that the next write will reach, and
+// a little past it, so the end of the data can always be found.  It's done
+// before the write, so a write cut short still leaves zeros after the data.
+void Logger::zeroAhead(String& filename, uint32_t length) {
+    if (_preallocateRecordBytes == 0) { return; }
+    bool     current  = filename == _fileName;
+    uint32_t dataEnd  = logFile.curPosition();
+    uint32_t zeroedTo = current && _zeroedTo > dataEnd ? _zeroedTo : dataEnd;
+    uint32_t fileSize = logFile.fileSize();
+    // A sector of zeros past the new data covers the start of a binary
+    // record as well as a line
+    uint32_t needed = dataEnd + length + 512;
+    if (zeroedTo >= needed || zeroedTo >= fileSize) { return; }
+
+    // Zero a few sectors at a time so it's spread over the day
+    uint32_t end = ((needed + 511) & ~static_cast<uint32_t>(511)) +
+        LOGGER_SD_ZERO_AHEAD_BYTES;
+    if (end > fileSize) { end = fileSize; }
+    static const uint8_t zeros[512] = {0};
+    logFile.seekSet(zeroedTo);
+    while (zeroedTo < end) {
+        uint32_t count = end - zeroedTo;
+        if (count > sizeof(zeros)) { count = sizeof(zeros); }
+        if (logFile.write(zeros, count) != count) { break; }
+        zeroedTo += count;
+    }
+    logFile.seekSet(dataEnd);
+    if (current) { _zeroedTo = zeroedTo; }
+}
+
+
+// Keeps where the data in the current file ends after a write, or forgets it
+// if the write failed
+void Logger::noteDataEnd(String& filename, bool success) {
+    if (filename != _fileName) { return; }
+    _dataEnd = success ? logFile.curPosition() : 0;
+}
+
+
+// Cuts the unused preallocated space off the end of a file
+bool Logger::truncateLogFile(String& filename) {
+    // Opening the file leaves it at the end of the data
+    if (!openFile(filename, false)) { return false; }
+    uint32_t dataEnd = logFile.curPosition();
+    bool     success = logFile.truncate(dataEnd);
+    logFile.close();
+    MS_DBG(F("Truncated"), filename, F("to"), dataEnd, F("bytes"));
+    return success;
+}
+
+
+// Writes all of the buffered lines to the current file in one go, initializing
+// the card again and retrying once if that fails
+bool Logger::flushSDBuffer(void) {
+    if (_sdBufferUsed == 0) { return true; }
+    bool success = false;
+    for (uint8_t attempt = 0; attempt < 2 && !success; attempt++) {
+        // The card may have been swapped or lost its state, so start it over
+        // before the second try
+        if (attempt > 0) {
+            PRINTOUT(F("Initializing the SD card again to retry the write"));
+            _sdCardReady = false;
+            _dataEnd     = 0;
+        }
+        if (!openLogFileForAppend()) { continue; }
+        zeroAhead(_fileName, _sdBufferUsed);
+        success = logFile.write(_sdBuffer, _sdBufferUsed) == _sdBufferUsed;
+        noteDataEnd(_fileName, success);
+        setFileTimestamp(logFile, T_WRITE | T_ACCESS);
+        logFile.close();
+    }
+    if (!success) {
+        PRINTOUT(F("Unable to write buffered lines to SD card!"));
+        return false;
+    }
+    MS_DBG(F("Wrote"), _sdBufferUsed, F("buffered bytes to"), _fileName);
+    _sdBufferUsed = 0;
+    return true;
 }
 
 // ===================================================================== //
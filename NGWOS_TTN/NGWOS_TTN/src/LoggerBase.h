@@ -55,6 +55,43 @@
 
 #include <SdFat.h>  // To communicate with the SD card
 
+#ifndef LOGGER_SD_BUFFER_SIZE
+/**
+ * @brief The size of the RAM buffer for lines waiting to be written to the SD
+ * card.
+ *
+ * This should be a multiple of the 512 byte SD card sector size.
+ */
+#define LOGGER_SD_BUFFER_SIZE 2048
+#endif
+
+#ifndef LOGGER_SD_ZERO_AHEAD_BYTES
+/**
+ * @brief How far past the data to zero a preallocated file each time the data
+ * gets close to the end of the zeros.
+ *
+ * This should be a multiple of the 512 byte SD card sector size.
+ */
+#define LOGGER_SD_ZERO_AHEAD_BYTES 2048
+#endif
+
+#ifndef LOGGER_MIN_SLEEP_SECONDS
+/**
+ * @brief The fewest seconds before the next logging interval that the logger
+ * will set the RTC alarm and go to sleep; any closer and it stays awake.
+ */
+#define LOGGER_MIN_SLEEP_SECONDS 2
+#endif
+
+#ifndef LOGGER_MIN_SLEEP_MS
+/**
+ * @brief The shortest wait, in milliseconds, that Logger::sleepFor() will
+ * sleep through; anything shorter isn't worth stopping and restarting I2C and
+ * USB for, so it's waited out awake.
+ */
+#define LOGGER_MIN_SLEEP_MS 250
+#endif
+
 
 /**
  * @brief The "Logger" Class handles low power sleep for the main processor,
@@ -615,18 +652,77 @@ class Logger {
      */
     static void wakeISR(void);
 
+    /**
+     * @brief Set the RTC alarm for the start of the next logging interval.
+     *
+     * The logger then sleeps straight through to the next interval instead
+     * of waking every minute.  Intervals are aligned the same way as
+     * checkInterval() expects.
+     *
+     * @return True if the alarm was set; false if the next interval is too
+     * close to be sure of catching it, so the logger should stay awake.
+     */
+    bool setAlarmForNextInterval(void);
+
     /**
      * @brief Put the mcu to sleep to conserve battery life and handle
      * post-interrupt wake actions
      *
+     * The RTC alarm wakes the mcu at the start of the next logging interval;
+     * an interrupt on any other pin, like a button, also wakes it.  If the
+     * next interval is less than LOGGER_MIN_SLEEP_SECONDS away, this returns
+     * without sleeping.
+     *
      * @note This DOES NOT sleep or wake the sensors!!
      */
     void systemSleep(void);
+
+    /**
+     * @brief Put the mcu to sleep for a set time, instead of busy-waiting.
+     *
+     * This is for waits in the middle of a reading, like a sensor warming up,
+     * where nothing needs the processor until the time is up.  The RV-8803
+     * countdown timer wakes the mcu, in steps of 1/64 of a second, or of a
+     * second for waits over a minute.  Any other interrupt that wakes the
+     * mcu, like a button, ends that step early.  The watch-dog is stopped
+     * while asleep and restarted with a full count on waking, so a long wait
+     * can't set it off.  Any part of the wait shorter than
+     * LOGGER_MIN_SLEEP_MS, or the whole wait if there's no wake pin, is spent
+     * awake with the watch-dog reset as it goes.
+     *
+     * @note millis() and micros() stop while the mcu sleeps, so anything
+     * timing the wait with them should add the time returned.
+     *
+     * @param ms The time to wait, in milliseconds
+     * @return The part of the wait, in milliseconds, spent asleep
+     */
+    uint32_t sleepFor(uint32_t ms);
+
     /**
      * @brief A watch-dog implementation to use to reboot the system in case of
      * lock-ups
      */
     extendedWatchDogSAMD watchDogTimer;
+
+ protected:
+    /**
+     * @brief Put the mcu in standby until the wake pin interrupts.
+     *
+     * Whatever RTC interrupt is to wake the mcu must already be set; this
+     * stops I2C, USB and the watch-dog around the sleep and restarts them
+     * after.
+     */
+    void sleepUntilInterrupt(void);
+    /**
+     * @brief Get the RTC's time to the hundredth of a second, in
+     * milliseconds.
+     *
+     * Only differences between two calls mean anything; it's used to time a
+     * sleep that ended early, since millis() stops while the mcu sleeps.
+     *
+     * @return The RTC time, in milliseconds, wrapping around
+     */
+    uint32_t getRTCMillis(void);
     /**@}*/
 
     // ===================================================================== //
@@ -697,6 +793,61 @@ class Logger {
      */
     bool createLogFile();
 
+    /**
+     * @brief Set a header line to write at the top of every new file.
+     *
+     * The header is only written when createLogFile() makes a new file, so it
+     * is not repeated when the logger restarts and opens an existing file.
+     *
+     * @param header The header line
+     */
+    void setFileHeader(String& header) {
+        _fileHeader = header;
+    }
+    /**
+     * @copydoc Logger::setFileHeader(String& header)
+     */
+    void setFileHeader(const char* header) {
+        _fileHeader = header;
+    }
+
+    /**
+     * @brief Set the space to preallocate in each new file for every record
+     * in a day.
+     *
+     * With a size of 0 (the default), files grow one line at a time, so the
+     * card has to allocate clusters and update the directory throughout the
+     * day.  Otherwise, createLogFile() reserves one contiguous extent big
+     * enough for a day of records at the logging interval, so every line
+     * after that is written in place.  Rather than zeroing the whole extent
+     * at once, the space just past the data is zeroed
+     * #LOGGER_SD_ZERO_AHEAD_BYTES at a time as the data reaches it.  The
+     * unused space is cut off the end of the file when the logger rolls over
+     * to a new file at midnight; a file that was being written when the
+     * logger lost power or was restarted keeps it, and programs reading the
+     * file should stop at the first zero byte (or, for binary files, the
+     * first record starting with zeros).  Binary files reserve space by their
+     * record size instead of recordBytes.
+     *
+     * @param recordBytes The expected length of each line, in bytes
+     */
+    void setFilePreallocation(uint16_t recordBytes) {
+        _preallocateRecordBytes = recordBytes;
+    }
+
+    /**
+     * @brief Start a new file when the date has changed since the current
+     * auto-named file was made.
+     *
+     * Anything buffered for the old file is written to it and its unused
+     * preallocated space is cut off first.  This is called by logToSD(rec), so
+     * it only needs to be called directly to roll over without logging a line.
+     * It does nothing if the file name was set with setFileName().
+     *
+     * @return True if the current file is ready to write to
+     */
+    bool checkFileRollover(void);
+
     /**
      * @brief Open a file with the given name on the SD card and append the
      * given line to the bottom of it.
@@ -724,6 +875,96 @@ class Logger {
      * _and_ data appended to it.
      */
     bool logToSD(String& rec);
+    /**
+     * @copydoc Logger::logToSD(String& rec)
+     *
+     * When buffering, the line is copied straight into the buffer without
+     * making a String.
+     */
+    bool logToSD(const char* rec);
+    /**
+     * @brief Append one binary record to the current file.
+     *
+     * The record must be the size given to setBinaryFormat(), and its first
+     * four bytes must not all be zero - a timestamp is a good choice.
+     *
+     * @param record The record to write
+     * @return True if the record was buffered or written
+     */
+    bool logToSD(const uint8_t* record);
+
+    /**
+     * @brief Save fixed-size binary records instead of lines of text.
+     *
+     * The header is written at the start of each new file in place of the
+     * text header, and files get a ".bin" extension instead of ".csv".  The
+     * header is not copied, so it must stay valid.  Call this before the file
+     * is created.
+     *
+     * @param header The header to write at the start of each file
+     * @param headerSize The number of bytes in the header
+     * @param recordSize The number of bytes in each record; 0 to go back to
+     * text
+     */
+    void setBinaryFormat(const uint8_t* header, uint16_t headerSize,
+                         uint16_t recordSize);
+
+    /**
+     * @brief Set how long lines can be held in RAM before they are written to
+     * the SD card.
+     *
+     * With an interval of 0 (the default), every line is written to the card
+     * as soon as it is logged.  Otherwise, logToSD(rec) adds lines to a buffer
+     * of #LOGGER_SD_BUFFER_SIZE bytes, and the whole buffer is written to the
+     * card at once when the next line will not fit in it or when the oldest
+     * line in it is this old.
+     *
+     * @note Lines in the buffer are lost if the logger resets or loses power
+     * before they are written.  Call flushSDBuffer() before anything that
+     * might leave the logger without power.
+     *
+     * @param flushIntervalSeconds The longest to hold a line in RAM, in
+     * seconds
+     */
+    void setSDFlushInterval(uint32_t flushIntervalSeconds);
+    /**
+     * @brief Get how long lines can be held in RAM before they are written to
+     * the SD card.
+     *
+     * @return The longest to hold a line in RAM, in seconds
+     */
+    uint32_t getSDFlushInterval(void) {
+        return _sdFlushInterval;
+    }
+    /**
+     * @brief Write all of the lines waiting in the buffer to the current file
+     * on the SD card.
+     *
+     * If the write fails, the card is initialized again and the write is
+     * tried once more before giving up.  The lines stay in the buffer until
+     * they are written.
+     *
+     * @return True if the buffer is empty afterwards
+     */
+    bool flushSDBuffer(void);
+    /**
+     * @brief Get the number of bytes waiting in the buffer to be written to
+     * the SD card.
+     *
+     * @return The number of bytes waiting
+     */
+    uint16_t getSDBufferUsed(void) {
+        return _sdBufferUsed;
+    }
+    /**
+     * @brief Get the number of lines (or binary records) that could not be
+     * saved to the SD card since the logger started.
+     *
+     * @return The number of lines dropped
+     */
+    uint32_t getSDLinesDropped(void) {
+        return _sdLinesDropped;
+    }
 
     // The SD card and file
     /**
@@ -739,12 +980,74 @@ class Logger {
      */
     String _fileName = "";
     // ^^ Initialize with no file name
+    /**
+     * @brief Lines waiting to be written to the SD card
+     */
+    char _sdBuffer[LOGGER_SD_BUFFER_SIZE];
+    /**
+     * @brief The number of bytes waiting in the SD card buffer
+     */
+    uint16_t _sdBufferUsed = 0;
+    /**
+     * @brief The local epoch time the oldest line in the buffer was logged
+     */
+    uint32_t _sdBufferStart = 0;
+    /**
+     * @brief The longest to hold a line in the buffer, in seconds; 0 to write
+     * every line immediately
+     */
+    uint32_t _sdFlushInterval = 0;
+    /**
+     * @brief The number of lines that could not be saved to the SD card
+     */
+    uint32_t _sdLinesDropped = 0;
+    /**
+     * @brief True if the SD card has been initialized and not powered off
+     * since
+     */
+    bool _sdCardReady = false;
+    /**
+     * @brief The header line written at the top of every new file
+     */
+    String _fileHeader = "";
+    /**
+     * @brief The expected length of each line, for preallocating files; 0 to
+     * not preallocate
+     */
+    uint16_t _preallocateRecordBytes = 0;
+    /**
+     * @brief The end of the data in the current preallocated file; 0 if it
+     * hasn't been found yet
+     */
+    uint32_t _dataEnd = 0;
+    /**
+     * @brief How far the current preallocated file is known to be zeroed
+     */
+    uint32_t _zeroedTo = 0;
+    /**
+     * @brief The header written at the start of each binary file
+     */
+    const uint8_t* _binaryHeader = nullptr;
+    /**
+     * @brief The number of bytes in the binary header
+     */
+    uint16_t _binaryHeaderSize = 0;
+    /**
+     * @brief The number of bytes in each binary record; 0 to save text
+     */
+    uint16_t _binaryRecordSize = 0;
+    /**
+     * @brief True if the file name was generated from the logger id and date,
+     * and should roll over with the date
+     */
+    bool _autoFileName = false;
 
     /**
      * @brief Check if the SD card is available and ready to write to.
      *
      * We run this check before every communication with the SD card to prevent
-     * hanging.
+     * hanging.  The card is only initialized again after it has been powered
+     * off or a file on it could not be opened.
      *
      * @return True if the SD card is ready
      */
@@ -775,6 +1078,71 @@ class Logger {
      * @return True if a file was successfully opened or created.
      */
     bool openFile(String& filename, bool createFile);
+
+    /**
+     * @brief Find the end of the data in a preallocated file - the first of
+     * the zeros after the data.
+     *
+     * Only the space just past the data is sure to be zeroed, so this reads
+     * forward from the start of the file.  openFile() keeps the result for
+     * the current file, so it's only searched once.
+     *
+     * @param file The open file to search
+     * @return The length of the data in the file
+     */
+    uint32_t findDataEnd(File& file);
+    /**
+     * @brief Find the end of the data in a preallocated binary file - the
+     * first record that starts with four zeros.
+     *
+     * @param file The open file to search
+     * @return The length of the data in the file
+     */
+    uint32_t findBinaryDataEnd(File& file);
+    /**
+     * @brief Zero the space in the open preallocated file that the next write
+     * will reach, and a sector past it, if it isn't already.  The file is
+     * left where it was.
+     *
+     * @param filename The name of the open file
+     * @param length The number of bytes about to be written
+     */
+    void zeroAhead(String& filename, uint32_t length);
+    /**
+     * @brief Keep the position of the open file as the end of the data in the
+     * current file after a write.
+     *
+     * @param filename The name of the open file
+     * @param success False if the write failed, to search for the end again
+     */
+    void noteDataEnd(String& filename, bool success);
+    /**
+     * @brief Add data to the buffer for the SD card.
+     *
+     * The buffer is written out first if the data won't fit in it, and
+     * afterwards if the oldest data in it has waited for the flush interval.
+     *
+     * @param data The data to add
+     * @param length The number of bytes to add
+     * @param addLineEnd True to add a carriage return and new line after the
+     * data
+     * @return True if the data was added
+     */
+    bool bufferForSD(const uint8_t* data, uint16_t length, bool addLineEnd);
+    /**
+     * @brief Open the current file to add to it, creating it with its header
+     * if it does not exist yet.
+     *
+     * @return True if the file is open
+     */
+    bool openLogFileForAppend(void);
+    /**
+     * @brief Cut the unused preallocated space off the end of a file.
+     *
+     * @param filename The name of the file to truncate
+     * @return True if the file was truncated
+     */
+    bool truncateLogFile(String& filename);
     /**@}*/
 
     // ===================================================================== //
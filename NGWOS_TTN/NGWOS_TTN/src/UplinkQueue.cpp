@@ -0,0 +1,159 @@
+/**
+ * @file UplinkQueue.cpp
+ * @copyright Stroud Water Research Center
+ * This library is published under the BSD-3 license.
+ *
+ * @brief Implements the UplinkQueue class.
+ */
+
+#include "UplinkQueue.h"
+
+// The queue file starts with a magic number, the capacity, the slot of the
+// oldest frame and the number of frames, padded out to this size
+#define UPLINK_QUEUE_HEADER_SIZE 16
+static const uint8_t uplinkQueueMagic[4] = {'U', 'P', 'Q', '1'};
+
+
+UplinkQueue::UplinkQueue(Logger& logger, const char* fileName,
+                         uint16_t capacity, drainOrder order)
+    : _logger(logger),
+      _fileName(fileName),
+      _capacity(capacity),
+      _order(order),
+      _head(0),
+      _count(0),
+      _begun(false) {}
+UplinkQueue::~UplinkQueue() {}
+
+
+bool UplinkQueue::begin(void) {
+    if (!openQueueFile()) {
+        PRINTOUT(F("Unable to open the uplink queue file!"));
+        return false;
+    }
+
+    uint8_t header[UPLINK_QUEUE_HEADER_SIZE];
+    bool    valid = _queueFile.fileSize() >= UPLINK_QUEUE_HEADER_SIZE &&
+        _queueFile.seekSet(0) &&
+        _queueFile.read(header, UPLINK_QUEUE_HEADER_SIZE) ==
+            UPLINK_QUEUE_HEADER_SIZE &&
+        memcmp(header, uplinkQueueMagic, 4) == 0;
+    if (valid) {
+        uint16_t capacity = (header[4] << 8) | header[5];
+        _head             = (header[6] << 8) | header[7];
+        _count            = (header[8] << 8) | header[9];
+        valid = capacity == _capacity && _head < _capacity &&
+            _count <= _capacity;
+    }
+
+    bool success = true;
+    if (!valid) {
+        // Start over with an empty queue
+        MS_DBG(F("Starting a new uplink queue in"), _fileName);
+        _head  = 0;
+        _count = 0;
+        success &= _queueFile.truncate(0);
+        success &= writeHeader();
+    }
+    _queueFile.close();
+
+    _begun = success;
+    PRINTOUT(_count, F("frames waiting in the uplink queue"));
+    return success;
+}
+
+
+bool UplinkQueue::push(const uint8_t* frame, uint8_t size) {
+    if (!_begun && !begin()) { return false; }
+    if (size == 0 || size > UPLINK_QUEUE_SLOT_SIZE - 1) { return false; }
+    if (!openQueueFile()) { return false; }
+
+    // Write the whole slot so the file never has a gap in it; the SD card
+    // writes a full block either way
+    uint8_t slotBuffer[UPLINK_QUEUE_SLOT_SIZE] = {0};
+    slotBuffer[0]                              = size;
+    memcpy(slotBuffer + 1, frame, size);
+    uint16_t slot = (_head + _count) % _capacity;
+    bool success  = _queueFile.seekSet(slotPosition(slot)) &&
+        _queueFile.write(slotBuffer, UPLINK_QUEUE_SLOT_SIZE) ==
+            UPLINK_QUEUE_SLOT_SIZE;
+    if (success) {
+        if (_count < _capacity) {
+            _count++;
+        } else {
+            // The ring was full, so we just overwrote the oldest frame
+            _head = (_head + 1) % _capacity;
+            MS_DBG(F("Uplink queue is full, dropped the oldest frame"));
+        }
+        success = writeHeader();
+    }
+    _queueFile.close();
+
+    MS_DBG(F("Queued a frame of"), size, F("bytes,"), _count,
+           F("frames now waiting"));
+    return success;
+}
+
+
+uint8_t UplinkQueue::peek(uint8_t* frame, uint8_t maxSize) {
+    if (!_begun && !begin()) { return 0; }
+    if (_count == 0) { return 0; }
+    if (!openQueueFile()) { return 0; }
+
+    uint8_t size = 0;
+    if (!_queueFile.seekSet(slotPosition(nextSlot())) ||
+        _queueFile.read(&size, 1) != 1 || size > maxSize ||
+        _queueFile.read(frame, size) != size) {
+        size = 0;
+    }
+    _queueFile.close();
+    return size;
+}
+
+
+bool UplinkQueue::pop(void) {
+    if (_count == 0) { return false; }
+    if (!openQueueFile()) { return false; }
+
+    if (_order == OLDEST_FIRST) { _head = (_head + 1) % _capacity; }
+    _count--;
+    bool success = writeHeader();
+    _queueFile.close();
+    return success;
+}
+
+
+bool UplinkQueue::openQueueFile(void) {
+    // skip everything else if there's no SD card, otherwise it might hang
+    if (!_logger.initializeSDCard()) { return false; }
+    return _queueFile.open(_fileName, O_RDWR | O_CREAT);
+}
+
+
+bool UplinkQueue::writeHeader(void) {
+    uint8_t header[UPLINK_QUEUE_HEADER_SIZE] = {0};
+    memcpy(header, uplinkQueueMagic, 4);
+    header[4] = _capacity >> 8;
+    header[5] = _capacity & 0xFF;
+    header[6] = _head >> 8;
+    header[7] = _head & 0xFF;
+    header[8] = _count >> 8;
+    header[9] = _count & 0xFF;
+    return _queueFile.seekSet(0) &&
+        _queueFile.write(header, UPLINK_QUEUE_HEADER_SIZE) ==
+        UPLINK_QUEUE_HEADER_SIZE;
+}
+
+
+uint16_t UplinkQueue::nextSlot(void) {
+    if (_order == NEWEST_FIRST) {
+        return (_head + _count - 1) % _capacity;
+    }
+    return _head;
+}
+
+
+uint32_t UplinkQueue::slotPosition(uint16_t slot) {
+    return UPLINK_QUEUE_HEADER_SIZE +
+        static_cast<uint32_t>(slot) * UPLINK_QUEUE_SLOT_SIZE;
+}
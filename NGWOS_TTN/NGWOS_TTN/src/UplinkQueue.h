@@ -0,0 +1,172 @@
+/**
+ * @file UplinkQueue.h
+ * @copyright Stroud Water Research Center
+ * This library is published under the BSD-3 license.
+ *
+ * @brief Contains the UplinkQueue class, a store-and-forward queue of LoRa
+ * frames kept on the SD card.
+ */
+
+// Header Guards
+#ifndef SRC_UPLINKQUEUE_H_
+#define SRC_UPLINKQUEUE_H_
+
+// Debugging Statement
+// #define MS_UPLINKQUEUE_DEBUG
+
+#ifdef MS_UPLINKQUEUE_DEBUG
+#define MS_DEBUGGING_STD "UplinkQueue"
+#endif
+
+// Included Dependencies
+#include "ModSensorDebugger.h"
+#undef MS_DEBUGGING_STD
+#include "LoggerBase.h"
+
+/**
+ * @brief The size of each slot in the queue file.  The first byte of each slot
+ * is the length of the frame in it, so the largest frame that can be queued is
+ * one byte less than this.
+ */
+#define UPLINK_QUEUE_SLOT_SIZE 256
+
+/**
+ * @brief The UplinkQueue class keeps LoRa frames that could not be sent in a
+ * ring of fixed-size slots in a single file on the SD card, so they can be
+ * sent on later cycles once the network is back.
+ *
+ * The file starts with a small header holding the position of the oldest
+ * frame and the number of frames waiting; it is rewritten after every change
+ * so the queue survives a reset or a power loss.  When the ring is full, the
+ * oldest frame is overwritten.
+ *
+ * Frames are taken from the queue oldest-first or newest-first depending on
+ * the drain order.  Newest-first gets the current state of the site to the
+ * network soonest after an outage; oldest-first fills the gap in order.
+ *
+ * Like the log file, the file is opened and closed for every operation, so
+ * the SD card must be powered whenever the queue is used.
+ *
+ * @ingroup base_classes
+ */
+class UplinkQueue {
+ public:
+    /**
+     * @brief The order frames are taken from the queue.
+     */
+    typedef enum drainOrder {
+        OLDEST_FIRST = 0,  ///< First in, first out
+        NEWEST_FIRST       ///< Last in, first out
+    } drainOrder;
+
+    /**
+     * @brief Construct a new Uplink Queue object.
+     *
+     * @param logger The logger whose SD card holds the queue
+     * @param fileName The name of the queue file
+     * @param capacity The most frames to keep
+     * @param order The order to take frames from the queue
+     */
+    UplinkQueue(Logger& logger, const char* fileName = "UPLINKQ.BIN",
+                uint16_t capacity = 1024, drainOrder order = OLDEST_FIRST);
+    /**
+     * @brief Destroy the Uplink Queue object
+     */
+    ~UplinkQueue();
+
+    /**
+     * @brief Read the state of the queue from the SD card, creating the queue
+     * file if it does not already exist.
+     *
+     * If the file was made with a different capacity, it is started over
+     * empty.
+     *
+     * @return True if the queue file could be read or created
+     */
+    bool begin(void);
+
+    /**
+     * @brief Add a frame to the queue, overwriting the oldest frame if the
+     * queue is full.
+     *
+     * @param frame The frame to add
+     * @param size The number of bytes in the frame
+     * @return True if the frame was saved
+     */
+    bool push(const uint8_t* frame, uint8_t size);
+
+    /**
+     * @brief Copy the next frame to send into a buffer, without removing it
+     * from the queue.
+     *
+     * @param frame A buffer for the frame
+     * @param maxSize The size of the buffer
+     * @return The number of bytes in the frame; 0 if the queue is empty or the
+     * frame could not be read
+     */
+    uint8_t peek(uint8_t* frame, uint8_t maxSize);
+
+    /**
+     * @brief Remove the frame last returned by peek() from the queue.
+     *
+     * @return True if a frame was removed
+     */
+    bool pop(void);
+
+    /**
+     * @brief Get the number of frames waiting in the queue.
+     *
+     * @return The number of frames waiting
+     */
+    uint16_t getCount(void) {
+        return _count;
+    }
+
+    /**
+     * @brief Set the order to take frames from the queue.
+     *
+     * @param order The order to take frames from the queue
+     */
+    void setDrainOrder(drainOrder order) {
+        _order = order;
+    }
+
+ protected:
+    /**
+     * @brief Open the queue file for reading and writing.
+     *
+     * @return True if the file was opened
+     */
+    bool openQueueFile(void);
+    /**
+     * @brief Write the position of the oldest frame and the number of frames
+     * to the start of the open queue file.
+     *
+     * @return True if the header was written
+     */
+    bool writeHeader(void);
+    /**
+     * @brief Get the slot of the next frame to send.
+     *
+     * @return The slot number
+     */
+    uint16_t nextSlot(void);
+    /**
+     * @brief Get the position of a slot in the queue file.
+     *
+     * @param slot The slot number
+     * @return The byte offset of the slot
+     */
+    uint32_t slotPosition(uint16_t slot);
+
+    Logger&     _logger;
+    const char* _fileName;
+    uint16_t    _capacity;
+    drainOrder  _order;
+    uint16_t    _head;   // the slot of the oldest frame
+    uint16_t    _count;  // the number of frames waiting
+    bool        _begun;
+    File        _queueFile;
+};
+
+#endif  // SRC_UPLINKQUEUE_H_
@@ -161,6 +161,15 @@ void extendedWatchDogSAMD::disableWatchDog() {
 }
 
 
+bool extendedWatchDogSAMD::isWatchDogEnabled() {
+#if defined(__SAMD51__)
+    return WDT->CTRLA.bit.ENABLE;
+#else
+    return WDT->CTRL.bit.ENABLE;
+#endif
+}
+
+
 void extendedWatchDogSAMD::resetWatchDog() {
     extendedWatchDogSAMD::_barksUntilReset = _resetTime_s / 8;
     // Write the watchdog clear key value (0xA5) to the watchdog
@@ -69,6 +69,12 @@ class extendedWatchDogSAMD {
      * @brief Disable the watchdog.
      */
     void disableWatchDog();
+    /**
+     * @brief Check whether the watchdog is running.
+     *
+     * @return True if the watchdog is enabled.
+     */
+    bool isWatchDogEnabled();
 
     /**
      * @brief Reset the watchdog's clock to prevent the board from resetting.
@@ -0,0 +1,140 @@
+#!/usr/bin/env python3
+"""Converts binary SD card log files back into the logger's CSV layout.
+
+The logger writes binary files when USE_BINARY_LOG is defined in
+NGWOS_TTN.ino.  The format is described in BinaryLogRecord.h.
+
+Usage:
+    python3 binary_log_to_csv.py 24008_2024-06-01.bin [more.bin ...]
+
+Each file is written next to the original with a ".csv" extension.  Use "-" as
+the only file name to read from stdin and write to stdout.
+"""
+
+import datetime
+import math
+import struct
+import sys
+
+MAGIC = b"NGWB"
+FIXED_HEADER = struct.Struct("<4sBBHHhB")
+INTEGER = 0xFF
+NO_DATA = -9999
+
+
+def read_name(data, position):
+    length = data[position]
+    position += 1
+    return data[position : position + length].decode("ascii"), position + length
+
+
+def parse_header(data):
+    (
+        magic,
+        version,
+        n_channels,
+        header_size,
+        record_size,
+        tz_minutes,
+        frame_bytes,
+    ) = FIXED_HEADER.unpack_from(data)
+    if magic != MAGIC:
+        raise ValueError("not a binary log file")
+    if version != 1:
+        raise ValueError("unsupported binary log version %d" % version)
+    position = FIXED_HEADER.size
+    frame_name, position = read_name(data, position)
+    channels = []
+    for _ in range(n_channels):
+        decimals = data[position]
+        name, position = read_name(data, position + 1)
+        channels.append((name, decimals))
+    return {
+        "header_size": header_size,
+        "record_size": record_size,
+        "tz_minutes": tz_minutes,
+        "frame_bytes": frame_bytes,
+        "frame_name": frame_name,
+        "channels": channels,
+    }
+
+
+def format_time(epoch, tz_minutes):
+    # matches RV8803::stringTime8601TZ()
+    local = datetime.datetime(1970, 1, 1) + datetime.timedelta(
+        seconds=epoch + tz_minutes * 60
+    )
+    sign = "-" if tz_minutes < 0 else "+"
+    offset = abs(tz_minutes)
+    return "%s%s%02d:%02d" % (
+        local.strftime("%Y-%m-%dT%H:%M:%S"),
+        sign,
+        offset // 60,
+        offset % 60,
+    )
+
+
+def format_value(value, decimals):
+    # missing values are written as a bare -9999 by the logger
+    if value == NO_DATA:
+        return "-9999"
+    if decimals == INTEGER:
+        return "%d" % value
+    # matches String(float, decimals), which pads to decimals + 2 characters
+    if math.isnan(value):
+        return "%*s" % (decimals + 2, "nan")
+    return "%*.*f" % (decimals + 2, decimals, value)
+
+
+def convert(data, out):
+    header = parse_header(data)
+    channels = header["channels"]
+    values = struct.Struct("<I%df" % len(channels))
+    record_size = header["record_size"]
+    tz_minutes = header["tz_minutes"]
+
+    columns = ["Time", "Unix Timestamp"] + [name for name, _ in channels]
+    out.write(",".join(columns + [header["frame_name"]]) + "\r\n")
+
+    n_records = 0
+    last_start = len(data) - record_size
+    for start in range(header["header_size"], last_start + 1, record_size):
+        unpacked = values.unpack_from(data, start)
+        epoch = unpacked[0]
+        # the rest of the file is unused preallocated space
+        if epoch == 0:
+            break
+        frame_start = start + values.size
+        frame_size = data[frame_start]
+        frame = data[frame_start + 1 : frame_start + 1 + frame_size]
+        fields = [format_time(epoch, tz_minutes), str(epoch)]
+        fields += [
+            format_value(value, decimals)
+            for value, (_, decimals) in zip(unpacked[1:], channels)
+        ]
+        fields.append(frame.hex())
+        out.write(",".join(fields) + "\r\n")
+        n_records += 1
+    return n_records
+
+
+def main(argv):
+    if len(argv) < 2:
+        sys.stderr.write(__doc__)
+        return 1
+    if argv[1:] == ["-"]:
+        convert(sys.stdin.buffer.read(), sys.stdout)
+        return 0
+    for path in argv[1:]:
+        with open(path, "rb") as f:
+            data = f.read()
+        out_path = path[: -len(".bin")] if path.endswith(".bin") else path
+        out_path += ".csv"
+        with open(out_path, "w", newline="") as out:
+            n_records = convert(data, out)
+        print("%s: %d records -> %s" % (path, n_records, out_path))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
@@ -0,0 +1,96 @@
+#!/usr/bin/env python3
+"""Summarizes how long each part of the logger's readings took.
+
+The logger saves the times when USE_CYCLE_PROFILE is defined in NGWOS_TTN.ino.
+Each record holds the times of the reading before it, in milliseconds.
+
+Usage:
+    python3 cycle_profile_summary.py 24008_2024-06-01.csv [more.csv ...]
+
+Binary ".bin" files can be read directly.  The times from all of the files
+are summarized together.
+"""
+
+import csv
+import io
+import os
+import sys
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import binary_log_to_csv  # noqa: E402
+
+PREFIX = "Previous Cycle "
+NO_DATA = -9999
+PERCENTILES = (50, 90, 99)
+
+
+def read_rows(path):
+    if path.endswith(".bin"):
+        with open(path, "rb") as f:
+            data = f.read()
+        text = io.StringIO()
+        binary_log_to_csv.convert(data, text)
+        text.seek(0)
+        return list(csv.reader(text))
+    with open(path, "rb") as f:
+        data = f.read()
+    # files that were being written when the logger restarted end in the
+    # unused part of their preallocated space, which starts with a zero
+    text = data.split(b"\0", 1)[0].decode("utf-8", "replace")
+    return list(csv.reader(io.StringIO(text, newline="")))
+
+
+def collect(paths):
+    times = {}
+    for path in paths:
+        rows = read_rows(path)
+        if not rows:
+            continue
+        columns = [
+            (i, name[len(PREFIX) :])
+            for i, name in enumerate(rows[0])
+            if name.startswith(PREFIX)
+        ]
+        for row in rows[1:]:
+            for i, name in columns:
+                if i >= len(row):
+                    continue
+                value = float(row[i])
+                if value != NO_DATA:
+                    times.setdefault(name, []).append(value)
+    return times
+
+
+def percentile(values, percent):
+    # nearest rank
+    rank = max(1, -(-len(values) * percent // 100))
+    return values[int(rank) - 1]
+
+
+def summarize(times, out):
+    headers = ["Phase", "Count", "Mean", "Min"]
+    headers += ["P%d" % p for p in PERCENTILES] + ["Max"]
+    out.write("%-22s" % headers[0] + "".join("%10s" % h for h in headers[1:]))
+    out.write("\n")
+    for name, values in times.items():
+        values = sorted(values)
+        stats = [sum(values) / len(values), values[0]]
+        stats += [percentile(values, p) for p in PERCENTILES] + [values[-1]]
+        out.write("%-22s%10d" % (name, len(values)))
+        out.write("".join("%10.0f" % s for s in stats) + "\n")
+
+
+def main(argv):
+    if len(argv) < 2:
+        sys.stderr.write(__doc__)
+        return 1
+    times = collect(argv[1:])
+    if not times:
+        sys.stderr.write("No cycle times found - was USE_CYCLE_PROFILE on?\n")
+        return 1
+    summarize(times, sys.stdout)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
@@ -0,0 +1,369 @@
+// Header Guards
+#ifndef HOST_ARDUINO_H_
+#define HOST_ARDUINO_H_
+
+// A stand-in for the parts of the Arduino core used by the sketch's helper
+// headers, so they can be compiled and run on a computer.
+//
+// Time only passes on the host when the program waits for it: delay() and
+// delayMicroseconds() move the clock forward by the time asked for, yield()
+// moves it by a millisecond, and a simulated device can move it with
+// hostAdvanceMicros().  Nothing else takes any time, so every run is the same.
+//
+// Like the sketch's own headers, this defines its globals in the header, so
+// each test program must be a single .cpp file.
+
+#include <ctype.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+typedef uint8_t byte;
+typedef bool    boolean;
+
+#define F(text) text
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define INPUT_PULLDOWN 3
+#define DEC 10
+#define HEX 16
+#define A0 14
+
+// ==========================================================================
+// Time
+// ==========================================================================
+
+inline uint64_t& hostClockMicros() {
+    static uint64_t clock_us = 0;
+    return clock_us;
+}
+inline void hostAdvanceMicros(uint64_t us) {
+    hostClockMicros() += us;
+}
+inline uint32_t millis() {
+    return static_cast<uint32_t>(hostClockMicros() / 1000);
+}
+inline uint32_t micros() {
+    return static_cast<uint32_t>(hostClockMicros());
+}
+inline void delay(uint32_t ms) {
+    hostAdvanceMicros(static_cast<uint64_t>(ms) * 1000);
+}
+inline void delayMicroseconds(uint32_t us) {
+    hostAdvanceMicros(us);
+}
+inline void yield() {
+    hostAdvanceMicros(1000);
+}
+
+// ==========================================================================
+// Pins
+// ==========================================================================
+
+inline void pinMode(int, int) {}
+inline void digitalWrite(int, int) {}
+inline int  digitalRead(int) {
+    return LOW;
+}
+inline int analogRead(int) {
+    return 0;
+}
+inline void analogReadResolution(int) {}
+
+// ==========================================================================
+// String
+// ==========================================================================
+
+// Formats a float the way the SAMD core's dtostrf() does - with printf
+inline const char* dtostrf(double value, signed char width, unsigned char prec,
+                           char* out) {
+    sprintf(out, "%*.*f", width, prec, value);
+    return out;
+}
+
+/**
+ * @brief The Arduino String, with the same formatting rules as the SAMD core:
+ * String(float, n) is dtostrf(value, n + 2, n), += float is dtostrf(value, 4,
+ * 2), and numbers in other bases are lower case.
+ */
+class String {
+ public:
+    String(const char* text = "") : _text(text ? text : "") {}
+    String(const std::string& text) : _text(text) {}
+    String(char c) : _text(1, c) {}
+    explicit String(unsigned char value, unsigned char base = DEC)
+        : _text(fromUnsigned(value, base)) {}
+    explicit String(int value, unsigned char base = DEC)
+        : _text(fromSigned(value, base)) {}
+    explicit String(unsigned int value, unsigned char base = DEC)
+        : _text(fromUnsigned(value, base)) {}
+    explicit String(long value, unsigned char base = DEC)
+        : _text(fromSigned(value, base)) {}
+    explicit String(unsigned long value, unsigned char base = DEC)
+        : _text(fromUnsigned(value, base)) {}
+    explicit String(float value, unsigned char decimals = 2)
+        : _text(fromFloat(value, decimals + 2, decimals)) {}
+    explicit String(double value, unsigned char decimals = 2)
+        : _text(fromFloat(value, decimals + 2, decimals)) {}
+
+    String& operator+=(const String& other) {
+        _text += other._text;
+        return *this;
+    }
+    String& operator+=(const char* text) {
+        _text += text;
+        return *this;
+    }
+    String& operator+=(char c) {
+        _text += c;
+        return *this;
+    }
+    String& operator+=(unsigned char value) {
+        _text += fromUnsigned(value, DEC);
+        return *this;
+    }
+    String& operator+=(int value) {
+        _text += fromSigned(value, DEC);
+        return *this;
+    }
+    String& operator+=(unsigned int value) {
+        _text += fromUnsigned(value, DEC);
+        return *this;
+    }
+    String& operator+=(long value) {
+        _text += fromSigned(value, DEC);
+        return *this;
+    }
+    String& operator+=(unsigned long value) {
+        _text += fromUnsigned(value, DEC);
+        return *this;
+    }
+    String& operator+=(float value) {
+        _text += fromFloat(value, 4, 2);
+        return *this;
+    }
+    String& operator+=(double value) {
+        _text += fromFloat(value, 4, 2);
+        return *this;
+    }
+
+    bool operator==(const String& other) const {
+        return _text == other._text;
+    }
+    bool operator!=(const String& other) const {
+        return _text != other._text;
+    }
+    char operator[](unsigned int index) const {
+        return index < _text.size() ? _text[index] : '\0';
+    }
+
+    const char* c_str() const {
+        return _text.c_str();
+    }
+    unsigned int length() const {
+        return _text.size();
+    }
+    String substring(unsigned int left) const {
+        return substring(left, _text.size());
+    }
+    String substring(unsigned int left, unsigned int right) const {
+        if (left > right) {
+            unsigned int temp = right;
+            right             = left;
+            left              = temp;
+        }
+        if (left >= _text.size()) { return String(); }
+        if (right > _text.size()) { right = _text.size(); }
+        return String(_text.substr(left, right - left));
+    }
+    void trim() {
+        size_t start = 0;
+        size_t end   = _text.size();
+        while (start < end && isspace(static_cast<uint8_t>(_text[start]))) {
+            start++;
+        }
+        while (end > start && isspace(static_cast<uint8_t>(_text[end - 1]))) {
+            end--;
+        }
+        _text = _text.substr(start, end - start);
+    }
+    long toInt() const {
+        return atol(_text.c_str());
+    }
+    float toFloat() const {
+        return atof(_text.c_str());
+    }
+    void toCharArray(char* buffer, unsigned int size) const {
+        if (size == 0) { return; }
+        strncpy(buffer, _text.c_str(), size - 1);
+        buffer[size - 1] = '\0';
+    }
+
+ protected:
+    // Like itoa(), only base 10 numbers get a minus sign
+    static std::string fromSigned(long value, unsigned char base) {
+        if (base != DEC || value >= 0) {
+            return fromUnsigned(static_cast<uint32_t>(value), base);
+        }
+        return "-" + fromUnsigned(0 - static_cast<uint32_t>(value), base);
+    }
+    static std::string fromUnsigned(unsigned long value, unsigned char base) {
+        char  digits[66];
+        char* p = digits + sizeof(digits) - 1;
+        *p      = '\0';
+        do {
+            uint8_t digit = value % base;
+            *--p          = digit < 10 ? '0' + digit : 'a' + digit - 10;
+            value /= base;
+        } while (value > 0);
+        return std::string(p);
+    }
+    static std::string fromFloat(double value, signed char width,
+                                 unsigned char prec) {
+        char text[352];
+        return std::string(dtostrf(value, width, prec, text));
+    }
+
+    std::string _text;
+};
+
+// ==========================================================================
+// Print and Stream
+// ==========================================================================
+
+class Print {
+ public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    size_t         write(const char* text) {
+        size_t n = 0;
+        while (*text) { n += write(static_cast<uint8_t>(*text++)); }
+        return n;
+    }
+
+    size_t print(const char* text) {
+        return write(text);
+    }
+    size_t print(const String& text) {
+        return write(text.c_str());
+    }
+    size_t print(char c) {
+        return write(static_cast<uint8_t>(c));
+    }
+    size_t print(unsigned char value, int base = DEC) {
+        return print(String(value, base));
+    }
+    size_t print(int value, int base = DEC) {
+        return print(String(value, base));
+    }
+    size_t print(unsigned int value, int base = DEC) {
+        return print(String(value, base));
+    }
+    size_t print(long value, int base = DEC) {
+        return print(String(value, base));
+    }
+    size_t print(unsigned long value, int base = DEC) {
+        return print(String(value, base));
+    }
+    size_t print(double value, int digits = 2) {
+        char text[352];
+        snprintf(text, sizeof(text), "%.*f", digits, value);
+        return write(text);
+    }
+
+    size_t println() {
+        return write("\r\n");
+    }
+    template <typename T>
+    size_t println(const T& value) {
+        return print(value) + println();
+    }
+    template <typename T>
+    size_t println(const T& value, int format) {
+        return print(value, format) + println();
+    }
+};
+
+/**
+ * @brief The Arduino Stream.  Reads that wait for a character give up after
+ * the timeout, and call yield() while they wait so the host clock moves.
+ */
+class Stream : public Print {
+ public:
+    Stream() : _timeout(1000) {}
+    virtual int available() = 0;
+    virtual int read()      = 0;
+    virtual int peek()      = 0;
+
+    void setTimeout(unsigned long timeout) {
+        _timeout = timeout;
+    }
+
+    size_t readBytesUntil(char terminator, char* buffer, size_t length) {
+        size_t count = 0;
+        while (count < length) {
+            int c = timedRead();
+            if (c < 0 || c == terminator) { break; }
+            buffer[count++] = static_cast<char>(c);
+        }
+        return count;
+    }
+
+    String readStringUntil(char terminator) {
+        std::string text;
+        int         c = timedRead();
+        while (c >= 0 && c != terminator) {
+            text += static_cast<char>(c);
+            c = timedRead();
+        }
+        return String(text);
+    }
+
+ protected:
+    int timedRead() {
+        uint32_t start = millis();
+        do {
+            int c = read();
+            if (c >= 0) { return c; }
+            yield();
+        } while (millis() - start < _timeout);
+        return -1;
+    }
+
+    unsigned long _timeout;
+};
+
+// The serial port, printed to stdout if hostSerialEcho is true
+class hostSerial : public Stream {
+ public:
+    hostSerial() : echo(false) {}
+    void begin(unsigned long) {}
+    operator bool() {
+        return true;
+    }
+    size_t write(uint8_t c) {
+        if (echo) { putchar(c); }
+        return 1;
+    }
+    int available() {
+        return 0;
+    }
+    int read() {
+        return -1;
+    }
+    int peek() {
+        return -1;
+    }
+
+    bool echo;
+};
+
+hostSerial Serial;
+
+#endif
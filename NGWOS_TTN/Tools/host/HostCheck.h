@@ -0,0 +1,44 @@
+// Header Guards
+#ifndef HOST_CHECK_H_
+#define HOST_CHECK_H_
+
+#include <math.h>
+#include <stdio.h>
+
+// Checks for the host test programs.  A failed check is printed and counted,
+// and the program carries on so every failure is seen in one run; main()
+// returns hostCheckResult() so a failure gives a non-zero exit code.
+
+inline int& hostCheckFailures() {
+    static int failures = 0;
+    return failures;
+}
+
+inline int& hostCheckCount() {
+    static int count = 0;
+    return count;
+}
+
+inline bool hostCheck(bool passed, const char* text, const char* file,
+                      int line) {
+    hostCheckCount()++;
+    if (!passed) {
+        hostCheckFailures()++;
+        printf("FAILED %s:%d: %s\n", file, line, text);
+    }
+    return passed;
+}
+
+// Prints the totals and gives the exit code for main()
+inline int hostCheckResult(const char* program) {
+    printf("%s: %d checks, %d failed\n", program, hostCheckCount(),
+           hostCheckFailures());
+    return hostCheckFailures() == 0 ? 0 : 1;
+}
+
+#define CHECK(condition) hostCheck((condition), #condition, __FILE__, __LINE__)
+#define CHECK_NEAR(actual, expected, tolerance)                              \
+    hostCheck(fabs((actual) - (expected)) <= (tolerance),                    \
+              #actual " is near " #expected, __FILE__, __LINE__)
+
+#endif
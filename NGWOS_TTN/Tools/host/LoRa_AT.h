@@ -0,0 +1,195 @@
+// Header Guards
+#ifndef HOST_LORA_AT_H_
+#define HOST_LORA_AT_H_
+
+// A stand-in for the LoRa_AT library, so LoRaModemFxns.h can be compiled and
+// run on a computer.  It simulates an mDot's network session - the one it's
+// using and the one saved in its flash - and the network server on the other
+// side, which only takes frames for the session it knows with an uplink
+// counter it hasn't seen yet.
+
+#include <Arduino.h>
+#include <string>
+
+enum _lora_class { CLASS_A = 'A', CLASS_B = 'B', CLASS_C = 'C' };
+#define UNIX 0
+
+// The modem's serial port.  Only parseInt() answers anything: the number the
+// last command gave.
+class hostLoRaStream : public Stream {
+ public:
+    hostLoRaStream() : answer(0) {}
+    size_t write(uint8_t) {
+        return 1;
+    }
+    int available() {
+        return 0;
+    }
+    int read() {
+        return -1;
+    }
+    int peek() {
+        return -1;
+    }
+    void flush() {}
+    long parseInt() {
+        return answer;
+    }
+
+    long answer;
+};
+
+class LoRa_AT {
+ public:
+    LoRa_AT()
+        : joined(false),
+          uplinks(0),
+          savedJoined(false),
+          savedUplinks(0),
+          joinWorks(true),
+          networkHasSession(false),
+          networkLastUplink(-1),
+          joins(0),
+          restores(0),
+          saves(0),
+          _ok(true) {}
+
+    // Sends an uplink, counting it whether or not the network takes it.
+    // Returns whether the network took it.
+    bool hostSendUplink() {
+        if (!joined) { return false; }
+        bool taken = networkHasSession && uplinks > networkLastUplink;
+        if (taken) { networkLastUplink = uplinks; }
+        uplinks++;
+        return taken;
+    }
+
+    // The network forgets the session, and the modem notices it's no longer
+    // joined, as it does when its link checks go unanswered
+    void hostDropSession() {
+        networkHasSession = false;
+        joined            = false;
+    }
+
+    // The modem loses power: the session it was using is gone, but the one
+    // saved in its flash is kept
+    void hostPowerCycle() {
+        joined  = false;
+        uplinks = 0;
+    }
+
+    bool init() {
+        return true;
+    }
+    bool testAT(uint32_t) {
+        return true;
+    }
+    String getDevEUI() {
+        return String("00-80-00-00-00-00-00-01");
+    }
+    String getModuleInfo() {
+        return String("MultiTech mDot");
+    }
+    String getBand() {
+        return String("US915");
+    }
+    bool setClass(_lora_class) {
+        return true;
+    }
+    bool setPublicNetwork(bool) {
+        return true;
+    }
+    bool setFrequencySubBand(int8_t) {
+        return true;
+    }
+    bool setAdaptiveDataRate(bool) {
+        return true;
+    }
+    bool setConfirmationRetries(int8_t) {
+        return true;
+    }
+    void requireConfirmation(bool) {}
+    uint32_t getDateTimeEpoch(int) {
+        return 1780335300;
+    }
+    bool pinSleep(int8_t, int8_t, int8_t) {
+        return true;
+    }
+
+    bool isNetworkConnected() {
+        return joined;
+    }
+
+    // A join starts a new session on both sides, with the counter at 0
+    bool joinOTAA(const char*, const char*) {
+        joins++;
+        if (!joinWorks) { return false; }
+        joined            = true;
+        uplinks           = 0;
+        networkHasSession = true;
+        networkLastUplink = -1;
+        return true;
+    }
+
+    // Runs the session commands LoRaModemFxns.h sends itself; anything else
+    // just answers OK
+    template <typename... Args>
+    void sendAT(Args... args) {
+        _command.clear();
+        append(args...);
+        _ok = true;
+        if (_command == "+RS") {
+            restores++;
+            joined  = savedJoined;
+            uplinks = savedUplinks;
+        } else if (_command == "+SS") {
+            saves++;
+            savedJoined  = joined;
+            savedUplinks = uplinks;
+        } else if (_command == "+UPC?") {
+            stream.answer = uplinks;
+        } else if (_command.compare(0, 5, "+UPC=") == 0) {
+            uplinks = atol(_command.c_str() + 5);
+        }
+    }
+    int8_t waitResponse() {
+        return _ok ? 1 : 0;
+    }
+
+    hostLoRaStream stream;
+
+    bool    joined;        // whether the modem is using a session
+    int32_t uplinks;       // the modem's uplink counter
+    bool    savedJoined;   // whether there's a session saved in its flash
+    int32_t savedUplinks;  // the uplink counter saved with it
+    bool    joinWorks;     // whether a join gets an answer
+    // Whether the network still has the session the modem joined
+    bool networkHasSession;
+    // The last uplink counter the network took
+    int32_t networkLastUplink;
+    int     joins;     // the number of joins tried
+    int     restores;  // the number of AT+RS
+    int     saves;     // the number of AT+SS
+
+ protected:
+    void append() {}
+    template <typename T, typename... Rest>
+    void append(T value, Rest... rest) {
+        appendOne(value);
+        append(rest...);
+    }
+    void appendOne(const char* text) {
+        _command += text;
+    }
+    void appendOne(long value) {
+        _command += std::to_string(value);
+    }
+    void appendOne(int value) {
+        _command += std::to_string(value);
+    }
+
+    std::string _command;
+    bool        _ok;
+};
+
+#endif
@@ -0,0 +1,430 @@
+// Header Guards
+#ifndef SDI12_SIM_H_
+#define SDI12_SIM_H_
+
+#include <Arduino.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+// The time to send one character at 1200 baud, 7E1 (10 bits), in microseconds
+#define SDI12_SIM_CHARACTER_US 8333
+// The break and marking that wake the sensors before each command, in
+// microseconds
+#define SDI12_SIM_WAKE_US (12000 + 8333)
+// The default time from the end of a command to the start of the response, in
+// microseconds; the standard allows up to 15 ms
+#define SDI12_SIM_RESPONSE_LATENCY_US 9000
+
+// Things that can go wrong with a response, to inject into the simulated bus
+enum sdi12SimFault {
+    // the sensor doesn't answer at all
+    SDI12_FAULT_NO_RESPONSE = 0,
+    // the response has another sensor's address
+    SDI12_FAULT_WRONG_ADDRESS,
+    // a character is changed on the wire, after the CRC was added
+    SDI12_FAULT_GARBLED,
+    // the response stops halfway, without its <CR><LF>
+    SDI12_FAULT_TRUNCATED,
+    // noise follows the <CR><LF>
+    SDI12_FAULT_EXTRA_CHARACTERS,
+    // a standard measurement never sends its service request
+    SDI12_FAULT_NO_SERVICE_REQUEST,
+    // the measurement takes twice as long as it should
+    SDI12_FAULT_LATE_DATA,
+};
+
+/**
+ * @brief A simulated SDI-12 sensor.
+ *
+ * The values are sent exactly as given, so each should start with its sign.
+ * Each measurement takes the next time in readyMillis, repeating from the
+ * start when they run out, so timing recorded from a real sensor can be
+ * replayed.
+ */
+struct sdi12VirtualSensor {  // Structure declaration
+    char address;
+    // The response to aI!, after the address
+    std::string identification;
+    // The measurement time the sensor gives in its acknowledgement, in seconds
+    uint16_t measurementSeconds;
+    // How long each measurement really takes, in milliseconds
+    std::vector<uint32_t> readyMillis;
+    // The values returned by the D commands
+    std::vector<std::string> values;
+    // The number of values on each D page; if empty, each page is filled up
+    // to the 35 (standard) or 75 (concurrent) characters the standard allows
+    std::vector<uint8_t> pageLayout;
+    // Whether the sensor adds a CRC when one is asked for
+    bool supportsCRC;
+    // The time from the end of a command to the start of the response, in
+    // microseconds
+    uint32_t responseLatencyMicros;
+};
+
+// A METER Hydros 21 - depth in mm, temperature in °C, and conductivity in
+// µS/cm - with typical timing
+inline sdi12VirtualSensor hydros21Sensor(char address) {
+    sdi12VirtualSensor sensor;
+    sensor.address               = address;
+    sensor.identification        = "13METER   HYDR21410H21-00123";
+    sensor.measurementSeconds    = 1;
+    sensor.readyMillis           = {520, 540, 510};
+    sensor.values                = {"+132", "+21.6", "+1045"};
+    sensor.supportsCRC           = true;
+    sensor.responseLatencyMicros = SDI12_SIM_RESPONSE_LATENCY_US;
+    return sensor;
+}
+
+// A VEGAPULS C 21 - stage and distance in m, temperature in °C, reliability in
+// dB, and an error code - with typical timing
+inline sdi12VirtualSensor vegaPulsSensor(char address) {
+    sdi12VirtualSensor sensor;
+    sensor.address               = address;
+    sensor.identification        = "14VEGA    PSC21 1001234567";
+    sensor.measurementSeconds    = 3;
+    sensor.readyMillis           = {2150, 2300, 2200};
+    sensor.values                = {"+1.234", "+2.766", "+22.4", "+41.2", "+0"};
+    sensor.supportsCRC           = true;
+    sensor.responseLatencyMicros = SDI12_SIM_RESPONSE_LATENCY_US;
+    return sensor;
+}
+
+/**
+ * @brief A simulated SDI-12 bus, with the same stream interface as the SDI-12
+ * library, for running SDI12Master.h on a computer.
+ *
+ * Sending a command moves the host clock forward by the time the wake-up and
+ * the command take at 1200 baud.  Each character of the response arrives when
+ * it would finish on a real bus, so reads that wait for it move the clock too.
+ * A standard measurement sends its service request once its data is ready; a
+ * concurrent one answers a D command sent too early with only its address.
+ * As on a real bus, any command to a sensor in the middle of a standard
+ * measurement aborts it.
+ *
+ * Faults are injected for a number of the commands that start with the given
+ * text, after the address, so "D1" is the second data page and "M" is any
+ * standard measurement.
+ */
+class sdi12SimBus : public Stream {
+ public:
+    sdi12SimBus() : TIMEOUT(-9999), busMicros(0) {}
+    ~sdi12SimBus() {}
+
+    // Put a sensor on the bus, returning its position
+    int8_t addSensor(const sdi12VirtualSensor& sensor) {
+        _sensors.push_back(sensorState(sensor));
+        return _sensors.size() - 1;
+    }
+
+    sdi12VirtualSensor& getSensor(uint8_t index) {
+        return _sensors[index].sensor;
+    }
+
+    /**
+     * @brief Make the next responses to a command go wrong.
+     *
+     * @param address The address of the sensor
+     * @param command The start of the command after the address, ie "D0"
+     * @param fault What goes wrong
+     * @param times How many of the matching commands it happens to
+     */
+    void injectFault(char address, const char* command, sdi12SimFault fault,
+                     uint8_t times = 1) {
+        injectedFault injected = {address, command, fault, times};
+        _faults.push_back(injected);
+    }
+
+    // The number of injected faults that haven't happened yet
+    size_t faultsLeft() {
+        size_t left = 0;
+        for (size_t i = 0; i < _faults.size(); i++) {
+            left += _faults[i].times;
+        }
+        return left;
+    }
+
+    void begin() {}
+    void end() {}
+
+    void sendCommand(String& command, int8_t extraWakeTime = 0) {
+        sendCommand(command.c_str(), extraWakeTime);
+    }
+
+    void sendCommand(const char* command, int8_t extraWakeTime = 0) {
+        size_t length = strlen(command);
+        commands.push_back(command);
+        uint64_t sent = SDI12_SIM_WAKE_US +
+            static_cast<uint64_t>(extraWakeTime) * 1000 +
+            length * SDI12_SIM_CHARACTER_US;
+        hostAdvanceMicros(sent);
+        busMicros += sent;
+
+        if (length < 2 || command[length - 1] != '!') { return; }
+        for (size_t i = 0; i < _sensors.size(); i++) {
+            if (_sensors[i].sensor.address == command[0]) {
+                std::string body(command + 1, length - 2);
+                respond(_sensors[i], i, body);
+            }
+        }
+    }
+
+    // Throws away the characters received so far; ones still on their way
+    // will arrive later
+    void clearBuffer() {
+        while (arrived()) { _incoming.erase(_incoming.begin()); }
+    }
+
+    int available() {
+        int count = 0;
+        for (size_t i = 0; i < _incoming.size(); i++) {
+            if (_incoming[i].at > hostClockMicros()) { break; }
+            count++;
+        }
+        return count;
+    }
+
+    int read() {
+        if (!arrived()) { return -1; }
+        char c = _incoming.front().c;
+        _incoming.erase(_incoming.begin());
+        return static_cast<uint8_t>(c);
+    }
+
+    int peek() {
+        return arrived() ? static_cast<uint8_t>(_incoming.front().c) : -1;
+    }
+
+    size_t write(uint8_t) {
+        return 0;
+    }
+
+    // Like the SDI-12 library's TIMEOUT, returned by its parseInt/parseFloat
+    int TIMEOUT;
+    // Every command sent, in order
+    std::vector<std::string> commands;
+    // The time the bus has spent sending commands and responses
+    uint64_t busMicros;
+
+ protected:
+    struct sensorState {
+        sdi12VirtualSensor       sensor;
+        std::vector<std::string> pages;
+        bool                     measuring;
+        bool                     concurrent;
+        bool                     crc;
+        uint64_t                 readyAt;
+        size_t                   measurements;
+        explicit sensorState(const sdi12VirtualSensor& virtual_sensor)
+            : sensor(virtual_sensor),
+              measuring(false),
+              concurrent(false),
+              crc(false),
+              readyAt(0),
+              measurements(0) {}
+    };
+
+    struct pendingCharacter {
+        uint64_t at;
+        char     c;
+        int8_t   serviceRequestFrom;  // the sensor, if part of one
+    };
+
+    struct injectedFault {
+        char          address;
+        std::string   command;
+        sdi12SimFault fault;
+        uint8_t       times;
+    };
+
+    bool arrived() {
+        return !_incoming.empty() && _incoming.front().at <= hostClockMicros();
+    }
+
+    // Finds and uses up an injected fault for a command
+    bool takeFault(char address, const std::string& body, sdi12SimFault fault) {
+        for (size_t i = 0; i < _faults.size(); i++) {
+            injectedFault& injected = _faults[i];
+            if (injected.address == address && injected.fault == fault &&
+                injected.times > 0 &&
+                body.compare(0, injected.command.size(), injected.command) ==
+                    0) {
+                injected.times--;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void queue(uint64_t at, char c, int8_t serviceRequestFrom = -1) {
+        pendingCharacter pending = {at, c, serviceRequestFrom};
+        std::vector<pendingCharacter>::iterator position = _incoming.end();
+        while (position != _incoming.begin() && (position - 1)->at > at) {
+            position--;
+        }
+        _incoming.insert(position, pending);
+    }
+
+    // Drops a service request that hasn't started arriving yet
+    void cancelServiceRequest(size_t index) {
+        for (size_t i = _incoming.size(); i > 0; i--) {
+            pendingCharacter& pending = _incoming[i - 1];
+            if (pending.serviceRequestFrom == static_cast<int8_t>(index) &&
+                pending.at > hostClockMicros()) {
+                _incoming.erase(_incoming.begin() + i - 1);
+            }
+        }
+    }
+
+    void respond(sensorState& state, size_t index, const std::string& body) {
+        const sdi12VirtualSensor& sensor = state.sensor;
+        // any command aborts a standard measurement that isn't finished
+        if (state.measuring && !state.concurrent &&
+            hostClockMicros() < state.readyAt) {
+            state.measuring = false;
+            state.pages.clear();
+            cancelServiceRequest(index);
+        }
+
+        std::string response(1, sensor.address);
+        bool        add_crc = false;
+        if (body.empty()) {
+            // acknowledge active
+        } else if (body == "I") {
+            response += sensor.identification;
+        } else if (body[0] == 'M' || body[0] == 'C') {
+            startMeasurement(state, body, response);
+        } else if (body[0] == 'D' && body.size() == 2) {
+            uint8_t page  = body[1] - '0';
+            bool    ready = state.measuring &&
+                hostClockMicros() >= state.readyAt;
+            if (ready && page < state.pages.size()) {
+                response += state.pages[page];
+            }
+            add_crc = state.crc;
+        } else {
+            return;  // not a command this sensor knows
+        }
+
+        if (takeFault(sensor.address, body, SDI12_FAULT_NO_RESPONSE)) {
+            return;
+        }
+        if (takeFault(sensor.address, body, SDI12_FAULT_WRONG_ADDRESS)) {
+            response[0] = sensor.address == '9' ? '8' : sensor.address + 1;
+        }
+        if (add_crc) { appendCRC(response); }
+        if (takeFault(sensor.address, body, SDI12_FAULT_GARBLED)) {
+            // change a character after the address, or the address if that's
+            // all there is
+            size_t position = response.size() > 1 ? response.size() / 2 : 0;
+            response[position] ^= 0x04;
+        }
+        bool truncated = takeFault(sensor.address, body, SDI12_FAULT_TRUNCATED);
+        if (truncated) {
+            response.resize(response.size() / 2);
+        } else {
+            response += "\r\n";
+        }
+        if (takeFault(sensor.address, body, SDI12_FAULT_EXTRA_CHARACTERS)) {
+            response += "x?";
+        }
+
+        uint64_t at = hostClockMicros() + sensor.responseLatencyMicros;
+        for (size_t i = 0; i < response.size(); i++) {
+            at += SDI12_SIM_CHARACTER_US;
+            queue(at, response[i]);
+        }
+        busMicros += response.size() * SDI12_SIM_CHARACTER_US;
+        if (state.measuring && hostClockMicros() < state.readyAt &&
+            !state.concurrent &&
+            !takeFault(sensor.address, body, SDI12_FAULT_NO_SERVICE_REQUEST)) {
+            // the service request comes once the data is ready, but never
+            // before the acknowledgement has finished
+            uint64_t request_at = std::max(state.readyAt, at);
+            queue(request_at + 1 * SDI12_SIM_CHARACTER_US, sensor.address,
+                  index);
+            queue(request_at + 2 * SDI12_SIM_CHARACTER_US, '\r', index);
+            queue(request_at + 3 * SDI12_SIM_CHARACTER_US, '\n', index);
+        }
+    }
+
+    // Starts a measurement, adding the acknowledgement to the response
+    void startMeasurement(sensorState& state, const std::string& body,
+                          std::string& response) {
+        const sdi12VirtualSensor& sensor = state.sensor;
+        state.concurrent = body[0] == 'C';
+        state.crc = body.size() > 1 && body[1] == 'C' && sensor.supportsCRC;
+
+        uint32_t ready_ms = 0;
+        if (!sensor.readyMillis.empty()) {
+            ready_ms = sensor.readyMillis[state.measurements %
+                                          sensor.readyMillis.size()];
+        }
+        state.measurements++;
+        if (takeFault(sensor.address, body, SDI12_FAULT_LATE_DATA)) {
+            ready_ms *= 2;
+        }
+
+        // the acknowledgement is atttn for standard measurements and atttnn
+        // for concurrent ones
+        char acknowledgement[8];
+        snprintf(acknowledgement, sizeof(acknowledgement),
+                 state.concurrent ? "%03u%02u" : "%03u%01u",
+                 sensor.measurementSeconds % 1000,
+                 static_cast<unsigned>(sensor.values.size()) %
+                     (state.concurrent ? 100 : 10));
+        response += acknowledgement;
+
+        // the measurement starts once the acknowledgement has been sent
+        uint64_t acknowledged = hostClockMicros() +
+            sensor.responseLatencyMicros +
+            (response.size() + 2) * SDI12_SIM_CHARACTER_US;
+        state.readyAt   = acknowledged + static_cast<uint64_t>(ready_ms) * 1000;
+        state.measuring = true;
+        state.pages     = splitPages(sensor, state.concurrent ? 75 : 35);
+    }
+
+    static std::vector<std::string> splitPages(const sdi12VirtualSensor& sensor,
+                                               size_t max_characters) {
+        std::vector<std::string> pages;
+        std::string              page;
+        size_t                   on_page = 0;
+        size_t                   layout  = 0;
+        for (size_t i = 0; i < sensor.values.size(); i++) {
+            const std::string& value = sensor.values[i];
+            bool               full  = layout < sensor.pageLayout.size()
+                               ? on_page >= sensor.pageLayout[layout]
+                               : page.size() + value.size() > max_characters;
+            if (full && on_page > 0) {
+                pages.push_back(page);
+                page.clear();
+                on_page = 0;
+                layout++;
+            }
+            page += value;
+            on_page++;
+        }
+        if (on_page > 0) { pages.push_back(page); }
+        return pages;
+    }
+
+    // Adds the three character SDI-12 CRC
+    static void appendCRC(std::string& response) {
+        uint16_t crc = 0;
+        for (size_t i = 0; i < response.size(); i++) {
+            crc ^= static_cast<uint8_t>(response[i]);
+            for (uint8_t bit = 0; bit < 8; bit++) {
+                crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : crc >> 1;
+            }
+        }
+        response += static_cast<char>(0x40 | (crc >> 12));
+        response += static_cast<char>(0x40 | ((crc >> 6) & 0x3F));
+        response += static_cast<char>(0x40 | (crc & 0x3F));
+    }
+
+    std::vector<sensorState>      _sensors;
+    std::vector<pendingCharacter> _incoming;
+    std::vector<injectedFault>    _faults;
+};
+
+#endif
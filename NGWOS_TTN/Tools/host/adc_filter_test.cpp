@@ -0,0 +1,173 @@
+// Tests how adcFilter in AdcFilter.h throws out outliers, on a few made-up
+// bursts and on the bursts in the traces folder, checking each against a
+// plain double-precision version of the same filter.
+//
+// The traces are read from Tools/host/traces, so run it from the folder
+// holding the ReadMe, or give the trace files to read on the command line.
+//
+// See "Host Tests" in the ReadMe to build and run it.
+
+#include <Arduino.h>
+#include "HostCheck.h"
+#include "AdcFilter.h"
+
+#include <algorithm>
+#include <vector>
+
+const char* defaultTraces[] = {"Tools/host/traces/battery_quiet.txt",
+                               "Tools/host/traces/battery_modem_tx.txt",
+                               "Tools/host/traces/light_sensor.txt"};
+
+// The filter as it's described, in doubles, to check adcFilter against
+adcBurstResult reference(std::vector<uint16_t> samples) {
+    adcBurstResult result = {-9999, 0, 0, 0, 0};
+    std::sort(samples.begin(), samples.end());
+    size_t n      = samples.size();
+    double median = n % 2 ? samples[n / 2]
+                          : (samples[n / 2 - 1] + samples[n / 2]) / 2.0;
+    std::vector<double> deviations;
+    for (size_t i = 0; i < n; i++) {
+        deviations.push_back(fabs(samples[i] - median));
+    }
+    std::sort(deviations.begin(), deviations.end());
+    double mad   = n % 2 ? deviations[n / 2]
+                         : (deviations[n / 2 - 1] + deviations[n / 2]) / 2.0;
+    double limit = ADC_FILTER_OUTLIER_LIMIT * 1.4826 * mad;
+    if (limit < ADC_FILTER_MIN_SPREAD) { limit = ADC_FILTER_MIN_SPREAD; }
+
+    double total = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (fabs(samples[i] - median) > limit) {
+            result.rejected++;
+            continue;
+        }
+        if (result.used == 0) { result.min = samples[i]; }
+        result.max = samples[i];
+        total += samples[i];
+        result.used++;
+    }
+    result.mean = total / result.used;
+    return result;
+}
+
+adcBurstResult filterCopy(std::vector<uint16_t> samples) {
+    return adcFilter::filter(samples.data(), samples.size());
+}
+
+// Whether adcFilter and the reference agree on a burst
+bool sameAsReference(const std::vector<uint16_t>& samples) {
+    adcBurstResult got      = filterCopy(samples);
+    adcBurstResult expected = reference(samples);
+    return got.used == expected.used && got.rejected == expected.rejected &&
+        got.min == expected.min && got.max == expected.max &&
+        fabs(got.mean - expected.mean) < 0.001;
+}
+
+void testNoOutliers() {
+    std::vector<uint16_t> samples = {2466, 2467, 2465, 2466, 2466, 2467, 2466};
+    adcBurstResult        result  = filterCopy(samples);
+    CHECK(result.used == 7);
+    CHECK(result.rejected == 0);
+    CHECK(result.min == 2465);
+    CHECK(result.max == 2467);
+    CHECK_NEAR(result.mean, 2466.142857, 0.001);
+}
+
+void testSpikeThrownOut() {
+    std::vector<uint16_t> samples = {2458, 2459, 2458, 2380, 2459, 2458,
+                                     2457, 2459, 2460, 2458, 2459, 2458};
+    adcBurstResult        result  = filterCopy(samples);
+    CHECK(result.rejected == 1);
+    CHECK(result.min == 2457);
+    CHECK_NEAR(result.mean, 2458.454545, 0.001);
+}
+
+// A median half way between two readings.  The deviations are all a whole
+// number and a half; cut to whole bits, the spread came out smaller and the
+// reading at 1098, 67.5 bits from the median, was thrown out.
+void testEvenCountHalfBitMedian() {
+    std::vector<uint16_t> samples = {1000, 1010, 1020, 1030,
+                                     1031, 1041, 1051, 1098};
+    adcBurstResult        result  = filterCopy(samples);
+    CHECK(result.rejected == 0);
+    CHECK(result.used == 8);
+    CHECK(result.max == 1098);
+    CHECK(sameAsReference(samples));
+}
+
+void testEdgeCases() {
+    CHECK(adcFilter::filter(NULL, 0).mean == -9999);
+    CHECK(adcFilter::filter(NULL, 0).used == 0);
+
+    std::vector<uint16_t> one = {4095};
+    CHECK(filterCopy(one).used == 1);
+    CHECK(filterCopy(one).mean == 4095);
+
+    // a flat channel keeps readings within ADC_FILTER_MIN_SPREAD
+    std::vector<uint16_t> flat = {100, 100, 100, 100, 102, 100, 103, 100};
+    adcBurstResult        result = filterCopy(flat);
+    CHECK(result.max == 102);
+    CHECK(result.rejected == 1);
+}
+
+// Reads a trace file, checking every burst against the reference and the
+// number of outliers written after it
+void testTrace(const char* path) {
+    FILE* file = fopen(path, "r");
+    if (!CHECK(file != NULL)) {
+        printf("  couldn't open %s\n", path);
+        return;
+    }
+    char line[1024];
+    int  bursts    = 0;
+    int  different = 0;
+    int  wrong     = 0;
+    int  rejected  = 0;
+    while (fgets(line, sizeof(line), file)) {
+        if (line[0] == '#' || line[0] == '\n') { continue; }
+        std::vector<uint16_t> samples;
+        char*                 cursor = line;
+        while (*cursor && *cursor != '|') {
+            char* end;
+            long  value = strtol(cursor, &end, 10);
+            if (end == cursor) {
+                cursor++;
+                continue;
+            }
+            samples.push_back(value);
+            cursor = end;
+        }
+        int expected = *cursor == '|' ? atoi(cursor + 1) : -1;
+        bursts++;
+        if (!sameAsReference(samples)) { different++; }
+        adcBurstResult result = filterCopy(samples);
+        if (result.rejected != expected) {
+            if (wrong++ < 5) {
+                printf("  %s burst %d: %u outliers, expected %d\n", path,
+                       bursts, result.rejected, expected);
+            }
+        }
+        rejected += result.rejected;
+    }
+    fclose(file);
+    printf("%s: %d bursts, %d outliers thrown out\n", path, bursts, rejected);
+    CHECK(bursts > 0);
+    CHECK(different == 0);
+    CHECK(wrong == 0);
+}
+
+int main(int argc, char* argv[]) {
+    testNoOutliers();
+    testSpikeThrownOut();
+    testEvenCountHalfBitMedian();
+    testEdgeCases();
+    if (argc > 1) {
+        for (int i = 1; i < argc; i++) { testTrace(argv[i]); }
+    } else {
+        for (size_t i = 0; i < sizeof(defaultTraces) / sizeof(defaultTraces[0]);
+             i++) {
+            testTrace(defaultTraces[i]);
+        }
+    }
+    return hostCheckResult("adc_filter_test");
+}
@@ -0,0 +1,161 @@
+// Tests when LoRaModemFxns.h joins the network again, restores the session
+// saved in the modem, or keeps the one it has, against a simulated mDot and
+// network server (the LoRa_AT.h stand-in).
+//
+// See "Host Tests" in the ReadMe to build and run it.
+
+#include <Arduino.h>
+#include "HostCheck.h"
+
+// The processor's backup RAM, where the hash of the configuration is kept
+uint32_t hostBackupRam[3];
+#define LORA_CONFIG_HASH_ADDR hostBackupRam
+#include "LoRaModemFxns.h"
+
+const char appEui[] = "0000000000000001";
+const char appKey[] = "00112233445566778899AABBCCDDEEFF";
+
+// The same modem object the sketch makes, without any pins
+loraModemTTN newModem() {
+    return loraModemTTN(-1, -1, -1, -1, 0, 0);
+}
+
+// A fresh start: the modem is set up, joins, and saves the session
+void testFirstStartJoins() {
+    memset(hostBackupRam, 0, sizeof(hostBackupRam));
+    LoRa_AT      mdot;
+    loraModemTTN modem = newModem();
+    modem.setupModemTTN(mdot, appEui, appKey);
+    CHECK(modem.modemConnect(mdot, appEui, appKey));
+    CHECK(mdot.joins == 1);
+    CHECK(mdot.restores == 0);
+    CHECK(mdot.savedJoined);
+    CHECK(mdot.hostSendUplink());
+}
+
+// A restart with the same configuration restores the saved session, with
+// the uplink counter moved past any frames sent since it was saved
+void testRestartRestoresSession() {
+    memset(hostBackupRam, 0, sizeof(hostBackupRam));
+    LoRa_AT      mdot;
+    loraModemTTN modem = newModem();
+    modem.setupModemTTN(mdot, appEui, appKey);
+    modem.modemConnect(mdot, appEui, appKey);
+    for (int i = 0; i < 10; i++) { mdot.hostSendUplink(); }
+
+    mdot.hostPowerCycle();
+    loraModemTTN restarted = newModem();
+    restarted.setupModemTTN(mdot, appEui, appKey);
+    CHECK(restarted.modemConnect(mdot, appEui, appKey));
+    CHECK(mdot.joins == 1);
+    CHECK(mdot.restores == 1);
+    CHECK(mdot.uplinks == LORA_SESSION_SAVE_UPLINKS);
+    CHECK(mdot.hostSendUplink());
+
+    // and the fast start does the same
+    mdot.hostPowerCycle();
+    loraModemTTN resumed = newModem();
+    CHECK(resumed.resumeModemTTN(mdot));
+    CHECK(resumed.modemConnect(mdot, appEui, appKey));
+    CHECK(mdot.joins == 1);
+    CHECK(mdot.restores == 2);
+    CHECK(mdot.hostSendUplink());
+
+    // a new key joins instead
+    mdot.hostPowerCycle();
+    loraModemTTN rekeyed = newModem();
+    rekeyed.setupModemTTN(mdot, appEui, "FFEEDDCCBBAA99887766554433221100");
+    CHECK(rekeyed.modemConnect(mdot, appEui, appKey));
+    CHECK(mdot.joins == 2);
+    CHECK(mdot.restores == 2);
+}
+
+// A send fails and the modem isn't joined any more: the logger must join
+// again, not restore the session the network has dropped
+void testFailedSendJoinsAgain() {
+    memset(hostBackupRam, 0, sizeof(hostBackupRam));
+    LoRa_AT      mdot;
+    loraModemTTN modem = newModem();
+    modem.setupModemTTN(mdot, appEui, appKey);
+    modem.modemConnect(mdot, appEui, appKey);
+    for (int i = 0; i < 40; i++) { mdot.hostSendUplink(); }
+    modem.modemSleep(mdot);
+    CHECK(mdot.savedUplinks == 40);
+
+    mdot.hostDropSession();
+    CHECK(!mdot.hostSendUplink());
+    CHECK(!mdot.isNetworkConnected());
+    CHECK(modem.modemReconnect(mdot, appEui, appKey));
+    CHECK(mdot.joins == 2);
+    CHECK(mdot.restores == 0);
+    CHECK(mdot.hostSendUplink());
+    // the new session is the one saved
+    CHECK(mdot.savedUplinks == 0);
+
+    // the next wake keeps it
+    CHECK(modem.modemConnect(mdot, appEui, appKey));
+    CHECK(mdot.joins == 2);
+    CHECK(mdot.restores == 0);
+}
+
+// A send that fails while the modem is still joined doesn't join again
+void testFailedSendStillJoined() {
+    memset(hostBackupRam, 0, sizeof(hostBackupRam));
+    LoRa_AT      mdot;
+    loraModemTTN modem = newModem();
+    modem.setupModemTTN(mdot, appEui, appKey);
+    modem.modemConnect(mdot, appEui, appKey);
+    CHECK(modem.modemReconnect(mdot, appEui, appKey));
+    CHECK(mdot.joins == 1);
+    CHECK(mdot.restores == 0);
+}
+
+// A join that fails is tried again at the next connect, even if there's a
+// session to restore
+void testFailedJoinTriedAgain() {
+    memset(hostBackupRam, 0, sizeof(hostBackupRam));
+    LoRa_AT      mdot;
+    loraModemTTN modem = newModem();
+    modem.setupModemTTN(mdot, appEui, appKey);
+    modem.modemConnect(mdot, appEui, appKey);
+
+    mdot.hostDropSession();
+    mdot.joinWorks = false;
+    CHECK(!modem.modemReconnect(mdot, appEui, appKey));
+    CHECK(!mdot.isNetworkConnected());
+    mdot.joinWorks = true;
+    CHECK(modem.modemConnect(mdot, appEui, appKey));
+    CHECK(mdot.joins == 3);
+    CHECK(mdot.restores == 0);
+    CHECK(mdot.hostSendUplink());
+}
+
+// The session is saved every LORA_SESSION_SAVE_UPLINKS uplinks, not at every
+// sleep
+void testSessionSavedNowAndThen() {
+    memset(hostBackupRam, 0, sizeof(hostBackupRam));
+    LoRa_AT      mdot;
+    loraModemTTN modem = newModem();
+    modem.setupModemTTN(mdot, appEui, appKey);
+    modem.modemConnect(mdot, appEui, appKey);
+    int saves = mdot.saves;
+    for (int i = 1; i < LORA_SESSION_SAVE_UPLINKS; i++) {
+        mdot.hostSendUplink();
+        modem.modemSleep(mdot);
+    }
+    CHECK(mdot.saves == saves);
+    mdot.hostSendUplink();
+    modem.modemSleep(mdot);
+    CHECK(mdot.saves == saves + 1);
+    CHECK(mdot.savedUplinks == LORA_SESSION_SAVE_UPLINKS);
+}
+
+int main() {
+    testFirstStartJoins();
+    testRestartRestoresSession();
+    testFailedSendJoinsAgain();
+    testFailedSendStillJoined();
+    testFailedJoinTriedAgain();
+    testSessionSavedNowAndThen();
+    return hostCheckResult("lora_modem_test");
+}
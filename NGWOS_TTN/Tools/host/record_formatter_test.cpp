@@ -0,0 +1,324 @@
+// Checks that recordFormatter in RecordFormatter.h builds the same text as
+// String concatenation byte-for-byte - including how floats are rounded - and
+// benchmarks it against String on a line like the sketch logs.
+//
+// See "Host Tests" in the ReadMe to build and run it.
+
+#include <Arduino.h>
+#include "HostCheck.h"
+#include "RecordFormatter.h"
+
+#include <time.h>
+
+char            lineBuffer[512];
+recordFormatter line(lineBuffer, sizeof(lineBuffer));
+
+// A repeatable random number, so every run checks the same values
+uint32_t nextRandom() {
+    static uint32_t state = 2463534242UL;
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+float floatFromBits(uint32_t bits) {
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// Checks one float against String(value, decimals), printing the first few
+// that differ
+bool sameFloat(float value, uint8_t decimals) {
+    static int printed = 0;
+    line.reset();
+    line.addFloat(value, decimals);
+    String expected(value, decimals);
+    bool   same = strcmp(line.c_str(), expected.c_str()) == 0;
+    if (!same && printed++ < 10) {
+        printf("  %.9g with %u decimals: \"%s\", String gives \"%s\"\n", value,
+               decimals, line.c_str(), expected.c_str());
+    }
+    return same;
+}
+
+void testIntegers() {
+    const long values[] = {0,     1,          -1,          9,   10,  -10,
+                           -9999, 1700000000, -2147483647L - 1, 2147483647L};
+    for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+        line.reset();
+        line += values[i];
+        CHECK(String(values[i]) == String(line.c_str()));
+        line.reset();
+        line += static_cast<int>(values[i]);
+        CHECK(String(static_cast<int>(values[i])) == String(line.c_str()));
+    }
+    line.reset();
+    line += 4294967295UL;
+    CHECK(String(4294967295UL) == String(line.c_str()));
+    line.reset();
+    line += 0U;
+    CHECK(String(0U) == String(line.c_str()));
+}
+
+void testHex() {
+    bool all_same = true;
+    for (int value = 0; value < 256; value++) {
+        line.reset();
+        line.addHex(value);
+        all_same &= String(static_cast<unsigned char>(value), HEX) ==
+            String(line.c_str());
+    }
+    CHECK(all_same);
+}
+
+// The values a sensor or the sketch actually gives, and the cases where
+// rounding is easy to get wrong
+void testFloatRounding() {
+    // exact ties go to the even digit, like printf
+    CHECK(sameFloat(0.125f, 2));
+    CHECK(sameFloat(0.375f, 2));
+    CHECK(sameFloat(2.5f, 0));
+    CHECK(sameFloat(3.5f, 0));
+    CHECK(sameFloat(-0.5f, 0));
+    CHECK(sameFloat(1.0625f, 3));
+    // not quite ties - the float is a little above or below the decimal
+    CHECK(sameFloat(0.115f, 2));
+    CHECK(sameFloat(1.005f, 2));
+    CHECK(sameFloat(2.675f, 2));
+    CHECK(sameFloat(-1.2345f, 3));
+    // carrying into a new digit
+    CHECK(sameFloat(9.995f, 2));
+    CHECK(sameFloat(99.96f, 1));
+    CHECK(sameFloat(0.9999999f, 3));
+    // padding to decimals + 2 characters
+    CHECK(sameFloat(5, 0));
+    CHECK(sameFloat(7.3f, 1));
+    CHECK(sameFloat(-7.3f, 1));
+    CHECK(sameFloat(0, 3));
+    CHECK(sameFloat(-0.0f, 2));
+    CHECK(sameFloat(-0.001f, 2));
+    // the missing value the sketch logs
+    CHECK(sameFloat(-9999, 2));
+    CHECK(sameFloat(-9999, 3));
+    // big, small, and not numbers at all
+    CHECK(sameFloat(123456.789f, 3));
+    CHECK(sameFloat(1e17f, 1));
+    CHECK(sameFloat(3e38f, 2));
+    CHECK(sameFloat(1e-7f, 8));
+    CHECK(sameFloat(NAN, 2));
+    CHECK(sameFloat(INFINITY, 2));
+    CHECK(sameFloat(-INFINITY, 1));
+
+    // += float is String(value, 2)
+    line.reset();
+    line += 21.678f;
+    String expected;
+    expected += 21.678f;
+    CHECK(expected == String(line.c_str()));
+}
+
+// Many values like the sensors give, and many random float bit patterns
+void testManyFloats() {
+    int differences = 0;
+    for (int i = 0; i < 200000; i++) {
+        // readings with up to 4 decimal places, from -100 to 100
+        float reading = static_cast<int32_t>(nextRandom() % 2000001) - 1000000;
+        reading /= 10000;
+        if (!sameFloat(reading, i % 4)) { differences++; }
+    }
+    CHECK(differences == 0);
+
+    differences = 0;
+    for (int i = 0; i < 200000; i++) {
+        float value = floatFromBits(nextRandom());
+        // The host prints the sign of a NaN, newlib on the board doesn't
+        if (isnan(value)) { continue; }
+        if (!sameFloat(value, i % 9)) { differences++; }
+    }
+    CHECK(differences == 0);
+}
+
+void testTruncation() {
+    char            small[8];
+    recordFormatter short_line(small, sizeof(small));
+    short_line += "1234";
+    CHECK(!short_line.isTruncated());
+    short_line += 567;
+    CHECK(!short_line.isTruncated());
+    CHECK(strcmp(short_line.c_str(), "1234567") == 0);
+    short_line += ',';
+    CHECK(short_line.isTruncated());
+    CHECK(short_line.length() == 7);
+    short_line.reset();
+    CHECK(!short_line.isTruncated());
+    CHECK(short_line.length() == 0);
+}
+
+// The values for one line, in the order the sketch adds them
+struct sampleLine {
+    const char* timestamp;
+    uint32_t    epoch;
+    int16_t     rssi;
+    float       temperature;
+    float       humidity;
+    float       vega[5];
+    float       hydros[3];
+    float       lux;
+    float       battery[3];
+    uint32_t    profile[8];
+    uint8_t     frame[24];
+};
+
+const sampleLine sample = {
+    "2026-06-01T12:35:00-05:00",
+    1780335300,
+    -87,
+    21.3487f,
+    64.915f,
+    {1.234f, 2.766f, 22.4f, 41.2f, 0},
+    {1045, 21.6f, 132},
+    1532.125f,
+    {3.987f, 88.4f, -0.625f},
+    {812, 5200, 3016, 35, 2411, 8216, 3224, 11892},
+    {0x01, 0x0a, 0x6a, 0x2c, 0xff, 0x00, 0x10, 0x05, 0xd2, 0x0a, 0xce, 0x01,
+     0x38, 0x00, 0x00, 0x7f, 0x80, 0x09, 0x41, 0xe4, 0x03, 0x15, 0x7c, 0x02},
+};
+
+// Builds the line with recordFormatter, the way the sketch does
+void formatLine(recordFormatter& out, const sampleLine& s) {
+    out.reset();
+    out += s.timestamp;
+    out += ",";
+    out += static_cast<unsigned long>(s.epoch);
+    out += ",";
+    out += static_cast<int>(s.rssi);
+    out += ",";
+    out.addFloat(s.temperature, 2);
+    out += ",";
+    out.addFloat(s.humidity, 2);
+    out += ",";
+    out.addFloat(s.vega[0], 3);
+    out += ",";
+    out.addFloat(s.vega[1], 3);
+    out += ",";
+    out.addFloat(s.vega[2], 1);
+    out += ",";
+    out.addFloat(s.vega[3], 1);
+    out += ",";
+    out += s.vega[4];
+    out += ",";
+    out.addFloat(s.hydros[2], 3);
+    out += ",";
+    out.addFloat(s.hydros[1], 1);
+    out += ",";
+    out.addFloat(s.hydros[0], 0);
+    out += ",";
+    out.addFloat(s.lux, 1);
+    for (uint8_t i = 0; i < 3; i++) {
+        out += ",";
+        out.addFloat(s.battery[i], 3);
+    }
+    for (uint8_t i = 0; i < 8; i++) {
+        out += ",";
+        out += static_cast<unsigned long>(s.profile[i]);
+    }
+    out += ",";
+    for (uint8_t i = 0; i < sizeof(s.frame); i++) { out.addHex(s.frame[i]); }
+}
+
+// Builds the same line with String, the way the sketch did before
+String stringLine(const sampleLine& s) {
+    String out = s.timestamp;
+    out += ",";
+    out += static_cast<unsigned long>(s.epoch);
+    out += ",";
+    out += static_cast<int>(s.rssi);
+    out += ",";
+    out += String(s.temperature, 2);
+    out += ",";
+    out += String(s.humidity, 2);
+    out += ",";
+    out += String(s.vega[0], 3);
+    out += ",";
+    out += String(s.vega[1], 3);
+    out += ",";
+    out += String(s.vega[2], 1);
+    out += ",";
+    out += String(s.vega[3], 1);
+    out += ",";
+    out += s.vega[4];
+    out += ",";
+    out += String(s.hydros[2], 3);
+    out += ",";
+    out += String(s.hydros[1], 1);
+    out += ",";
+    out += String(s.hydros[0], 0);
+    out += ",";
+    out += String(s.lux, 1);
+    for (uint8_t i = 0; i < 3; i++) {
+        out += ",";
+        out += String(s.battery[i], 3);
+    }
+    for (uint8_t i = 0; i < 8; i++) {
+        out += ",";
+        out += static_cast<unsigned long>(s.profile[i]);
+    }
+    out += ",";
+    for (uint8_t i = 0; i < sizeof(s.frame); i++) {
+        out += String(s.frame[i], HEX);
+    }
+    return out;
+}
+
+void testSameLineAsString() {
+    formatLine(line, sample);
+    String expected = stringLine(sample);
+    CHECK(!line.isTruncated());
+    CHECK(line.length() == expected.length());
+    CHECK(strcmp(line.c_str(), expected.c_str()) == 0);
+
+    // and with the missing values logged when a sensor isn't read
+    sampleLine missing = sample;
+    for (uint8_t i = 0; i < 5; i++) { missing.vega[i] = -9999; }
+    for (uint8_t i = 0; i < 3; i++) { missing.hydros[i] = -9999; }
+    formatLine(line, missing);
+    CHECK(strcmp(line.c_str(), stringLine(missing).c_str()) == 0);
+}
+
+void benchmarkLine() {
+    const int runs  = 200000;
+    size_t    sink  = 0;
+    clock_t   start = clock();
+    for (int run = 0; run < runs; run++) {
+        String text = stringLine(sample);
+        sink += text.length();
+    }
+    double string_ns = 1e9 * (clock() - start) / CLOCKS_PER_SEC / runs;
+
+    start = clock();
+    for (int run = 0; run < runs; run++) {
+        formatLine(line, sample);
+        sink += line.length();
+    }
+    double formatter_ns = 1e9 * (clock() - start) / CLOCKS_PER_SEC / runs;
+
+    printf("\nBuilding a %u character line %d times (checksum %lu):\n",
+           static_cast<unsigned>(line.length()), runs,
+           static_cast<unsigned long>(sink));
+    printf("  String:          %7.1f ns per line\n", string_ns);
+    printf("  recordFormatter: %7.1f ns per line (%.1fx faster)\n",
+           formatter_ns, string_ns / formatter_ns);
+}
+
+int main() {
+    testIntegers();
+    testHex();
+    testFloatRounding();
+    testManyFloats();
+    testTruncation();
+    testSameLineAsString();
+    benchmarkLine();
+    return hostCheckResult("record_formatter_test");
+}
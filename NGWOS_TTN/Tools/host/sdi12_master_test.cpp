@@ -0,0 +1,341 @@
+// Runs the SDI-12 master functions and the bus scheduler against simulated
+// sensors on a simulated bus, with injected faults, and times the bus for a
+// clean read and for reads that need retries.
+//
+// See "Host Tests" in the ReadMe to build and run it.
+
+#define SDI12_BUS_CLASS sdi12SimBus
+#include "SDI12Sim.h"
+#include "HostCheck.h"
+#include "SDI12BusScheduler.h"
+
+#include <time.h>
+
+// The number of times a command was sent
+size_t countCommands(const sdi12SimBus& bus, const char* command) {
+    return std::count(bus.commands.begin(), bus.commands.end(),
+                      std::string(command));
+}
+
+// Starts a measurement and gets its results, without waiting for a service
+// request
+getResultsResult measure(sdi12SimBus& bus, char address, bool concurrent,
+                         float results[10], uint8_t page_retries = 2) {
+    startMeasurementResult started = startMeasurement(bus, address, concurrent,
+                                                      true, "", false);
+    uint32_t deadline = millis() +
+        static_cast<uint32_t>(started.meas_time_s) * 1000;
+    waitForMeasurement(bus, address, deadline, false);
+    return getResults(bus, address, started.numberResults, results, true,
+                      false, 0, 0, page_retries);
+}
+
+void testPrintInfo() {
+    sdi12SimBus bus;
+    bus.addSensor(hydros21Sensor('1'));
+    CHECK(printInfo(bus, '1', false));
+    CHECK(bus.commands.size() == 1 && bus.commands[0] == "1I!");
+    // nobody at this address - the read times out
+    uint32_t start = millis();
+    CHECK(!printInfo(bus, '5', false));
+    CHECK(millis() - start >= 1000);
+}
+
+void testStandardMeasurement() {
+    sdi12SimBus bus;
+    bus.addSensor(hydros21Sensor('1'));
+    startMeasurementResult started = startMeasurement(bus, '1', false, true,
+                                                      "", false);
+    CHECK(started.returned_address == "1");
+    CHECK(started.meas_time_s == 1);
+    CHECK(started.numberResults == 3);
+
+    // the sensor is ready after about 520 ms and says so with a service
+    // request, well before the 1 s it gave
+    uint32_t        start    = millis();
+    uint32_t        deadline = start + 1000;
+    sdi12WaitResult waited = waitForMeasurement(bus, '1', deadline, true);
+    CHECK(waited == SDI12_WAIT_SERVICE_REQUEST);
+    CHECK(millis() - start >= 520 && millis() - start < 600);
+
+    float            results[10];
+    getResultsResult got = getResults(bus, '1', 3, results, true, false);
+    CHECK(got.success && got.crcMatch && got.addressMatch);
+    CHECK(got.resultsReceived == 3 && got.maxDataCommand == 1);
+    CHECK_NEAR(results[0], 132, 1e-4);
+    CHECK_NEAR(results[1], 21.6, 1e-4);
+    CHECK_NEAR(results[2], 1045, 1e-4);
+}
+
+void testConcurrentMeasurement() {
+    sdi12SimBus bus;
+    bus.addSensor(vegaPulsSensor('0'));
+    startMeasurementResult started = startMeasurement(bus, '0', true, true, "",
+                                                      false);
+    CHECK(started.meas_time_s == 3 && started.numberResults == 5);
+    // concurrent measurements never send a service request
+    uint32_t deadline = millis() + 3000;
+    CHECK(waitForMeasurement(bus, '0', deadline, false) ==
+          SDI12_WAIT_DEADLINE);
+    CHECK(millis() == deadline);
+
+    float            results[10];
+    getResultsResult got = getResults(bus, '0', 5, results, true, false, 5, 0);
+    CHECK(got.success && got.resultsReceived == 5 && !got.errorCode);
+    CHECK_NEAR(results[0], 1.234, 1e-6);
+    CHECK_NEAR(results[1], 2.766, 1e-6);
+    CHECK_NEAR(results[2], 22.4, 1e-5);
+    CHECK_NEAR(results[3], 41.2, 1e-5);
+    CHECK_NEAR(results[4], 0, 1e-6);
+}
+
+void testCollectingTooEarly() {
+    sdi12SimBus bus;
+    bus.addSensor(vegaPulsSensor('0'));
+    startMeasurement(bus, '0', true, true, "", false);
+    // a concurrent measurement that isn't ready answers with only its address
+    float            results[10];
+    getResultsResult got = getResults(bus, '0', 5, results, true, false);
+    CHECK(!got.success && got.resultsReceived == 0 && got.crcMatch);
+}
+
+void testMissingServiceRequest() {
+    sdi12SimBus bus;
+    bus.addSensor(hydros21Sensor('1'));
+    bus.injectFault('1', "M", SDI12_FAULT_NO_SERVICE_REQUEST);
+    startMeasurement(bus, '1', false, true, "", false);
+    uint32_t deadline = millis() + 1000;
+    CHECK(waitForMeasurement(bus, '1', deadline, true, 1000) ==
+          SDI12_WAIT_TIMEOUT);
+    CHECK(millis() == deadline + 1000);
+    // the data is there anyway
+    float results[10];
+    CHECK(getResults(bus, '1', 3, results, true, false).success);
+}
+
+void testLateData() {
+    sdi12SimBus bus;
+    sdi12VirtualSensor hydros = hydros21Sensor('1');
+    hydros.readyMillis        = {700};
+    bus.addSensor(hydros);
+    bus.injectFault('1', "M", SDI12_FAULT_LATE_DATA);
+    startMeasurement(bus, '1', false, true, "", false);
+    // the service request comes 400 ms after the 1 s deadline
+    uint32_t start = millis();
+    CHECK(waitForMeasurement(bus, '1', start + 1000, true, 1000) ==
+          SDI12_WAIT_SERVICE_REQUEST);
+    CHECK(millis() - start >= 1400 && millis() - start < 1500);
+}
+
+void testRetryGarbledPage() {
+    sdi12SimBus bus;
+    bus.addSensor(vegaPulsSensor('0'));
+    bus.injectFault('0', "D0", SDI12_FAULT_GARBLED);
+    float            results[10];
+    getResultsResult got = measure(bus, '0', true, results);
+    CHECK(got.success && got.crcMatch);
+    CHECK(got.retries == 1 && got.retriedPages == 0x01);
+    CHECK(countCommands(bus, "0D0!") == 2);
+    CHECK_NEAR(results[0], 1.234, 1e-6);
+}
+
+void testRetryOnlyTheFailedPage() {
+    sdi12SimBus        bus;
+    sdi12VirtualSensor vega = vegaPulsSensor('0');
+    vega.pageLayout         = {3, 2};
+    bus.addSensor(vega);
+    bus.injectFault('0', "D1", SDI12_FAULT_GARBLED);
+    float            results[10];
+    getResultsResult got = measure(bus, '0', true, results);
+    CHECK(got.success && got.resultsReceived == 5 && got.maxDataCommand == 2);
+    CHECK(got.retries == 1 && got.retriedPages == 0x02);
+    CHECK(countCommands(bus, "0D0!") == 1);
+    CHECK(countCommands(bus, "0D1!") == 2);
+    CHECK_NEAR(results[3], 41.2, 1e-5);
+}
+
+void testRetriesRunOut() {
+    sdi12SimBus bus;
+    bus.addSensor(hydros21Sensor('1'));
+    bus.injectFault('1', "D0", SDI12_FAULT_WRONG_ADDRESS, 3);
+    float            results[10];
+    getResultsResult got = measure(bus, '1', true, results, 2);
+    CHECK(!got.success && !got.addressMatch && got.crcMatch);
+    CHECK(got.retries == 2 && got.resultsReceived == 0);
+    CHECK(countCommands(bus, "1D0!") == 3);
+}
+
+void testNoResponse() {
+    sdi12SimBus bus;
+    bus.addSensor(hydros21Sensor('1'));
+    bus.injectFault('1', "D0", SDI12_FAULT_NO_RESPONSE);
+    float            results[10];
+    uint32_t         start = millis();
+    getResultsResult got   = measure(bus, '1', true, results, 1);
+    CHECK(got.success && got.retries == 1);
+    // the silent page costs the whole stream timeout
+    CHECK(millis() - start >= 1000 + 1000);
+}
+
+void testTruncatedAndNoisyResponses() {
+    sdi12SimBus bus;
+    bus.addSensor(hydros21Sensor('1'));
+    bus.injectFault('1', "D0", SDI12_FAULT_TRUNCATED);
+    float            results[10];
+    getResultsResult got = measure(bus, '1', true, results);
+    CHECK(got.success && got.retries == 1);
+
+    // characters after the <CR><LF> are thrown away, not retried
+    bus.injectFault('1', "D0", SDI12_FAULT_EXTRA_CHARACTERS);
+    got = measure(bus, '1', true, results);
+    CHECK(got.success && got.retries == 0);
+    CHECK(bus.faultsLeft() == 0);
+}
+
+void testPageTiming() {
+    sdi12SimBus bus;
+    bus.addSensor(hydros21Sensor('1'));
+    startMeasurement(bus, '1', true, true, "", false);
+    delay(1000);
+    // the wake-up with its extra delay, 4 command characters, the latency, and
+    // the 20 characters of "1+132+21.6+1045" with its CRC and <CR><LF>
+    uint32_t expected_us = SDI12_SIM_WAKE_US + wake_delay * 1000 +
+        4 * SDI12_SIM_CHARACTER_US +
+        SDI12_SIM_RESPONSE_LATENCY_US + 20 * SDI12_SIM_CHARACTER_US;
+    uint32_t start = micros();
+    float    results[10];
+    CHECK(getResults(bus, '1', 3, results, true, false).success);
+    uint32_t took_us = micros() - start;
+    CHECK(took_us >= expected_us && took_us < expected_us + 1000);
+}
+
+void testSchedulerConcurrent() {
+    sdi12SimBus bus;
+    bus.addSensor(vegaPulsSensor('0'));
+    bus.addSensor(hydros21Sensor('1'));
+    sdi12BusScheduler scheduler(bus, true, true, false);
+    int8_t            vega   = scheduler.addSensor('0', 5, 0);
+    int8_t            hydros = scheduler.addSensor('1');
+
+    uint32_t start = millis();
+    CHECK(scheduler.startAll() == 2);
+    // the Hydros 21 is ready first, so it's collected first
+    CHECK(scheduler.collectNext() == hydros);
+    CHECK(scheduler.collectNext() == vega);
+    CHECK(scheduler.collectNext() == -1);
+    // the wait for the bus is the longest measurement, not the sum
+    CHECK(millis() - start < 3000 + 1000);
+    CHECK(scheduler.getSensor(vega).result.success);
+    CHECK(scheduler.getSensor(hydros).result.success);
+    CHECK_NEAR(scheduler.getSensor(hydros).results[2], 1045, 1e-4);
+
+    // a sensor that isn't due isn't measured
+    scheduler.setEnabled(vega, false);
+    bus.commands.clear();
+    CHECK(scheduler.startAll() == 1);
+    while (scheduler.collectNext() >= 0) {}
+    CHECK(countCommands(bus, "0CC!") == 0);
+    CHECK(scheduler.getSensor(vega).numberResults == 0);
+}
+
+void testSchedulerSingleSensor() {
+    sdi12SimBus bus;
+    bus.addSensor(vegaPulsSensor('0'));
+    bus.addSensor(hydros21Sensor('1'));
+    // concurrent by default, like the sketch
+    sdi12BusScheduler scheduler(bus, true, true, false);
+    int8_t            vega   = scheduler.addSensor('0', 5, 0);
+    int8_t            hydros = scheduler.addSensor('1');
+    scheduler.setEnabled(hydros, false);
+
+    // with only one sensor due, it gets a standard measurement, and its
+    // service request ends the wait before the 3 s it gave
+    CHECK(scheduler.startAll() == 1);
+    CHECK(countCommands(bus, "0MC!") == 1 && countCommands(bus, "0CC!") == 0);
+    CHECK(scheduler.collectNext() == vega);
+    sdi12ScheduledSensor& sensor = scheduler.getSensor(vega);
+    CHECK(sensor.waitResult == SDI12_WAIT_SERVICE_REQUEST);
+    CHECK(sensor.finishedAt - sensor.startedAt < 2300);
+    CHECK(sensor.result.success);
+
+    // with both due, they go back to concurrent measurements
+    scheduler.setEnabled(hydros, true);
+    CHECK(scheduler.startAll() == 2);
+    CHECK(countCommands(bus, "0CC!") == 1 && countCommands(bus, "1CC!") == 1);
+    while (scheduler.collectNext() >= 0) {}
+    CHECK(scheduler.getSensor(vega).waitResult == SDI12_WAIT_DEADLINE);
+}
+
+void testSchedulerStandard() {
+    sdi12SimBus bus;
+    bus.addSensor(vegaPulsSensor('0'));
+    bus.addSensor(hydros21Sensor('1'));
+    sdi12BusScheduler scheduler(bus, true, false, false);
+    int8_t            vega   = scheduler.addSensor('0', 5, 0);
+    int8_t            hydros = scheduler.addSensor('1');
+
+    // standard measurements take turns, each ended by its service request
+    CHECK(scheduler.startAll() == 1);
+    CHECK(scheduler.collectNext() == vega);
+    CHECK(scheduler.getSensor(vega).waitResult == SDI12_WAIT_SERVICE_REQUEST);
+    CHECK(scheduler.collectNext() == hydros);
+    CHECK(scheduler.getSensor(hydros).waitResult ==
+          SDI12_WAIT_SERVICE_REQUEST);
+    CHECK(scheduler.collectNext() == -1);
+    CHECK(scheduler.getSensor(vega).result.success);
+    CHECK(scheduler.getSensor(hydros).result.success);
+}
+
+// Times a clean read and reads with retries on the simulated bus, and the
+// processor time for the master functions to handle them
+void benchmarkRetries() {
+    const char*   names[]  = {"clean", "garbled D0", "no response D0",
+                              "wrong address D0 x2"};
+    sdi12SimFault faults[] = {SDI12_FAULT_GARBLED, SDI12_FAULT_GARBLED,
+                              SDI12_FAULT_NO_RESPONSE,
+                              SDI12_FAULT_WRONG_ADDRESS};
+    uint8_t       times[]  = {0, 1, 1, 2};
+    const int     runs     = 2000;
+
+    printf("\nVega Puls data commands, %d runs each:\n", runs);
+    printf("%-22s %12s %14s\n", "case", "bus ms", "cpu us/run");
+    for (uint8_t c = 0; c < 4; c++) {
+        uint64_t bus_us = 0;
+        clock_t  cpu    = 0;
+        for (int run = 0; run < runs; run++) {
+            sdi12SimBus bus;
+            bus.addSensor(vegaPulsSensor('0'));
+            if (times[c]) { bus.injectFault('0', "D0", faults[c], times[c]); }
+            startMeasurement(bus, '0', true, true, "", false);
+            delay(3000);
+            uint64_t clk_start = hostClockMicros();
+            float    results[10];
+            clock_t  cpu_start = clock();
+            getResults(bus, '0', 5, results, true, false, 5, 0, 2);
+            cpu += clock() - cpu_start;
+            bus_us += hostClockMicros() - clk_start;
+        }
+        printf("%-22s %12.1f %14.2f\n", names[c], bus_us / 1000.0 / runs,
+               1e6 * cpu / CLOCKS_PER_SEC / runs);
+    }
+}
+
+int main() {
+    testPrintInfo();
+    testStandardMeasurement();
+    testConcurrentMeasurement();
+    testCollectingTooEarly();
+    testMissingServiceRequest();
+    testLateData();
+    testRetryGarbledPage();
+    testRetryOnlyTheFailedPage();
+    testRetriesRunOut();
+    testNoResponse();
+    testTruncatedAndNoisyResponses();
+    testPageTiming();
+    testSchedulerConcurrent();
+    testSchedulerStandard();
+    testSchedulerSingleSensor();
+    benchmarkRetries();
+    return hostCheckResult("sdi12_master_test");
+}
@@ -0,0 +1,317 @@
+// Tests the allocation-free SDI-12 response parser in SDI12Master.h, and
+// benchmarks it against the String and atof() parser it replaced on Hydros 21
+// and Vega Puls responses.
+//
+// See "Host Tests" in the ReadMe to build and run it.
+
+#define SDI12_BUS_CLASS sdi12SimBus
+#include "SDI12Sim.h"
+#include "HostCheck.h"
+#include "SDI12Master.h"
+
+#include <time.h>
+
+// Responses like those from a Vega Puls (address 0) and a Hydros 21 (address
+// 1), with CRCs but without the <CR><LF>, and the values in them.  The first
+// is the example from the SDI-12 specification.  Add responses copied from a
+// real sensor's serial output here to test and time them too.
+struct sampleResponse {
+    const char* response;
+    uint8_t     numberValues;
+    float       values[5];
+};
+const sampleResponse samples[] = {
+    {"0+3.14OqZ", 1, {3.14f}},
+    {"0+1.234+2.766+22.4+41.2+0Doq", 5, {1.234f, 2.766f, 22.4f, 41.2f, 0}},
+    {"0+0.873+3.127+18.9+38.6+0MAp", 5, {0.873f, 3.127f, 18.9f, 38.6f, 0}},
+    {"0-0.012+4.012+5.1+12.3+3Fr`", 5, {-0.012f, 4.012f, 5.1f, 12.3f, 3}},
+    {"0+1.234+2.766+22.4CB`", 3, {1.234f, 2.766f, 22.4f}},
+    {"0+41.2+0JUW", 2, {41.2f, 0}},
+    {"1+132+21.6+1045CKa", 3, {132, 21.6f, 1045}},
+    {"1+0+4.3+0BUz", 3, {0, 4.3f, 0}},
+    {"1-3+25.1+212LRW", 3, {-3, 25.1f, 212}},
+};
+const size_t numberSamples = sizeof(samples) / sizeof(samples[0]);
+
+sdi12ParsedResponse parse(const char* response, bool has_crc,
+                          sdi12Value values[SDI12_MAX_VALUES_PER_RESPONSE]) {
+    return parseSDI12Response(response, strlen(response), has_crc, values,
+                              SDI12_MAX_VALUES_PER_RESPONSE);
+}
+
+void testSampleResponses() {
+    sdi12Value values[SDI12_MAX_VALUES_PER_RESPONSE];
+    for (size_t r = 0; r < numberSamples; r++) {
+        sdi12ParsedResponse parsed = parse(samples[r].response, true, values);
+        CHECK(parsed.address == samples[r].response[0]);
+        CHECK(parsed.crcMatch && parsed.valuesValid);
+        CHECK(parsed.numberValues == samples[r].numberValues);
+        for (uint8_t v = 0; v < parsed.numberValues; v++) {
+            CHECK(sdi12ValueToFloat(values[v]) == samples[r].values[v]);
+        }
+    }
+}
+
+void testCRC() {
+    sdi12Value values[SDI12_MAX_VALUES_PER_RESPONSE];
+    // the example from the specification
+    CHECK(parse("0+3.14OqZ", true, values).crcMatch);
+    // a changed digit, a changed CRC character, and a swapped pair
+    CHECK(!parse("0+3.15OqZ", true, values).crcMatch);
+    CHECK(!parse("0+3.14OqY", true, values).crcMatch);
+    CHECK(!parse("0+3.41OqZ", true, values).crcMatch);
+    // the address is part of the CRC
+    CHECK(!parse("1+3.14OqZ", true, values).crcMatch);
+    // too short to have an address and a CRC
+    CHECK(!parse("0Oq", true, values).crcMatch);
+    CHECK(!parse("", true, values).crcMatch);
+    // an address and a CRC with no values, as from a measurement that
+    // isn't ready
+    std::string empty = "0";
+    uint16_t    crc   = sdi12UpdateCRC(0, '0');
+    empty += static_cast<char>(0x40 | (crc >> 12));
+    empty += static_cast<char>(0x40 | ((crc >> 6) & 0x3F));
+    empty += static_cast<char>(0x40 | (crc & 0x3F));
+    sdi12ParsedResponse parsed = parse(empty.c_str(), true, values);
+    CHECK(parsed.crcMatch && parsed.numberValues == 0);
+    // without a CRC, the last characters are values
+    parsed = parse("0+3.14", false, values);
+    CHECK(parsed.crcMatch && parsed.numberValues == 1);
+    CHECK(sdi12ValueToFloat(values[0]) == 3.14f);
+}
+
+void testSigns() {
+    sdi12Value          values[SDI12_MAX_VALUES_PER_RESPONSE];
+    sdi12ParsedResponse parsed = parse("0+1-2+3.5-0.25-0+7", false, values);
+    CHECK(parsed.numberValues == 6);
+    CHECK(!values[0].negative && values[0].digits == 1);
+    CHECK(values[1].negative && values[1].digits == 2);
+    CHECK(!values[2].negative && values[2].digits == 35 &&
+          values[2].decimalPlaces == 1);
+    CHECK(values[3].negative && values[3].digits == 25 &&
+          values[3].decimalPlaces == 2);
+    // negative zero is still zero
+    CHECK(values[4].negative && values[4].digits == 0);
+    CHECK(sdi12ValueToFloat(values[4]) == 0);
+    CHECK(sdi12ValueToFloat(values[5]) == 7);
+
+    // each sign starts a new value, even right after another sign or a
+    // decimal place
+    parsed = parse("0+-1", false, values);
+    CHECK(parsed.numberValues == 2 && values[0].digits == 0);
+    CHECK(sdi12ValueToFloat(values[1]) == -1);
+    parsed = parse("0+1.-2", false, values);
+    CHECK(parsed.numberValues == 2);
+    CHECK(sdi12ValueToFloat(values[0]) == 1 && values[0].decimalPlaces == 0);
+    CHECK(sdi12ValueToFloat(values[1]) == -2);
+
+    // a value without a sign starts a new value too, and the missing value
+    // code comes through as it is
+    parsed = parse("05-9999", false, values);
+    CHECK(parsed.numberValues == 2 && sdi12ValueToFloat(values[0]) == 5);
+    CHECK(sdi12ValueToFloat(values[1]) == -9999);
+
+    // values past the end of the caller's array are dropped
+    sdi12Value two[2];
+    parsed = parseSDI12Response("0+1+2+3", 7, false, two, 2);
+    CHECK(parsed.numberValues == 2 && sdi12ValueToFloat(two[1]) == 2);
+}
+
+void testValueLength() {
+    sdi12Value          values[SDI12_MAX_VALUES_PER_RESPONSE];
+    // the most digits that can be kept, before and after the decimal place
+    sdi12ParsedResponse parsed = parse("1+123456789-0.12345678", false,
+                                       values);
+    CHECK(parsed.valuesValid && parsed.numberValues == 2);
+    CHECK(values[0].digits == 123456789);
+    CHECK(values[1].digits == 12345678 && values[1].decimalPlaces == 8);
+    // leading zeros don't count
+    parsed = parse("1+0000000001.5C}K", true, values);
+    CHECK(parsed.valuesValid && parsed.crcMatch);
+    CHECK(sdi12ValueToFloat(values[0]) == 1.5f);
+    // one more digit is an error, not a value a power of ten too small
+    parsed = parse("1+1234567890JII", true, values);
+    CHECK(parsed.crcMatch && !parsed.valuesValid);
+    CHECK(!parse("1+1.234567890", false, values).valuesValid);
+    CHECK(!parse("1+0.0000000001", false, values).valuesValid);
+    // the limit is for each value, not the whole response
+    CHECK(parse("1+12345+67890+12345", false, values).valuesValid);
+}
+
+void testMultiplePages() {
+    sdi12SimBus        bus;
+    sdi12VirtualSensor vega = vegaPulsSensor('0');
+    vega.pageLayout         = {2, 2, 1};
+    bus.addSensor(vega);
+    startMeasurement(bus, '0', true, true, "", false);
+    delay(3000);
+    float            results[10];
+    getResultsResult got = getResults(bus, '0', 5, results, true, false);
+    CHECK(got.success && got.resultsReceived == 5 && got.maxDataCommand == 3);
+    CHECK(bus.commands.back() == "0D2!");
+    CHECK(results[0] == 1.234f && results[2] == 22.4f && results[4] == 0);
+
+    // a page with a value that's too long is retried, then fails without
+    // losing the pages before it
+    sdi12SimBus        bad_bus;
+    sdi12VirtualSensor hydros = hydros21Sensor('1');
+    hydros.values             = {"+132", "+21.6", "+1045123456"};
+    hydros.pageLayout         = {2, 1};
+    bad_bus.addSensor(hydros);
+    startMeasurement(bad_bus, '1', true, true, "", false);
+    delay(1000);
+    got = getResults(bad_bus, '1', 3, results, true, false, 0, 0, 1);
+    CHECK(!got.success && !got.valuesValid && got.crcMatch);
+    CHECK(got.addressMatch && got.retries == 1 && got.retriedPages == 0x02);
+    CHECK(got.resultsReceived == 2 && results[1] == 21.6f);
+}
+
+// ==========================================================================
+// The String parser that getResults() used before
+// ==========================================================================
+
+// The SDI-12 library's CRC check, which works on Strings
+bool legacyVerifyCRC(String& respWithCRC) {
+    uint16_t nChar   = respWithCRC.length();
+    String   recCRC  = respWithCRC.substring(nChar - 3, nChar);
+    String   without = respWithCRC.substring(0, nChar - 3);
+    uint16_t crc     = 0;
+    for (uint16_t i = 0; i < without.length(); i++) {
+        crc = sdi12UpdateCRC(crc, without[i]);
+    }
+    String calcCRC = "";
+    calcCRC += static_cast<char>(0x40 | (crc >> 12));
+    calcCRC += static_cast<char>(0x40 | ((crc >> 6) & 0x3F));
+    calcCRC += static_cast<char>(0x40 | (crc & 0x3F));
+    return recCRC == calcCRC;
+}
+
+// The parsing from the old getResults(), for one response as read from the
+// bus, with its <CR> but not its <LF>
+uint8_t legacyParse(const char* resp_buffer, size_t bytes_read,
+                    bool verify_crc, String& compiled_response,
+                    float sdi12_results[10]) {
+    int     max_sdi_digits  = 21;
+    uint8_t resultsReceived = 0;
+
+    size_t data_bytes_read = bytes_read - 1;
+    String sdiResponse     = String(resp_buffer);
+    compiled_response += sdiResponse;
+    sdiResponse.trim();
+    if (verify_crc) {
+        if (!legacyVerifyCRC(sdiResponse)) { return 0; }
+        data_bytes_read = data_bytes_read - 3;
+    }
+
+    char    float_buffer[21]     = {'\0'};
+    uint8_t fb_pos               = 0;
+    bool    finished_last_number = false;
+    for (size_t i = 1; i < data_bytes_read; i++) {
+        char c = resp_buffer[i];
+        if (c == '-' || (c >= '0' && c <= '9') || c == '.') {
+            float_buffer[fb_pos] = c;
+            fb_pos++;
+            float_buffer[fb_pos] = '\0';
+            finished_last_number = false;
+        } else {
+            finished_last_number = true;
+        }
+        if ((finished_last_number || i == data_bytes_read - 1) &&
+            strnlen(float_buffer, max_sdi_digits) > 0) {
+            float result                   = atof(float_buffer);
+            sdi12_results[resultsReceived] = result;
+            if (result != -9999) { resultsReceived++; }
+            float_buffer[0] = '\0';
+            fb_pos          = 0;
+        }
+    }
+    return resultsReceived;
+}
+
+// The new parsing for one response, as getResults() does it
+uint8_t newParse(const char* resp_buffer, size_t bytes_read, bool verify_crc,
+                 float sdi12_results[10]) {
+    sdi12Value          values[SDI12_MAX_VALUES_PER_RESPONSE];
+    sdi12ParsedResponse parsed = parseSDI12Response(
+        resp_buffer, bytes_read, verify_crc, values,
+        SDI12_MAX_VALUES_PER_RESPONSE);
+    if (!parsed.crcMatch || !parsed.valuesValid) { return 0; }
+    uint8_t resultsReceived = 0;
+    for (uint8_t v = 0; v < parsed.numberValues && resultsReceived < 10; v++) {
+        float result                   = sdi12ValueToFloat(values[v]);
+        sdi12_results[resultsReceived] = result;
+        if (result != -9999) { resultsReceived++; }
+    }
+    return resultsReceived;
+}
+
+// Both parsers get the same values from every sample response
+void testSameAsLegacy() {
+    for (size_t r = 0; r < numberSamples; r++) {
+        std::string with_cr = std::string(samples[r].response) + "\r";
+        String      compiled;
+        float       old_results[10];
+        float       new_results[10];
+        uint8_t     old_count = legacyParse(with_cr.c_str(), with_cr.size(),
+                                            true, compiled, old_results);
+        uint8_t     new_count = newParse(samples[r].response,
+                                         strlen(samples[r].response), true,
+                                         new_results);
+        CHECK(old_count == new_count);
+        for (uint8_t v = 0; v < old_count && v < new_count; v++) {
+            CHECK(old_results[v] == new_results[v]);
+        }
+    }
+}
+
+void benchmarkParsers() {
+    // the old parser was given the <CR> too
+    std::string with_cr[numberSamples];
+    for (size_t r = 0; r < numberSamples; r++) {
+        with_cr[r] = std::string(samples[r].response) + "\r";
+    }
+
+    const int runs  = 200000;
+    float     sink  = 0;
+    clock_t   start = clock();
+    for (int run = 0; run < runs; run++) {
+        String compiled;
+        for (size_t r = 0; r < numberSamples; r++) {
+            float results[10];
+            legacyParse(with_cr[r].c_str(), with_cr[r].size(), true, compiled,
+                        results);
+            sink += results[0];
+        }
+    }
+    double old_ns = 1e9 * (clock() - start) / CLOCKS_PER_SEC /
+        (runs * numberSamples);
+
+    start = clock();
+    for (int run = 0; run < runs; run++) {
+        for (size_t r = 0; r < numberSamples; r++) {
+            float results[10];
+            newParse(samples[r].response, strlen(samples[r].response), true,
+                     results);
+            sink += results[0];
+        }
+    }
+    double new_ns = 1e9 * (clock() - start) / CLOCKS_PER_SEC /
+        (runs * numberSamples);
+
+    printf("\nParsing %u sample responses %d times (checksum %g):\n",
+           static_cast<unsigned>(numberSamples), runs, sink);
+    printf("  String and atof:    %6.1f ns per response\n", old_ns);
+    printf("  parseSDI12Response: %6.1f ns per response (%.1fx faster)\n",
+           new_ns, old_ns / new_ns);
+}
+
+int main() {
+    testSampleResponses();
+    testCRC();
+    testSigns();
+    testValueLength();
+    testMultiplePages();
+    testSameAsLegacy();
+    benchmarkParsers();
+    return hostCheckResult("sdi12_parser_test");
+}
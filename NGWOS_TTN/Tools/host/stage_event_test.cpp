@@ -0,0 +1,110 @@
+// Tests when StageEventDetector.h starts and ends a stage event, with the
+// logging intervals the sketch uses: 5 minutes normally and 1 minute during an
+// event.
+//
+// See "Host Tests" in the ReadMe to build and run it.
+
+#include <Arduino.h>
+#include "HostCheck.h"
+#include "StageEventDetector.h"
+
+const float    triggerRate = 0.15;  // m per hour
+const uint32_t window      = 300;   // the 5 minute logging interval
+
+// Noise of a couple of millimeters, the same on every run
+float noise(uint32_t n) {
+    static const float offsets[] = {0.002f, -0.002f, 0.001f,  -0.001f,
+                                    0.002f, 0,       -0.002f, 0.001f};
+    return offsets[n % (sizeof(offsets) / sizeof(offsets[0]))];
+}
+
+void testCalmStageNeverStarts() {
+    stageEventDetector detector(triggerRate, -9999, window);
+    bool               started = false;
+    for (uint32_t n = 0; n < 288; n++) {
+        started |= detector.addReading(1.5f + noise(n), n * 300);
+    }
+    CHECK(!started);
+    CHECK(!detector.isActive());
+}
+
+void testRiseStartsEvent() {
+    stageEventDetector detector(triggerRate, -9999, window);
+    CHECK(!detector.addReading(1.0f, 0));
+    CHECK(!detector.addReading(1.0f, 300));
+    // 2 cm in 5 minutes is 0.24 m per hour
+    CHECK(detector.addReading(1.02f, 600));
+    CHECK(detector.isActive());
+    CHECK_NEAR(detector.getRate(), 0.24, 0.001);
+    // already going, so it doesn't start again
+    CHECK(!detector.addReading(1.04f, 900));
+}
+
+// The case that never ended when the rate was taken between consecutive
+// readings: 2 mm of noise a minute apart looks like 0.12 m per hour, more than
+// half the trigger rate
+void testNoiseAtOneMinuteEndsEvent() {
+    stageEventDetector detector(triggerRate, -9999, window);
+    detector.addReading(1.0f, 0);
+    CHECK(detector.addReading(1.05f, 300));
+
+    uint32_t epoch = 300;
+    uint32_t n     = 0;
+    while (detector.isActive() && n < 60) {
+        epoch += 60;
+        detector.addReading(1.05f + noise(n++), epoch);
+    }
+    CHECK(!detector.isActive());
+    // the rate is measured over 5 minutes, so it settles once the window is
+    // past the rise, and then takes STAGE_EVENT_CALM_READINGS readings
+    CHECK(n <= 5 + STAGE_EVENT_CALM_READINGS);
+}
+
+void testSteadyRiseKeepsEvent() {
+    stageEventDetector detector(triggerRate, -9999, window);
+    detector.addReading(1.0f, 0);
+    CHECK(detector.addReading(1.02f, 300));
+    // rising at 0.1 m per hour, more than half the trigger rate, with noise
+    bool ended = false;
+    for (uint32_t n = 1; n <= 60; n++) {
+        float stage = 1.02f + 0.1f * n / 60 + noise(n);
+        detector.addReading(stage, 300 + n * 60);
+        ended |= !detector.isActive();
+    }
+    CHECK(!ended);
+}
+
+void testThresholdAndMissingReadings() {
+    stageEventDetector detector(triggerRate, 2.0f, window);
+    CHECK(!detector.addReading(1.99f, 0));
+    CHECK(!detector.addReading(-9999, 300));
+    CHECK(!detector.addReading(NAN, 600));
+    // crossing the threshold starts an event even when it's slow
+    CHECK(detector.addReading(2.0f, 900));
+    CHECK(detector.isActive());
+    // missing readings don't count as calm ones
+    for (uint32_t n = 0; n < 10; n++) { detector.addReading(-9999, 960); }
+    CHECK(detector.isActive());
+}
+
+// Readings closer together than the window, before there are any that old
+void testShortHistory() {
+    stageEventDetector detector(triggerRate, -9999, window);
+    detector.addReading(1.0f, 0);
+    // measured from the only reading there is
+    CHECK(detector.addReading(1.01f, 60));
+    CHECK_NEAR(detector.getRate(), 0.6, 0.001);
+    // a clock that goes backwards starts the history over
+    CHECK(!detector.addReading(3.0f, 30));
+    CHECK(!detector.addReading(3.0f, 330));
+}
+
+int main() {
+    testCalmStageNeverStarts();
+    testRiseStartsEvent();
+    testNoiseAtOneMinuteEndsEvent();
+    testSteadyRiseKeepsEvent();
+    testThresholdAndMissingReadings();
+    testShortHistory();
+    return hostCheckResult("stage_event_test");
+}